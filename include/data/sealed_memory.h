@@ -0,0 +1,53 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef VELES_DATA_SEALED_MEMORY_H
+#define VELES_DATA_SEALED_MEMORY_H
+
+#include <stdint.h>
+#include <memory>
+
+namespace veles {
+namespace data {
+
+// A read-only copy of some data in a sealed memfd, so that it can be handed
+// to other processes (see NetworkConnection) - they can map it, but nobody
+// can change or resize it.  Linux only.
+class SealedMemory {
+ public:
+  // Returns nullptr if shared memory is not supported or creating it failed.
+  static std::shared_ptr<const SealedMemory> create(const uint8_t *data,
+                                                    uint64_t size);
+  ~SealedMemory();
+
+  SealedMemory(const SealedMemory &) = delete;
+  SealedMemory &operator=(const SealedMemory &) = delete;
+
+  // Stays owned by this object - dup() it to pass it on.
+  int fd() const { return fd_; }
+  uint64_t size() const { return size_; }
+
+ private:
+  SealedMemory(int fd, uint64_t size) : fd_(fd), size_(size) {}
+
+  int fd_;
+  uint64_t size_;
+};
+
+}  // namespace data
+}  // namespace veles
+
+#endif  // VELES_DATA_SEALED_MEMORY_H
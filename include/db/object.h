@@ -18,6 +18,7 @@
 #define VELES_DB_OBJECT_H
 
 #include <atomic>
+#include <memory>
 
 #include <QSet>
 #include <QMap>
@@ -27,6 +28,8 @@
 #include "dbif/types.h"
 #include "db/types.h"
 #include "data/bindata.h"
+#include "data/sealed_memory.h"
+#include "util/histogram_index.h"
 
 namespace veles {
 namespace db {
@@ -37,21 +40,36 @@ class LocalObject : public QEnableSharedFromThis<LocalObject> {
   QString comment_;
   static std::atomic<uint64_t> static_id_;
   uint64_t id_;
-  QSet<PLocalObject> children_;
+  // Ordered by id, so listings can resume at any child.
+  QMap<uint64_t, PLocalObject> children_;
   QSet<InfoGetter *> children_watchers_;
   QSet<InfoGetter *> description_watchers_;
+  bool children_dirty_;
+  bool updates_deferred_;
   void children_reply(InfoGetter *getter);
+  void subtree_reply(InfoGetter *getter, const dbif::SubtreeRequest &req);
   void remove_description_watcher(InfoGetter * getter);
   void remove_children_watcher(InfoGetter * getter);
 
  protected:
-  virtual void killed() {}
+  // Called for every object of a dying subtree, once the whole subtree is
+  // marked dead.  Detaches the object from its parent if that one survives
+  // and collects the getters that need to be told the object is gone.
+  virtual void killed(QSet<InfoGetter *> *watchers);
   void description_updated();
   virtual void children_updated();
   virtual void description_reply(InfoGetter *getter);
+  // Fills in everything but parent_id.
+  virtual void snapshot(dbif::ObjectSnapshot *res, bool with_items);
+  void children_changed();
+  bool children_dirty() const { return children_dirty_; }
+  // Queues this object's notifications until the current batch ends.
+  void defer_updates();
+  virtual void flush_updates();
 
  public:
-  LocalObject(Universe *db, QString name) : db_(db), name_(name), id_(++static_id_) {}
+  LocalObject(Universe *db, QString name) : db_(db), name_(name), id_(++static_id_),
+    children_dirty_(false), updates_deferred_(false) {}
   virtual ~LocalObject() { Q_ASSERT(dead()); }
   virtual void getInfo(InfoGetter *getter, PInfoRequest req, bool once);
   virtual void runMethod(MethodRunner *runner, PMethodRequest req);
@@ -64,8 +82,9 @@ class LocalObject : public QEnableSharedFromThis<LocalObject> {
   QString name() const { return name_; }
   QString comment() const { return comment_; }
   uint64_t id() const { return id_; }
-  const QSet<PLocalObject>& children() { return children_; }
+  const QMap<uint64_t, PLocalObject>& children() { return children_; }
   void setComment(QString comment);
+  void flushUpdates();
 };
 
 class RootLocalObject : public LocalObject {
@@ -88,23 +107,35 @@ class RootLocalObject : public LocalObject {
 
 class DataBlobObject : public LocalObject {
   LocalObject *parent_;
-  data::BinData data_;
+  // Shared with snapshots (see BlobSnapshotRequest), copied before changes
+  // if any are left.
+  std::shared_ptr<data::BinData> data_;
+  // Shared memory copy of data_, made on request and dropped when it
+  // changes.
+  std::shared_ptr<const data::SealedMemory> sealed_data_;
+  // Index of data_ for server-side histograms, made on request and dropped
+  // when it changes.
+  std::shared_ptr<util::HistogramIndex> histogram_index_;
   QMap<InfoGetter *, std::pair<uint64_t, uint64_t>> data_watchers_;
 
   void data_reply(InfoGetter *getter, uint64_t start, uint64_t end);
   void remove_data_watcher(InfoGetter *getter);
+  void editTree(MethodRunner *runner, const dbif::ChunkCreateTreeRequest &req,
+                const std::vector<dbif::ChunkFieldsUpdate> &updates,
+                const std::vector<dbif::ObjectHandle> &deleted);
 
  protected:
   DataBlobObject(LocalObject *parent, const data::BinData &data, const QString &name) :
-    LocalObject(parent->db(), name), parent_(parent), data_(data) {}
+    LocalObject(parent->db(), name), parent_(parent),
+    data_(std::make_shared<data::BinData>(data)) {}
   void description_reply(InfoGetter *getter) override;
-  void killed() override;
+  void killed(QSet<InfoGetter *> *watchers) override;
 
  public:
   LocalObject *parent() { return parent_; }
   void getInfo(InfoGetter *getter, PInfoRequest req, bool once) override;
   void runMethod(MethodRunner *runner, PMethodRequest req) override;
-  const data::BinData &data() const { return data_; }
+  const data::BinData &data() const { return *data_; }
 };
 
 class FileBlobObject : public DataBlobObject {
@@ -116,6 +147,7 @@ class FileBlobObject : public DataBlobObject {
 
  protected:
   void description_reply(InfoGetter *getter) override;
+  void snapshot(dbif::ObjectSnapshot *res, bool with_items) override;
 
  public:
   static PLocalObject create(LocalObject *parent,
@@ -157,24 +189,28 @@ class ChunkObject : public LocalObject {
   std::vector<data::ChunkDataItem> items_;
   std::vector<data::ChunkDataItem> parseReplyItems_;
   QSet<InfoGetter *> parse_watchers_;
+  bool parse_dirty_;
 
   ChunkObject(PLocalObject blob, PLocalObject parent_chunk,
               uint64_t start, uint64_t end, const QString &chunk_type,
               const QString &name) :
     LocalObject(blob->db(), name), blob_(blob), parent_chunk_(parent_chunk),
-    start_(start), end_(end), chunk_type_(chunk_type) {}
+    start_(start), end_(end), chunk_type_(chunk_type), parse_dirty_(false) {}
   void calcParseReplyItems();
   void remove_parse_watcher(InfoGetter *getter);
 
  protected:
   void description_reply(InfoGetter *getter) override;
+  void snapshot(dbif::ObjectSnapshot *res, bool with_items) override;
   virtual void children_updated() override;
   void parse_updated();
+  void parse_changed();
+  void flush_updates() override;
   virtual void parse_reply(InfoGetter *getter);
   void getInfo(InfoGetter *getter, PInfoRequest req, bool once) override;
   void runMethod(MethodRunner *runner, PMethodRequest req) override;
   dbif::ObjectType type() const override { return dbif::CHUNK; };
-  void killed() override;
+  void killed(QSet<InfoGetter *> *watchers) override;
 
  public:
   static PLocalObject create(PLocalObject blob, PLocalObject parent_chunk,
@@ -188,10 +224,16 @@ class ChunkObject : public LocalObject {
       blob->addChild(res);
     return res;
   }
+  PLocalObject blob() const { return blob_; }
+  PLocalObject parentChunk() const { return parent_chunk_; }
   uint64_t start() const { return start_; }
   uint64_t end() const { return end_; }
   QString chunkType() const { return chunk_type_; }
   const std::vector<data::ChunkDataItem>& items() const { return items_; }
+  void setParse(uint64_t start, uint64_t end,
+                const std::vector<data::ChunkDataItem> &items);
+  // See dbif::ChunkFieldsUpdate.
+  void setFields(const std::vector<data::ChunkDataItem> &fields);
 };
 
 };
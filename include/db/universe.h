@@ -17,6 +17,7 @@
 #ifndef VELES_DB_UNIVERSE_H
 #define VELES_DB_UNIVERSE_H
 
+#include <QHash>
 #include <QObject>
 #include <QStringList>
 #include "data/bindata.h"
@@ -53,21 +54,38 @@ class Universe : public QObject {
 
   PLocalObject root_;
   ParserWorker *parser_;
+  int batch_depth_;
+  QList<PLocalObject> deferred_;
+  QHash<uint64_t, WLocalObject> objects_;
 
  public slots:
   void getInfo(veles::db::PLocalObject obj, InfoGetter *getter, veles::dbif::PInfoRequest req, bool once);
   void runMethod(veles::db::PLocalObject obj, MethodRunner *runner, veles::dbif::PMethodRequest req);
 
  public:
-  Universe(ParserWorker *parser) : parser_(parser) {}
+  Universe(ParserWorker *parser) : parser_(parser), batch_depth_(0) {}
   dbif::ObjectHandle handle(PLocalObject obj);
-  void setRoot(PLocalObject root) { root_ = root; }
+  void setRoot(PLocalObject root) { root_ = root; registerObject(root); }
   ~Universe();
   QThread *parserThread() {
     return parser_->thread();
   }
   ParserWorker* parser() {return parser_;}
 
+  // While a batch is open, objects queue their change notifications instead
+  // of sending them right away.  Every queued object notifies its watchers
+  // once when the outermost batch ends.
+  void beginBatch() { batch_depth_++; }
+  void endBatch();
+  bool inBatch() const { return batch_depth_ != 0; }
+  void deferUpdates(PLocalObject obj) { deferred_.append(obj); }
+
+  // Index of live objects by LocalObject::id(), kept up to date as objects
+  // are attached to the tree and killed.
+  void registerObject(PLocalObject obj);
+  void unregisterObject(uint64_t id) { objects_.remove(id); }
+  PLocalObject findObject(uint64_t id) const;
+
  signals:
   void parse(
       veles::dbif::ObjectHandle blob, MethodRunner *runner, QString parser_id,
@@ -18,14 +18,20 @@
 #define VELES_DBIF_INFO_H
 
 #include <stdint.h>
+#include <memory>
+#include <utility>
 #include <vector>
 #include <QString>
 
 #include "dbif/types.h"
 #include "data/field.h"
 #include "data/bindata.h"
+#include "data/sealed_memory.h"
 
 namespace veles {
+namespace util {
+class HistogramIndex;
+}  // namespace util
 namespace dbif {
 
 // Requests
@@ -40,7 +46,12 @@ struct DescriptionReply;
 struct ChildrenReply;
 struct ParsersListReply;
 struct BlobDataReply;
+struct BlobSharedDataReply;
+struct BlobSnapshotReply;
 struct ChunkDataReply;
+struct ObjectByIdReply;
+struct ObjectsByIdReply;
+struct SubtreeReply;
 
 struct DescriptionRequest : InfoRequest {
   typedef DescriptionReply ReplyType;
@@ -62,10 +73,65 @@ struct BlobDataRequest : InfoRequest {
   typedef BlobDataReply ReplyType;
 };
 
+// The whole data of a blob in shared memory.  The blob keeps it until the
+// data changes, so repeated requests don't copy the data again.
+struct BlobSharedDataRequest : InfoRequest {
+  typedef BlobSharedDataReply ReplyType;
+};
+
+// The current data of a blob, without copying it - the blob makes a new
+// copy on change while a snapshot is still referenced.  Meant for long
+// reads done outside of the database thread.  With histogram_index, the
+// reply also has the blob's HistogramIndex of the snapshot, which the blob
+// builds in the background on first request and drops on change - check
+// built() before relying on it.
+struct BlobSnapshotRequest : InfoRequest {
+  const bool histogram_index;
+  explicit BlobSnapshotRequest(bool histogram_index = false) :
+    histogram_index(histogram_index) {}
+  typedef BlobSnapshotReply ReplyType;
+};
+
 struct ChunkDataRequest : InfoRequest {
   typedef ChunkDataReply ReplyType;
 };
 
+// Looks up any live object by its id.  Only the root object answers it.
+// If path is given, it has to be the ids from a child of the root down to
+// the object, or the lookup fails.
+struct ObjectByIdRequest : InfoRequest {
+  const uint64_t id;
+  const std::vector<uint64_t> path;
+  explicit ObjectByIdRequest(uint64_t id,
+                             std::vector<uint64_t> path = std::vector<uint64_t>())
+      : id(id), path(std::move(path)) {}
+  typedef ObjectByIdReply ReplyType;
+};
+
+// Like ObjectByIdRequest, for many objects at once - fails unless all of
+// them are alive.
+struct ObjectsByIdRequest : InfoRequest {
+  const std::vector<uint64_t> ids;
+  explicit ObjectsByIdRequest(const std::vector<uint64_t> &ids) : ids(ids) {}
+  typedef ObjectsByIdReply ReplyType;
+};
+
+// Describes many objects below this one at once - its children, or with
+// recursive set, its whole subtree in pre-order (children ordered by id).
+// With a nonzero limit at most that many objects are described, and the
+// reply carries a cursor to pass in the request for the next ones.
+struct SubtreeRequest : InfoRequest {
+  const bool recursive;
+  const std::vector<uint64_t> cursor;
+  const uint64_t limit;
+  const bool with_items;
+  explicit SubtreeRequest(bool recursive,
+                          const std::vector<uint64_t> &cursor = std::vector<uint64_t>(),
+                          uint64_t limit = 0, bool with_items = true) :
+    recursive(recursive), cursor(cursor), limit(limit), with_items(with_items) {}
+  typedef SubtreeReply ReplyType;
+};
+
 // Replies
 
 struct InfoReply {
@@ -143,12 +209,64 @@ struct BlobDataReply : InfoReply {
     data(data) {}
 };
 
+struct BlobSharedDataReply : InfoReply {
+  std::shared_ptr<const data::SealedMemory> memory;
+  explicit BlobSharedDataReply(std::shared_ptr<const data::SealedMemory> memory)
+      : memory(std::move(memory)) {}
+};
+
+struct BlobSnapshotReply : InfoReply {
+  std::shared_ptr<const data::BinData> data;
+  // Null unless requested, or if the data is too large to index.
+  std::shared_ptr<util::HistogramIndex> histogram_index;
+  BlobSnapshotReply(std::shared_ptr<const data::BinData> data,
+                    std::shared_ptr<util::HistogramIndex> histogram_index)
+      : data(std::move(data)), histogram_index(std::move(histogram_index)) {}
+};
+
 struct ChunkDataReply : InfoReply {
   std::vector<data::ChunkDataItem> items;
   ChunkDataReply(std::vector<data::ChunkDataItem> &items) :
     items(items) {}
 };
 
+struct ObjectByIdReply : InfoReply {
+  const ObjectHandle object;
+  explicit ObjectByIdReply(const ObjectHandle &object) : object(object) {}
+};
+
+// In the order of the request's ids.
+struct ObjectsByIdReply : InfoReply {
+  const std::vector<ObjectHandle> objects;
+  explicit ObjectsByIdReply(const std::vector<ObjectHandle> &objects) :
+    objects(objects) {}
+};
+
+// The description of a single object, as listed by SubtreeRequest.  Fields
+// that don't apply to the object's type are left empty.
+struct ObjectSnapshot {
+  uint64_t id;
+  uint64_t parent_id;
+  ObjectType type;
+  QString name;
+  QString comment;
+  QString path;
+  uint64_t start;
+  uint64_t end;
+  QString chunk_type;
+  std::vector<data::ChunkDataItem> items;
+  ObjectSnapshot() : id(0), parent_id(0), type(ROOT), start(0), end(0) {}
+};
+
+struct SubtreeReply : InfoReply {
+  const std::vector<ObjectSnapshot> objects;
+  // Empty if there are no more objects to list.
+  const std::vector<uint64_t> cursor;
+  explicit SubtreeReply(const std::vector<ObjectSnapshot> &objects,
+                        const std::vector<uint64_t> &cursor) :
+    objects(objects), cursor(cursor) {}
+};
+
 };
 };
 
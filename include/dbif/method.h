@@ -39,6 +39,7 @@ struct MethodRequest {
 
 struct CreatedReply;
 struct NullReply;
+struct ChunkTreeCreatedReply;
 
 struct RootCreateFileBlobFromDataRequest : MethodRequest {
   data::BinData data;
@@ -131,6 +132,61 @@ struct BlobParseRequest : MethodRequest {
   typedef NullReply ReplyType;
 };
 
+// A chunk queued in a ChunkCreateTreeRequest.  parent_chunk and the refs of
+// items may point either to existing objects or to the placeholder of
+// another node of the same request (parents must come before children).
+struct ChunkTreeNode {
+  ObjectHandle placeholder;
+  ObjectHandle parent_chunk;
+  QString name;
+  QString chunk_type;
+  uint64_t start;
+  uint64_t end;
+  std::vector<data::ChunkDataItem> items;
+};
+
+struct SubBlobTreeNode {
+  ObjectHandle placeholder;
+  ObjectHandle parent_chunk;
+  data::BinData data;
+  QString name;
+};
+
+// Creates a whole tree of chunks and sub-blobs on a blob in one go.  Either
+// all nodes are created or none is, and every affected object notifies its
+// watchers once, after the whole tree is in place.
+struct ChunkCreateTreeRequest : MethodRequest {
+  std::vector<ChunkTreeNode> chunks;
+  std::vector<SubBlobTreeNode> sub_blobs;
+  ChunkCreateTreeRequest(const std::vector<ChunkTreeNode> &chunks,
+                         const std::vector<SubBlobTreeNode> &sub_blobs) :
+    chunks(chunks), sub_blobs(sub_blobs) {}
+  typedef ChunkTreeCreatedReply ReplyType;
+};
+
+// New FIELD items for an existing chunk (or a node of the same request).
+// They replace its current FIELD items and the BITFIELDs that belong to
+// them - the rest of the chunk's parse is kept.
+struct ChunkFieldsUpdate {
+  ObjectHandle chunk;
+  std::vector<data::ChunkDataItem> fields;
+};
+
+// A ChunkCreateTreeRequest that also deletes chunks and sub-blobs of the
+// blob and updates the fields of its chunks.  Deletions go first, then the
+// tree is created, then fields are updated - all of it is checked before
+// anything changes, so the request is applied either whole or not at all.
+struct ChunkTreeEditRequest : ChunkCreateTreeRequest {
+  std::vector<ChunkFieldsUpdate> updates;
+  std::vector<ObjectHandle> deleted;
+  ChunkTreeEditRequest(const std::vector<ChunkTreeNode> &chunks,
+                       const std::vector<SubBlobTreeNode> &sub_blobs,
+                       const std::vector<ChunkFieldsUpdate> &updates,
+                       const std::vector<ObjectHandle> &deleted) :
+    ChunkCreateTreeRequest(chunks, sub_blobs), updates(updates),
+    deleted(deleted) {}
+};
+
 // Replies
 
 struct MethodReply {
@@ -147,6 +203,15 @@ struct CreatedReply : MethodReply {
   explicit CreatedReply(ObjectHandle object) : object(object) {}
 };
 
+// Objects created by a ChunkCreateTreeRequest, in the order of its nodes.
+struct ChunkTreeCreatedReply : MethodReply {
+  const std::vector<ObjectHandle> chunks;
+  const std::vector<ObjectHandle> sub_blobs;
+  ChunkTreeCreatedReply(const std::vector<ObjectHandle> &chunks,
+                        const std::vector<ObjectHandle> &sub_blobs) :
+    chunks(chunks), sub_blobs(sub_blobs) {}
+};
+
 };
 };
 
@@ -0,0 +1,198 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef VELES_NETWORK_CONNECTION_H
+#define VELES_NETWORK_CONNECTION_H
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <google/protobuf/arena.h>
+
+#include <QHash>
+#include <QIODevice>
+#include <QQueue>
+#include <QSocketNotifier>
+
+#include "dbif/info.h"
+#include "dbif/types.h"
+#include "network.pb.h"
+
+namespace veles {
+namespace db {
+
+// Serves a single client of NetworkServer.  Lives on one of the server's
+// worker threads and only talks to the database through dbif requests, so
+// clients are served concurrently and never touch objects owned by the
+// database thread.  Clients connect either over TCP or, when they run on the
+// same machine, over a local socket - only the latter can get blob data in
+// shared memory.
+class NetworkConnection : public QObject {
+  Q_OBJECT
+
+ public:
+  NetworkConnection(dbif::ObjectHandle root, qintptr socket_descriptor,
+                    bool local = false);
+  ~NetworkConnection() override;
+
+ public slots:
+  // Takes over the socket - has to run on the connection's thread.
+  void start();
+
+ private slots:
+  void readMessages();
+  void pumpStreams();
+  void flushPendingOutput();
+
+ private:
+  // A GET_BLOB_DATA request whose data is being sent in parts.
+  struct DataStream {
+    uint64_t request_id;
+    dbif::ObjectHandle blob;
+    uint64_t element_size;
+    uint64_t start;
+    uint64_t pos;
+    uint64_t end;
+    uint64_t part_size;
+    bool compress;
+  };
+
+  // A paged LIST_CHILDREN_RECURSIVE request.
+  struct ListStream {
+    uint64_t request_id;
+    dbif::ObjectHandle root;
+    std::vector<uint64_t> cursor;
+    uint64_t page_size;
+    bool skip_comments;
+    bool skip_items;
+  };
+
+  // A SUBSCRIBE request still in force.
+  struct Subscription {
+    dbif::InfoPromise *promise;
+    uint64_t object_id;
+    // Octet offset of the watched blob data, and hashes of the pages of its
+    // last sent contents.
+    uint64_t data_offset;
+    std::vector<uint64_t> page_hashes;
+  };
+
+  // Output held back until a message carrying a descriptor has gone out -
+  // see sendSharedData.  The descriptor (or -1) goes with the first byte.
+  struct PendingOutput {
+    std::string data;
+    int fd;
+  };
+
+  typedef std::function<void(dbif::PError)> ErrorHandler;
+  // Asynchronous steps of a request share it instead of copying it.
+  typedef std::shared_ptr<const network::Request> PRequest;
+
+  dbif::ObjectHandle root_;
+  qintptr socket_descriptor_;
+  bool local_;
+  QIODevice *socket_;
+  QQueue<DataStream> data_streams_;
+  QQueue<ListStream> list_streams_;
+  // Set while the head of the corresponding queue waits for the database.
+  bool data_stream_busy_;
+  bool list_stream_busy_;
+  // Keyed by the request_id of the SUBSCRIBE request.
+  QHash<uint64_t, Subscription> subscriptions_;
+  QQueue<PendingOutput> pending_output_;
+  // Created when the socket first refuses a message with a descriptor.
+  QSocketNotifier *write_notifier_;
+  // Reused for every message instead of being allocated per request.
+  std::shared_ptr<network::Request> request_;
+  std::vector<char> read_buffer_;
+  std::vector<char> write_buffer_;
+  // Responses live on the arena only until they are sent - see sendResponse.
+  std::vector<char> arena_block_;
+  google::protobuf::Arena arena_;
+
+  static const uint32_t k_max_msg_len_ = 1024*1024*16;
+  static const uint64_t k_max_part_size_ = 1024*1024*4;
+  // Streamed data is only requested while there is less than this much
+  // waiting in the socket's write buffer.
+  static const int64_t k_max_buffered_ = 1024*1024;
+  static const uint64_t k_default_page_size_ = 1024;
+  static const uint64_t k_max_page_size_ = 1024*64;
+  static const size_t k_arena_block_size_ = 1024*64;
+  static const uint64_t k_max_hits_ = 1024*64;
+  static const uint64_t k_default_window_size_ = 256;
+  // Granularity of BLOB_DATA subscription changes.
+  static const uint64_t k_subscription_page_size_ = 1024*64;
+  // Keeps ENTROPY responses within a few MiB.
+  static const uint64_t k_max_entropy_values_ = 1024*1024;
+
+  template<typename Request, typename... Args>
+  void getInfo(dbif::ObjectHandle obj,
+               std::function<void(QSharedPointer<typename Request::ReplyType>)> done,
+               ErrorHandler failed, Args... args);
+  template<typename Request, typename... Args>
+  void runMethod(dbif::ObjectHandle obj,
+                 std::function<void(QSharedPointer<typename Request::ReplyType>)> done,
+                 ErrorHandler failed, Args... args);
+  ErrorHandler failRequest(uint64_t request_id);
+
+  void handleRequest(const PRequest &req);
+  void handleRequest(const PRequest &req, dbif::ObjectHandle target);
+  void listChildren(const PRequest &req, dbif::ObjectHandle target);
+  void listChildrenRecursive(const PRequest &req,
+                             dbif::ObjectHandle target);
+  void createChunk(const PRequest &req, dbif::ObjectHandle blob,
+                   dbif::ObjectHandle parent_chunk);
+  void deleteObject(const PRequest &req, dbif::ObjectHandle target);
+  void applyBatch(const PRequest &req, dbif::ObjectHandle blob);
+  void getBlobData(const PRequest &req, dbif::ObjectHandle target);
+  // FIND, HISTOGRAM, ENTROPY and HASH.
+  void analyzeBlob(const PRequest &req, dbif::ObjectHandle target);
+  void subscribe(const PRequest &req, dbif::ObjectHandle target,
+                 uint64_t element_size);
+  void unsubscribe(const PRequest &req);
+  void sendEvent(uint64_t subscription_id, dbif::PInfoReply reply);
+  void sendDataChanges(uint64_t subscription_id, Subscription *subscription,
+                       const data::BinData &data);
+  void listPage(const ListStream &stream,
+                std::function<void(network::Response *,
+                                   const std::vector<uint64_t> &)> done,
+                ErrorHandler failed);
+  void pumpDataStream();
+  void pumpListStream();
+
+  // Responses are allocated on arena_ and are only valid until the next
+  // call to sendResponse.
+  network::Response *newResponse(uint64_t request_id);
+  void sendFailure(uint64_t request_id, const std::string &error_msg);
+  void sendResponse(network::Response *resp);
+  // Passes the whole blob's sealed memfd along with the response, which
+  // points at the requested range in it.
+  void sendSharedData(uint64_t request_id,
+                      const std::shared_ptr<const data::SealedMemory> &memory,
+                      uint64_t offset, uint64_t length);
+  void serializeResponse(network::Response *resp);
+  void sendData(const char *data, uint64_t length);
+  void writeAll(const char *data, uint64_t length);
+  void packObject(const dbif::ObjectSnapshot &object,
+                  network::LocalObject *result, bool skip_comments = false);
+};
+
+}  // namespace db
+}  // namespace veles
+
+#endif // VELES_NETWORK_CONNECTION_H
@@ -14,47 +14,54 @@
  * limitations under the License.
  *
  */
-
 #ifndef VELES_NETWORK_SERVER_H
 #define VELES_NETWORK_SERVER_H
 
-#include <QtNetwork/QTcpServer>
+#include <vector>
+
+#include <QObject>
+#include <QThread>
+#include <QtNetwork/QHostAddress>
 
-#include "db/types.h"
-#include "network.pb.h"
+#include "dbif/types.h"
 
 namespace veles {
 namespace db {
 
+// Accepts client connections and hands each of them to one of a pool of
+// worker threads, where a NetworkConnection serves it.  Besides TCP, the
+// server listens on a local socket (a Unix domain socket or a named pipe)
+// for clients running on the same machine.
 class NetworkServer : public QObject {
   Q_OBJECT
 
-  void handleRequest(network::Request &req, QTcpSocket *client_connection);
-  void sendResponse(QTcpSocket *client_connection, network::Response &resp);
-  void sendData(QTcpSocket *client_connection, const char *data, uint64_t length);
-  void packObject(PLocalObject object, network::LocalObject* result,
-                  bool pack_children = false);
+  class Listener;
+  class LocalListener;
 
 public:
-  NetworkServer(PLocalObject root);
+  // Listens on the address, port and local socket name from the network
+  // settings.
+  NetworkServer(dbif::ObjectHandle root);
+  // Port 0 picks any free port - see port().  An empty local_name means no
+  // local socket.
+  NetworkServer(dbif::ObjectHandle root, const QHostAddress &address,
+                uint16_t port, const QString &local_name = QString());
+  // Stops the workers and deletes the connections still served by them.
+  ~NetworkServer() override;
 
-private slots:
-  void handle();
-  void readMessage(QTcpSocket *client_connection);
+  uint16_t port() const;
+  // The full path of the local socket, empty if there is none.
+  QString localServerName() const;
 
 private:
-  PLocalObject root_;
-  QTcpServer *tcp_server_;
-
-  static const uint32_t k_max_msg_len_ = 1024*1024*16;
-
-  void listChildren(PLocalObject target_object, network::Response &resp,
-                    bool list_children = false);
-  void createChunk(PLocalObject target_object, PLocalObject blob,
-                   network::Request &req, network::Response &resp);
-  void deleteObject(PLocalObject target_object, network::Response &resp);
-  void getBlobData(PLocalObject target_object, QTcpSocket *client_connection,
-                   network::Response &resp);
+  dbif::ObjectHandle root_;
+  Listener *listener_;
+  LocalListener *local_listener_;
+  // Owned by the server - see ~NetworkServer.
+  std::vector<QThread *> workers_;
+  size_t next_worker_;
+
+  void addConnection(qintptr socket_descriptor, bool local);
 };
 
 }  // namespace db
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef VELES_PARSER_BATCH_H
+#define VELES_PARSER_BATCH_H
+
+#include <vector>
+
+#include <QHash>
+#include <QEnableSharedFromThis>
+
+#include "dbif/types.h"
+#include "dbif/universe.h"
+#include "data/field.h"
+
+namespace veles {
+namespace parser {
+
+class ChunkTreeBatch;
+
+// Stands in for a chunk or sub-blob that has been queued in a ChunkTreeBatch,
+// but not yet committed to the database.  Any request made through it
+// commits the batch first and is then forwarded to the real object.
+class PendingObjectHandle : public dbif::ObjectHandleBase {
+  QWeakPointer<ChunkTreeBatch> batch_;
+  const ChunkTreeBatch *owner_;
+  dbif::ObjectType type_;
+  dbif::ObjectHandle resolved_;
+
+ public:
+  PendingObjectHandle(QSharedPointer<ChunkTreeBatch> batch, dbif::ObjectType type) :
+    batch_(batch), owner_(batch.data()), type_(type) {}
+  dbif::InfoPromise *getInfo(dbif::PInfoRequest req) override;
+  dbif::InfoPromise *subInfo(dbif::PInfoRequest req) override;
+  dbif::MethodResultPromise *runMethod(dbif::PMethodRequest req) override;
+  dbif::ObjectType type() const override { return type_; }
+
+  QSharedPointer<ChunkTreeBatch> batch() const { return batch_.toStrongRef(); }
+  // Unlike batch(), also valid while the batch commits from its destructor.
+  const ChunkTreeBatch *owner() const { return owner_; }
+  dbif::ObjectHandle resolved() const { return resolved_; }
+  void setResolved(dbif::ObjectHandle obj) { resolved_ = obj; }
+  // Commits the owning batch if needed and returns the real object.
+  dbif::ObjectHandle resolve();
+};
+
+// Collects the chunks and sub-blobs created by parsers working on a blob and
+// creates them with a single ChunkCreateTreeRequest, instead of a request
+// per chunk.  The batch is committed when its last open chunk ends, or
+// earlier if something needs one of the queued objects.  Stream parsers
+// started inside a queued chunk join its batch.
+class ChunkTreeBatch : public QEnableSharedFromThis<ChunkTreeBatch> {
+  dbif::ObjectHandle blob_;
+  std::vector<dbif::ChunkTreeNode> chunks_;
+  std::vector<dbif::SubBlobTreeNode> sub_blobs_;
+  QHash<dbif::ObjectHandleBase *, size_t> chunk_index_;
+  unsigned open_;
+
+  dbif::ObjectHandle settle(dbif::ObjectHandle obj, bool allow_queued);
+  std::vector<data::ChunkDataItem> settleItems(
+      const std::vector<data::ChunkDataItem> &items, bool allow_queued);
+
+ public:
+  explicit ChunkTreeBatch(dbif::ObjectHandle blob) : blob_(blob), open_(0) {}
+  ~ChunkTreeBatch();
+
+  // Returns the batch that new chunks under parent_chunk should go to.
+  static QSharedPointer<ChunkTreeBatch> forParent(
+      dbif::ObjectHandle blob, dbif::ObjectHandle *parent_chunk);
+  // Returns the batch in which obj is still queued, if any.
+  static QSharedPointer<ChunkTreeBatch> queuedIn(dbif::ObjectHandle obj);
+
+  dbif::ObjectHandle blob() const { return blob_; }
+  bool empty() const { return chunks_.empty() && sub_blobs_.empty(); }
+
+  dbif::ObjectHandle startChunk(dbif::ObjectHandle parent_chunk, uint64_t start,
+                                const QString &type, const QString &name);
+  void endChunk(dbif::ObjectHandle chunk, uint64_t start, uint64_t end,
+                const std::vector<data::ChunkDataItem> &items);
+  // Forgets chunks that were started but will never be ended.
+  void abandonChunks(unsigned count);
+  dbif::ObjectHandle addSubBlob(dbif::ObjectHandle parent_chunk,
+                                const QString &name, const data::BinData &data);
+  void commit();
+};
+
+};
+};
+
+#endif
@@ -23,6 +23,7 @@
 #include "dbif/universe.h"
 #include "dbif/info.h"
 #include "data/repack.h"
+#include "parser/batch.h"
 
 namespace veles {
 namespace parser {
@@ -43,6 +44,8 @@ class StreamParser {
   std::vector<WorkChunk> stack_;
   unsigned width_;
   size_t blob_size_;
+  // Chunks are queued here and created in bulk, see ChunkTreeBatch.
+  QSharedPointer<ChunkTreeBatch> batch_;
 
  public:
   StreamParser(dbif::ObjectHandle blob, uint64_t start,
@@ -51,14 +54,18 @@ class StreamParser {
     auto desc = blob_->syncGetInfo<dbif::DescriptionRequest>();
     width_ = desc.dynamicCast<dbif::BlobDescriptionReply>()->width;
     blob_size_ = desc.dynamicCast<dbif::BlobDescriptionReply>()->size;
+    batch_ = ChunkTreeBatch::forParent(blob_, &parent_chunk_);
+  }
+
+  ~StreamParser() {
+    batch_->abandonChunks(stack_.size());
   }
 
   dbif::ObjectHandle startChunk(const QString &type, const QString &name) {
     dbif::ObjectHandle parent = parent_chunk_;
     if (stack_.size())
       parent = stack_.back().chunk;
-    dbif::ObjectHandle chunk = blob_->syncRunMethod<dbif::ChunkCreateRequest>(
-      name, type, parent, pos_, pos_)->object;
+    dbif::ObjectHandle chunk = batch_->startChunk(parent, pos_, type, name);
     stack_.push_back(WorkChunk{chunk, pos_, type, name, std::vector<data::ChunkDataItem>()});
     return chunk;
   }
@@ -66,7 +73,7 @@ class StreamParser {
   dbif::ObjectHandle endChunk() {
     auto &top = stack_.back();
     auto res = top.chunk;
-    res->syncRunMethod<dbif::SetChunkParseRequest>(top.start, pos_, top.items);
+    batch_->endChunk(res, top.start, pos_, top.items);
     if (stack_.size() > 1) {
       stack_[stack_.size() - 2].items.push_back(
         data::ChunkDataItem::subchunk(top.start, pos_, top.name, top.chunk)
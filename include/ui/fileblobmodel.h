@@ -24,6 +24,8 @@
 #include <QString>
 #include <QObject>
 
+#include <memory>
+
 #include "dbif/types.h"
 #include "ui/fileblobitem.h"
 #include "data/bindata.h"
@@ -57,7 +59,12 @@ class FileBlobModel : public QAbstractItemModel {
   QModelIndex indexFromPos(uint64_t pos,
                            const QModelIndex &parent = QModelIndex());
 
-  const data::BinData& binData() {return binData_;}
+  const data::BinData& binData() {return *binData_;}
+  // Contents of binData() for visualisations - a view of binData() that
+  // doesn't copy it, valid as long as *owner is kept (even after the data
+  // changes).  All visualisations of the blob share it, and so its sample
+  // pyramid too.
+  QByteArray visualisationData(std::shared_ptr<const void> *owner);
   bool isRemovable(const QModelIndex &index = QModelIndex());
   void uploadNewData(const QByteArray &buf);
   void parse(QString parser = "", qint64 offset = 0,
@@ -84,7 +91,8 @@ class FileBlobModel : public QAbstractItemModel {
   size_t bytesCount_;
   QStringList path_;
 
-  data::BinData binData_;
+  // Shared with visualisations, replaced (not modified) on change.
+  std::shared_ptr<const data::BinData> binData_;
 
   QColor color(int colorIndex) const;
   FileBlobItem *itemFromIndex(const QModelIndex &index) const;
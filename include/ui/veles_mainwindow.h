@@ -195,6 +195,7 @@ class VelesMainWindow : public MainWindowWithDetachableDockWidgets {
  private slots:
   void newFile();
   void open();
+  void visualiseFile();
   void about();
   void updateParsers(dbif::PInfoReply replay);
   void showDatabase();
@@ -215,6 +216,7 @@ class VelesMainWindow : public MainWindowWithDetachableDockWidgets {
 
   QAction *new_file_act_;
   QAction *open_act_;
+  QAction *visualise_file_act_;
   QAction *exit_act_;
   QAction *options_act_;
 
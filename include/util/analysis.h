@@ -0,0 +1,83 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef VELES_UTIL_ANALYSIS_H
+#define VELES_UTIL_ANALYSIS_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace veles {
+namespace util {
+namespace analysis {
+
+typedef std::array<uint64_t, 256> ByteHistogram;
+
+/**
+ * Find offsets of all (possibly overlapping) occurrences of pattern in data,
+ * in increasing order.  Stops after max_hits of them.
+ */
+std::vector<uint64_t> findAll(const uint8_t *data, size_t size,
+                              const uint8_t *pattern, size_t pattern_size,
+                              size_t max_hits);
+
+/**
+ * Count occurrences of every byte value in data.
+ */
+ByteHistogram byteHistogram(const uint8_t *data, size_t size);
+
+/**
+ * Sum of the values of bytes in data.
+ */
+uint64_t byteSum(const uint8_t *data, size_t size);
+
+/**
+ * Shannon entropy, in bits per byte (0 to 8), of bytes with given counts.
+ */
+double entropy(const ByteHistogram &counts, uint64_t total);
+
+/**
+ * Entropy of consecutive windows of window_size bytes of data - the last
+ * window may be shorter.
+ */
+std::vector<float> entropySeries(const uint8_t *data, size_t size,
+                                 size_t window_size);
+
+/**
+ * Same as the functions above, but split into chunks of about k_chunk_size
+ * bytes run on the workers of the given topic (see parallelReduce()).  The
+ * calling thread takes part, so they block until done.
+ */
+static const size_t k_chunk_size = 1024 * 1024;
+
+std::vector<uint64_t> parallelFindAll(const std::string &topic,
+                                      const uint8_t *data, size_t size,
+                                      const uint8_t *pattern,
+                                      size_t pattern_size, size_t max_hits);
+ByteHistogram parallelByteHistogram(const std::string &topic,
+                                    const uint8_t *data, size_t size);
+std::vector<float> parallelEntropySeries(const std::string &topic,
+                                         const uint8_t *data, size_t size,
+                                         size_t window_size);
+
+}  // namespace analysis
+}  // namespace util
+}  // namespace veles
+
+#endif  // VELES_UTIL_ANALYSIS_H
@@ -0,0 +1,208 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef VELES_UTIL_CONCURRENCY_PARALLEL_H
+#define VELES_UTIL_CONCURRENCY_PARALLEL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "util/concurrency/threadpool.h"
+
+namespace veles {
+namespace util {
+namespace threadpool {
+
+/**
+ * Data-parallel loops over index ranges, run on the workers of the given
+ * topic.  The range is split into chunks of grain indices (the last one may
+ * be shorter), which the calling thread and up to workerCount() tasks take
+ * in turn until none are left.  The calling thread always takes part, so
+ * the loops can be nested in tasks and still work if the topic has no
+ * workers (e.g. is mocked or the pool is shut down).  They return once all
+ * chunks are done.  If a chunk throws, no further chunks are started and
+ * the first exception is rethrown in the calling thread.
+ */
+
+namespace detail {
+
+template <typename T, typename F, typename R>
+class ParallelLoop {
+ public:
+  ParallelLoop(size_t begin, size_t end, size_t grain, T identity, F f,
+               R reduce)
+      : begin_(begin), end_(end), grain_(grain),
+        chunks_((end - begin - 1) / grain + 1), next_(0), pending_(chunks_),
+        identity_(std::move(identity)), result_(identity_), f_(std::move(f)),
+        reduce_(std::move(reduce)) {}
+
+  size_t chunks() const { return chunks_; }
+
+  // Takes chunks until there are none left, then merges its accumulator
+  // into the result.
+  void participate() {
+    T acc = identity_;
+    size_t processed = 0;
+    size_t chunk;
+    while ((chunk = next_.fetch_add(1)) < chunks_) {
+      processed++;
+      size_t chunk_begin = begin_ + chunk * grain_;
+      size_t chunk_end = std::min(end_, chunk_begin + grain_);
+      try {
+        f_(chunk_begin, chunk_end, acc);
+      } catch (...) {
+        fail(std::current_exception(), &processed);
+        break;
+      }
+    }
+    if (processed == 0) return;
+    std::unique_lock<std::mutex> lc(mutex_);
+    if (!error_) {
+      reduce_(result_, std::move(acc));
+    }
+    pending_ -= processed;
+    if (pending_ == 0) {
+      done_.notify_all();
+    }
+  }
+
+  T wait() {
+    std::unique_lock<std::mutex> lc(mutex_);
+    while (pending_ != 0) {
+      done_.wait(lc);
+    }
+    if (error_) {
+      std::rethrow_exception(error_);
+    }
+    return std::move(result_);
+  }
+
+ private:
+  const size_t begin_;
+  const size_t end_;
+  const size_t grain_;
+  const size_t chunks_;
+  std::atomic<size_t> next_;
+  // Chunks not yet finished and merged, guarded by mutex_.
+  size_t pending_;
+  std::exception_ptr error_;
+  std::mutex mutex_;
+  std::condition_variable done_;
+  const T identity_;
+  T result_;
+  F f_;
+  R reduce_;
+
+  void fail(std::exception_ptr error, size_t *processed) {
+    // Nobody will take the remaining chunks - count them as ours.
+    size_t next = next_.exchange(chunks_);
+    if (next < chunks_) {
+      *processed += chunks_ - next;
+    }
+    std::unique_lock<std::mutex> lc(mutex_);
+    if (!error_) {
+      error_ = error;
+    }
+  }
+};
+
+}  // namespace detail
+
+/**
+ * Calls f(acc, chunk_begin, chunk_end) for chunks covering [begin, end),
+ * where acc is a T& accumulator private to the calling thread, starting as
+ * a copy of identity.  The accumulators are then combined with
+ * reduce(T &into, T &&from) - in no particular order, so reduce should be
+ * associative and commutative.
+ */
+template <typename T, typename F, typename R>
+T parallelReduce(const std::string &topic, size_t begin, size_t end,
+                 size_t grain, T identity, F f, R reduce) {
+  grain = std::max(grain, size_t(1));
+  if (end <= begin) {
+    return identity;
+  }
+  if (end - begin <= grain) {
+    f(identity, begin, end);
+    return identity;
+  }
+  auto body = [f](size_t chunk_begin, size_t chunk_end, T &acc) {
+    f(acc, chunk_begin, chunk_end);
+  };
+  typedef detail::ParallelLoop<T, decltype(body), R> Loop;
+  auto loop = std::make_shared<Loop>(begin, end, grain, std::move(identity),
+                                     body, std::move(reduce));
+  size_t helpers = std::min(loop->chunks() - 1, workerCount());
+  for (size_t i = 0; i < helpers; i++) {
+    if (runTask(topic, [loop]() { loop->participate(); })
+        != SchedulingResult::SCHEDULED) {
+      break;
+    }
+  }
+  loop->participate();
+  return loop->wait();
+}
+
+/**
+ * Calls f(chunk_begin, chunk_end) for chunks covering [begin, end).
+ */
+template <typename F>
+void parallelFor(const std::string &topic, size_t begin, size_t end,
+                 size_t grain, F f) {
+  parallelReduce(topic, begin, end, grain, false,
+                 [&f](bool &, size_t chunk_begin, size_t chunk_end) {
+                   f(chunk_begin, chunk_end);
+                 },
+                 [](bool &, bool) {});
+}
+
+/**
+ * Sorts [first, last) like std::sort: blocks of grain elements are sorted
+ * in parallel, then merged pairwise in parallel rounds.
+ */
+template <typename Iterator>
+void parallelSort(const std::string &topic, Iterator first, Iterator last,
+                  size_t grain) {
+  grain = std::max(grain, size_t(1));
+  size_t size = static_cast<size_t>(last - first);
+  parallelFor(topic, 0, size, grain, [first](size_t begin, size_t end) {
+    std::sort(first + begin, first + end);
+  });
+  for (size_t width = grain; width < size; width *= 2) {
+    size_t pairs = (size - 1) / (2 * width) + 1;
+    parallelFor(topic, 0, pairs, 1,
+                [first, size, width](size_t begin, size_t end) {
+      for (size_t pair = begin; pair < end; pair++) {
+        size_t low = pair * 2 * width;
+        size_t mid = std::min(low + width, size);
+        size_t high = std::min(mid + width, size);
+        std::inplace_merge(first + low, first + mid, first + high);
+      }
+    });
+  }
+}
+
+}  // namespace threadpool
+}  // namespace util
+}  // namespace veles
+
+#endif  // VELES_UTIL_CONCURRENCY_PARALLEL_H
@@ -17,19 +17,56 @@
 #ifndef VELES_UTIL_CONCURRENCY_THREADPOOL_H
 #define VELES_UTIL_CONCURRENCY_THREADPOOL_H
 
+#include <future>
+#include <memory>
 #include <string>
-#include <functional>
+#include <type_traits>
+#include <utility>
 
 namespace veles {
 namespace util {
 namespace threadpool {
 
 /**
- * Globally accessible thread pool with workers split into
- * topics (worker groups).
+ * Globally accessible work-stealing thread pool.  Every worker has its own
+ * lock-free deque - tasks scheduled from a worker go there and idle workers
+ * steal from each other.  Tasks scheduled from other threads are queued by
+ * topic priority and taken highest priority first.  So are tasks scheduled
+ * from a worker for a topic below the highest priority, so that they can't
+ * get ahead of more important ones.
  */
 
-typedef std::function<void()> Task;
+/**
+ * A move-only callable taking no arguments - unlike std::function, it can
+ * hold e.g. a std::packaged_task.
+ */
+class Task {
+ public:
+  Task() {}
+  template <typename F, typename = typename std::enable_if<
+      !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+  Task(F &&f) : impl_(new Impl<typename std::decay<F>::type>(
+      std::forward<F>(f))) {}
+  Task(Task &&other) = default;
+  Task& operator=(Task &&other) = default;
+
+  void operator()() { impl_->run(); }
+  explicit operator bool() const { return impl_ != nullptr; }
+
+ private:
+  struct Base {
+    virtual ~Base() {}
+    virtual void run() = 0;
+  };
+  template <typename F>
+  struct Impl : Base {
+    F f;
+    template <typename G>
+    explicit Impl(G &&g) : f(std::forward<G>(g)) {}
+    void run() override { f(); }
+  };
+  std::unique_ptr<Base> impl_;
+};
 
 enum class SchedulingResult {
   SCHEDULED,
@@ -39,23 +76,109 @@ enum class SchedulingResult {
 };
 
 /**
- * Create a new topic and set number of workers for it.
+ * Set the number of worker threads.  Only has an effect before the first
+ * task is scheduled - the default is std::thread::hardware_concurrency().
  */
-void createTopic(std::string topic, size_t workers);
+void setWorkerCount(size_t workers);
 
 /**
- * Create a topic without any workers and run tasks in thread calling runTask().
- * This is meant for testing, when we may not want to actually spawn threads.
+ * The number of worker threads the pool has or will start.
+ */
+size_t workerCount();
+
+/**
+ * Create a new topic - a named class of tasks.  Workers start tasks of
+ * higher priority topics first.  Only tasks of the highest priority topics
+ * take the cheaper worker-local path (see runTask()), so a topic of higher
+ * priority than all others slows down scheduling from workers for the rest.
+ */
+void createTopic(std::string topic, int priority = 0);
+
+/**
+ * Create a topic whose tasks are run right away in the thread calling
+ * runTask().  This is meant for testing, when we may not want to actually
+ * spawn threads.
  */
 void mockTopic(std::string topic);
 
 /**
- * Schedule a job to be run on one of worker threads assigned to a given topic.
- * The job is run asynchronously, use callbacks or similar to communicate its
- * result.
+ * Schedule a job to be run on one of the worker threads.  The job is run
+ * asynchronously, use submit(), submitThen() or similar to communicate its
+ * result.  Tasks of the highest priority topics scheduled from within
+ * a task stay on the same worker unless stolen - this is the cheapest way
+ * to run a continuation.
+ */
+SchedulingResult runTask(const std::string &topic, Task t);
+
+/**
+ * Like runTask(), but returns a future for the result of f.  If f could not
+ * be scheduled, the future holds a std::future_error (broken promise).
  */
-SchedulingResult runTask(std::string topic, Task t);
+template <typename F>
+std::future<typename std::result_of<F()>::type> submit(
+    const std::string &topic, F &&f) {
+  typedef typename std::result_of<F()>::type Result;
+  std::packaged_task<Result()> task(std::forward<F>(f));
+  std::future<Result> result = task.get_future();
+  runTask(topic, std::move(task));
+  return result;
+}
+
+namespace detail {
+
+template <typename C, typename Result>
+struct Continuation {
+  C continuation;
+  std::future<Result> result;
+  void operator()() { continuation(std::move(result)); }
+};
+
+template <typename F, typename C>
+struct ContinuedTask {
+  typedef typename std::result_of<F()>::type Result;
+  F f;
+  std::string continuation_topic;
+  C continuation;
+
+  void operator()() {
+    std::packaged_task<Result()> task(std::move(f));
+    std::future<Result> result = task.get_future();
+    task();
+    typedef Continuation<C, Result> Next;
+    auto next = std::make_shared<Next>(
+        Next{std::move(continuation), std::move(result)});
+    if (runTask(continuation_topic, [next]() { (*next)(); })
+        != SchedulingResult::SCHEDULED) {
+      (*next)();
+    }
+  }
+};
 
+}  // namespace detail
+
+/**
+ * Like submit(), but instead of returning the future, passes it (ready,
+ * holding the result of f or its exception) to continuation, which is
+ * scheduled on continuation_topic once f is done - or run right away by
+ * the same worker if that fails.  Returns the result of scheduling f, which
+ * if not SCHEDULED means neither is going to run.
+ */
+template <typename F, typename C>
+SchedulingResult submitThen(const std::string &topic, F &&f,
+                            const std::string &continuation_topic,
+                            C &&continuation) {
+  typedef detail::ContinuedTask<typename std::decay<F>::type,
+                                typename std::decay<C>::type> Continued;
+  return runTask(topic, Continued{std::forward<F>(f), continuation_topic,
+                                  std::forward<C>(continuation)});
+}
+
+/**
+ * Let the workers finish all scheduled tasks (including ones scheduled by
+ * them meanwhile) and stop them.  Afterwards runTask() fails with
+ * ERR_NO_WORKERS, except for mock topics.
+ */
+void shutdown();
 
 }  // namespace threadpool
 }  // namespace util
@@ -0,0 +1,147 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef VELES_UTIL_CONCURRENCY_WORK_STEALING_DEQUE_H
+#define VELES_UTIL_CONCURRENCY_WORK_STEALING_DEQUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace veles {
+namespace util {
+namespace threadpool {
+
+/**
+ * Lock-free deque of pointers (Chase-Lev).  Only the owning thread may
+ * push() and pop() (at the bottom, LIFO), any thread may steal() (at the
+ * top, FIFO).  Empty pop() and steal() return nullptr - steal() may also
+ * return nullptr when it loses a race, callers should just try elsewhere.
+ */
+template <typename T>
+class WorkStealingDeque {
+ public:
+  explicit WorkStealingDeque(size_t log_capacity = 8)
+      : top_(0), bottom_(0) {
+    arrays_.emplace_back(new Array(log_capacity));
+    array_.store(arrays_.back().get(), std::memory_order_relaxed);
+  }
+
+  WorkStealingDeque(const WorkStealingDeque&) = delete;
+  WorkStealingDeque& operator=(const WorkStealingDeque&) = delete;
+
+  void push(T *item) {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    int64_t top = top_.load(std::memory_order_acquire);
+    Array *array = array_.load(std::memory_order_relaxed);
+    if (bottom - top > array->mask) {
+      array = grow(array, top, bottom);
+    }
+    array->put(bottom, item);
+    bottom_.store(bottom + 1, std::memory_order_release);
+  }
+
+  T *pop() {
+    int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    Array *array = array_.load(std::memory_order_relaxed);
+    bottom_.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = top_.load(std::memory_order_relaxed);
+    if (top > bottom) {
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    T *item = array->get(bottom);
+    if (top == bottom) {
+      // The last item - race the thieves for it.
+      if (!top_.compare_exchange_strong(top, top + 1,
+                                        std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+        item = nullptr;
+      }
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  T *steal() {
+    int64_t top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t bottom = bottom_.load(std::memory_order_acquire);
+    if (top >= bottom) {
+      return nullptr;
+    }
+    Array *array = array_.load(std::memory_order_acquire);
+    T *item = array->get(top);
+    if (!top_.compare_exchange_strong(top, top + 1,
+                                      std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return item;
+  }
+
+  bool empty() const {
+    int64_t bottom = bottom_.load(std::memory_order_acquire);
+    int64_t top = top_.load(std::memory_order_acquire);
+    return top >= bottom;
+  }
+
+ private:
+  struct Array {
+    int64_t mask;
+    std::unique_ptr<std::atomic<T *>[]> items;
+
+    explicit Array(size_t log_capacity)
+        : mask((int64_t(1) << log_capacity) - 1),
+          items(new std::atomic<T *>[mask + 1]) {}
+    T *get(int64_t index) const {
+      return items[index & mask].load(std::memory_order_relaxed);
+    }
+    void put(int64_t index, T *item) {
+      items[index & mask].store(item, std::memory_order_relaxed);
+    }
+  };
+
+  Array *grow(Array *array, int64_t top, int64_t bottom) {
+    size_t log_capacity = 1;
+    while ((int64_t(1) << log_capacity) <= array->mask + 1) {
+      log_capacity++;
+    }
+    Array *grown = new Array(log_capacity);
+    for (int64_t i = top; i < bottom; i++) {
+      grown->put(i, array->get(i));
+    }
+    // Thieves may still be reading the old array, so it is only freed
+    // together with the deque.
+    arrays_.emplace_back(grown);
+    array_.store(grown, std::memory_order_release);
+    return grown;
+  }
+
+  std::atomic<int64_t> top_;
+  std::atomic<int64_t> bottom_;
+  std::atomic<Array *> array_;
+  // Owned by the owning thread.
+  std::vector<std::unique_ptr<Array>> arrays_;
+};
+
+}  // namespace threadpool
+}  // namespace util
+}  // namespace veles
+
+#endif  // VELES_UTIL_CONCURRENCY_WORK_STEALING_DEQUE_H
@@ -0,0 +1,134 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef VELES_UTIL_HISTOGRAM_INDEX_H
+#define VELES_UTIL_HISTOGRAM_INDEX_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <QByteArray>
+
+#include "util/analysis.h"
+
+namespace veles {
+namespace util {
+
+/**
+ * Byte histograms of the blocks of one blob, for histograms (and so entropy
+ * and mean value) of any of its ranges without scanning it.
+ *
+ * The data is divided into aligned leaves of k_leaf_size bytes, whose
+ * histograms are kept with 16-bit counts.  Every k_fanout consecutive nodes
+ * of one level are summed into a node of the next one.  A range is then
+ * made of at most 2 * (k_fanout - 1) nodes per level, plus less than a leaf
+ * at both ends, which is read from the data.
+ *
+ * Like sample pyramids, indexes are shared per buffer (see forData()) and
+ * built in the background ("visualisation" topic).  Until then, queries
+ * scan the data instead - users that can't afford that should check
+ * built() and register a callback to learn when it's done.
+ */
+class HistogramIndex {
+ public:
+  static const size_t k_leaf_size = 4096;
+  static const size_t k_fanout = 16;
+
+  typedef std::function<void()> BuiltCallback;
+
+  /**
+   * If data doesn't own its bytes (see QByteArray::fromRawData()), owner
+   * has to keep them alive.  The index isn't built yet - see build().
+   */
+  explicit HistogramIndex(
+      const QByteArray &data,
+      std::shared_ptr<const void> owner = std::shared_ptr<const void>());
+
+  /**
+   * Return the index of data, creating it (and starting the background
+   * build) if there is none yet.
+   */
+  static std::shared_ptr<HistogramIndex> forData(
+      const QByteArray &data,
+      std::shared_ptr<const void> owner = std::shared_ptr<const void>());
+
+  /**
+   * Build the index in the calling thread (and workers), unless it's built
+   * already.  Can be called from any thread.
+   */
+  void build();
+  bool built() const { return built_.load(std::memory_order_acquire); }
+
+  /**
+   * Register a callback that will be called, in the building thread, once
+   * the index is built.  Callbacks registered after that are never called,
+   * so check built() after registering.  Returned value is callback id, for
+   * removeBuiltCallback().
+   */
+  int registerBuiltCallback(BuiltCallback cb);
+  /**
+   * Remove the callback with a given id.  Once this returns, the callback
+   * is not running and won't be called.
+   */
+  void removeBuiltCallback(int cb_id);
+
+  /**
+   * Histogram, entropy (in bits per byte) and mean byte value of range
+   * [start, end) of the data.  Can be called from any thread.
+   */
+  analysis::ByteHistogram histogram(size_t start, size_t end) const;
+  double entropy(size_t start, size_t end) const;
+  double mean(size_t start, size_t end) const;
+
+ private:
+  // Add counts of nodes [first, last) of level to counts.
+  void addNodes(int level, size_t first, size_t last,
+                analysis::ByteHistogram *counts) const;
+  void addBytes(size_t start, size_t end,
+                analysis::ByteHistogram *counts) const;
+
+  QByteArray data_;
+  std::shared_ptr<const void> owner_;
+  std::mutex build_mutex_;
+  std::atomic<bool> built_;
+  // 256 counts per leaf.
+  std::vector<uint16_t> leaves_;
+  // 256 counts per node, levels_[i] being level i + 1 (level 0 are the
+  // leaves).  Only complete nodes are kept.
+  std::vector<std::vector<uint64_t>> levels_;
+  std::mutex callbacks_mutex_;
+  int next_cb_id_;
+  std::map<int, BuiltCallback> callbacks_;
+
+  // Leaves handled by one task while building.
+  static const size_t k_leaves_per_chunk = 256;
+
+  static std::mutex registry_mutex_;
+  static std::map<std::pair<const char*, int>,
+                  std::weak_ptr<HistogramIndex>> registry_;
+};
+
+}  // namespace util
+}  // namespace veles
+
+#endif  // VELES_UTIL_HISTOGRAM_INDEX_H
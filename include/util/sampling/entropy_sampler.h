@@ -0,0 +1,63 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef ENTROPY_SAMPLER_H
+#define ENTROPY_SAMPLER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "util/sampling/windowed_sampler.h"
+
+namespace veles {
+namespace util {
+
+/**
+ * Samples windows like UniformSampler, but spends the sample budget where
+ * the information is: the data is divided into blocks, the entropy of each
+ * block is estimated from a few probes, and each block gets a share of
+ * windows proportional to its entropy (plus a small base share, so that
+ * constant regions such as padding are still visible).
+ */
+class EntropySampler : public WindowedSampler {
+ public:
+  explicit EntropySampler(const QByteArray &data);
+  ~EntropySampler();
+
+ private:
+  EntropySampler(const EntropySampler& other);
+  ResampleData* prepareResample(SamplerConfig *sc) override;
+  void applyResample(ResampleData *rd) override;
+  void cleanupResample(ResampleData *rd) override;
+  EntropySampler* cloneImpl() override;
+
+  // Estimates the entropy (in bits per byte) of each of the blocks.
+  std::vector<double> blockEntropies(SamplerConfig *sc, size_t block_size,
+                                     size_t blocks);
+
+  // At most this many blocks, each at least k_min_windows_per_block
+  // windows long.
+  static const size_t k_max_blocks = 4096;
+  static const size_t k_min_windows_per_block = 4;
+  // Bytes read from each block to estimate its entropy.
+  static const size_t k_probes = 4;
+  static const size_t k_probe_size = 1024;
+};
+
+}  // namespace util
+}  // namespace veles
+
+#endif
@@ -25,6 +25,7 @@ namespace util {
 class FakeSampler : public ISampler {
  public:
   explicit FakeSampler(const QByteArray &data) : ISampler(data) {}
+  ~FakeSampler() { stopResampling(); }
  protected:
   size_t getRealSampleSize() override;
  private:
@@ -36,6 +37,7 @@ class FakeSampler : public ISampler {
   void applyResample(ResampleData *rd) override;
   void cleanupResample(ResampleData *rd) override;
   FakeSampler* cloneImpl() override;
+  SampleSnapshot::Layout getSampleLayout() override;
 };
 
 }  // namespace util
@@ -0,0 +1,60 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef FILE_SAMPLER_H
+#define FILE_SAMPLER_H
+
+#include <memory>
+
+#include <QString>
+
+#include "util/sampling/uniform_sampler.h"
+
+namespace veles {
+namespace util {
+
+/**
+ * UniformSampler that reads the windows straight from a file instead of
+ * keeping the whole data in memory, so it works for files larger than RAM
+ * - only the sample itself is kept.  Windows of a task are announced to the
+ * OS before they are read (where supported), so that reads are overlapped
+ * with each other and with the rest of resampling.
+ *
+ * The file shouldn't change while it's being sampled.  If it can't be
+ * opened, the sampler is empty(); bytes that can't be read are zeros.
+ */
+class FileSampler : public UniformSampler {
+ public:
+  explicit FileSampler(const QString &path);
+  ~FileSampler();
+
+ private:
+  class File;
+
+  explicit FileSampler(std::shared_ptr<File> file);
+  FileSampler(const FileSampler& other);
+  void readWindows(SamplerConfig *sc, const size_t *windows, size_t count,
+                   size_t window_size, char *buffer) override;
+  FileSampler* cloneImpl() override;
+
+  // Shared with clones.
+  std::shared_ptr<File> file_;
+};
+
+}  // namespace util
+}  // namespace veles
+
+#endif
@@ -24,8 +24,11 @@
 #include <future>
 #include <utility>
 #include <map>
+#include <memory>
 #include <QByteArray>
 
+#include "util/sampling/sample_snapshot.h"
+
 namespace veles {
 namespace util {
 
@@ -47,10 +50,14 @@ typedef int ResampleCallbackId;
  * operation immediately. As this can be rather expensive time-wise
  * the sampler can be changed to asynchronous mode. In that case the resampling
  * is performed in a separate thread and a set of registered callbacks is
- * called once it's done.
+ * called once it's done. Requests made while a resample is running are
+ * coalesced - only the latest configuration gets sampled next, and the
+ * running resample is cancelled if the implementation supports it (see
+ * resampleCancelled()).
  *
  * When working in asynchronous mode it is recommended to perform any
- * operations on the data while keeping the mutex returned by sampler.lock().
+ * operations on the data while keeping the mutex returned by sampler.lock(),
+ * or to read the sample through snapshot() instead, which needs no locking.
  * Otherwise the sample we're looking at can suddenly change leading to
  * inconsistencies.
  *
@@ -64,7 +71,7 @@ typedef int ResampleCallbackId;
 class ISampler {
  public:
   explicit ISampler(const QByteArray &data);
-  virtual ~ISampler() {}
+  virtual ~ISampler();
 
   /**
    * Set the range of bytes from data to use as a base for sampling.
@@ -149,6 +156,15 @@ class ISampler {
    */
   const char* data();
 
+  /**
+   * Return the current sample as an immutable snapshot.  Unlike other
+   * methods this doesn't take the sampler lock, so it never waits for
+   * callbacks and the snapshot can then be read without any locking.
+   * A new snapshot is published whenever a resample (or any change of
+   * configuration) is applied, before the callbacks are called.
+   */
+  std::shared_ptr<const SampleSnapshot> snapshot();
+
   /**
    * Return true if sample is empty.
    * Generally true if underlying data is empty.
@@ -241,6 +257,8 @@ class ISampler {
    */
   struct SamplerConfig {
     size_t start, end, sample_size;
+    // Set for asynchronous resampling, see resampleCancelled().
+    int version;
   };
 
   /**
@@ -259,6 +277,7 @@ class ISampler {
    * was used data is re-indexed internally to still be 0 indexed.
    * If sc is provided it uses the range represented by sc instead of this
    * stored by sampler.
+   * Not available if the data isn't in memory (see ISampler(size_t)).
    */
   char getDataByte(size_t index, SamplerConfig *sc = nullptr);
 
@@ -278,9 +297,36 @@ class ISampler {
    * Return the input data as simple array. Size of array is getDataSize().
    * If sc is provided it uses the range represented by sc instead of this
    * stored by sampler.
+   * Not available if the data isn't in memory (see ISampler(size_t)).
    */
   const char* getRawData(SamplerConfig *sc = nullptr);
 
+  /**
+   * Return true if the resampling for sc has been superseded by a newer
+   * request and its result would just be thrown away. Long-running
+   * prepareResample implementations should check this every now and then
+   * and return early (possibly with nullptr, which is then passed to
+   * cleanupResample) if it's true.
+   * This does not use the sampler lock and can be called from any thread.
+   */
+  bool resampleCancelled(SamplerConfig *sc);
+
+  /**
+   * Cancel asynchronous resampling and wait until the one in progress (if
+   * any) returns.  ~ISampler() does this too, but by then the derived parts
+   * of the sampler are gone - so every implementation whose resampling
+   * uses them has to call this first thing in its destructor.
+   */
+  void stopResampling();
+
+  /**
+   * For samplers that read data_size bytes of data from elsewhere, e.g.
+   * a file, instead of keeping them in memory.  Such samplers always
+   * resample, even if the whole range would fit in the sample, and can't
+   * use getRawData() and getDataByte().
+   */
+  explicit ISampler(size_t data_size);
+
   ISampler(const ISampler& other);
 
  private:
@@ -309,10 +355,11 @@ class ISampler {
 
   /**
    * Prepare resampled data.
-   * This may be called asynchronously in a different thread and should neither
-   * modify nor rely on any mutable state of sampler (multiple prepareResample
-   * calls may be processed at the same time). Returned ResampleData* will
-   * later be passed to applyResample method.
+   * This may be called asynchronously in a different thread and should not
+   * modify any state of sampler. Resamples of one sampler never overlap, so
+   * it may read the current sample (as left by applyResample), but should
+   * take the configuration to sample from sc only. Returned ResampleData*
+   * will later be passed to applyResample or cleanupResample method.
    * Any call to method accepting SamplerConfig (getDataSize(),
    * getRawData(), etc) should pass the provided SamplerConfig.
    */
@@ -342,13 +389,24 @@ class ISampler {
    */
   virtual ISampler* cloneImpl() = 0;
 
+  /**
+   * Describe the current sample (of size getRealSampleSize()) for
+   * snapshot().  This is called while holding sampler lock, right after
+   * applyResample.  The layout has to share ownership of the sample, so that
+   * it stays valid after the next resample.
+   */
+  virtual SampleSnapshot::Layout getSampleLayout() = 0;
+
 
   size_t samplingRequired(SamplerConfig *sc = nullptr);
   void applySamplerConfig(SamplerConfig *sc);
   void runResample(SamplerConfig *sc);
-  void resampleAsync(int target_version, SamplerConfig *sc);
+  void resampleAsync();
+  void publishSnapshot();
 
   const QByteArray &data_;
+  size_t data_size_;
+  bool in_memory_;
   size_t start_, end_, sample_size_;
   bool allow_async_;
 
@@ -356,8 +414,14 @@ class ISampler {
   SamplerConditionVariable sampler_condition_;
   SamplerConfig last_config_;
   std::atomic<int> current_version_, requested_version_;
+  // The latest configuration not yet picked up by resampleAsync, which
+  // runs as long as there is one (resample_scheduled_ is set meanwhile).
+  SamplerConfig *pending_config_;
+  bool resample_scheduled_;
   ResampleCallbackId next_cb_id_;
   std::map<ResampleCallbackId, ResampleCallback> callbacks_;
+  // Only accessed with std::atomic_load and std::atomic_store.
+  std::shared_ptr<const SampleSnapshot> snapshot_;
 };
 
 }  // namespace util
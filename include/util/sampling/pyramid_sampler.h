@@ -0,0 +1,72 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef PYRAMID_SAMPLER_H
+#define PYRAMID_SAMPLER_H
+
+#include <memory>
+#include "util/sampling/isampler.h"
+#include "util/sampling/sample_pyramid.h"
+
+namespace veles {
+namespace util {
+
+/**
+ * Samples from the SamplePyramid of the data - the sample is the part of the
+ * coarsest level that still has at least the requested number of bytes in
+ * range (or of level 1, if even that doesn't).  Samplers (and their clones)
+ * on the same data share the pyramid, so resampling is mostly just picking
+ * a part of an already built level.
+ */
+class PyramidSampler : public ISampler {
+ public:
+  /**
+   * owner keeps data alive if it doesn't own its bytes - see
+   * SamplePyramid::forData().
+   */
+  explicit PyramidSampler(
+      const QByteArray &data,
+      std::shared_ptr<const void> owner = std::shared_ptr<const void>());
+  ~PyramidSampler();
+
+ private:
+  struct PyramidSamplerResampleData : public ResampleData {
+    SamplePyramid::Slice slice;
+    size_t start;
+  };
+
+  PyramidSampler(const PyramidSampler& other);
+  char getSampleByte(size_t index) override;
+  const char* getData() override;
+  size_t getRealSampleSize() override;
+  size_t getFileOffsetImpl(size_t index) override;
+  size_t getSampleOffsetImpl(size_t address) override;
+  ResampleData* prepareResample(SamplerConfig *sc) override;
+  void applyResample(ResampleData *rd) override;
+  void cleanupResample(ResampleData *rd) override;
+  PyramidSampler* cloneImpl() override;
+  SampleSnapshot::Layout getSampleLayout() override;
+
+  std::shared_ptr<SamplePyramid> pyramid_;
+  SamplePyramid::Slice slice_;
+  // Start of the range slice_ was taken for - windows are file offsets.
+  size_t slice_start_;
+};
+
+}  // namespace util
+}  // namespace veles
+
+#endif
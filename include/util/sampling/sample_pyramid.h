@@ -0,0 +1,145 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SAMPLE_PYRAMID_H
+#define SAMPLE_PYRAMID_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <QByteArray>
+
+namespace veles {
+namespace util {
+
+/**
+ * Multi-resolution sample of one blob, shared by all samplers working on it.
+ *
+ * The data is divided into aligned windows of k_window_size bytes.  Level 0
+ * is the data itself, and level i + 1 keeps one (pseudo-randomly chosen)
+ * window of every two consecutive windows of level i, so each level is half
+ * the size of the previous one and contains all windows of the coarser
+ * ones.  Any level restricted to a range is thus a ready-made sample of
+ * that range, without aliasing on periodic data.
+ *
+ * Levels up to k_max_level_size bytes are built once, coarsest first, in
+ * the background ("visualisation" topic) and then shared.  Finer levels are
+ * gathered on demand, for the requested range only.
+ *
+ * Pyramids are shared per buffer: forData() returns the same pyramid for
+ * all (implicitly shared) copies of a QByteArray, or all views of the same
+ * raw data, as long as any of them uses it.
+ */
+class SamplePyramid {
+ public:
+  /**
+   * Windows of one level in some range, sorted by file offset, with their
+   * bytes stored one after another.
+   */
+  struct Level {
+    size_t window_size;
+    std::vector<size_t> windows;
+    std::vector<char> bytes;
+  };
+
+  /**
+   * A part of a level - windows [first, first + count) of level.
+   */
+  struct Slice {
+    std::shared_ptr<const Level> level;
+    size_t first, count;
+
+    size_t size() const { return count * level->window_size; }
+    const char* data() const {
+      return level->bytes.data() + first * level->window_size;
+    }
+    size_t window(size_t index) const { return level->windows[first + index]; }
+  };
+
+  /**
+   * If data doesn't own its bytes (see QByteArray::fromRawData()), owner
+   * has to keep them alive - the pyramid keeps owner for as long as it is
+   * built.
+   */
+  explicit SamplePyramid(
+      const QByteArray &data,
+      std::shared_ptr<const void> owner = std::shared_ptr<const void>());
+
+  /**
+   * Return the pyramid for data, creating it (and starting the background
+   * build) if there is none yet.
+   */
+  static std::shared_ptr<SamplePyramid> forData(
+      const QByteArray &data,
+      std::shared_ptr<const void> owner = std::shared_ptr<const void>());
+
+  /**
+   * Number of levels above level 0 - the last one is the first not larger
+   * than k_min_level_size.
+   */
+  int levels() const { return levels_; }
+
+  /**
+   * Return the windows of level (1 to levels()) inside [start, end).
+   * Stored levels are built first if needed (meanwhile blocking other
+   * readers of the same level), other ones are gathered for the range.
+   * Can be called from any thread.
+   */
+  Slice slice(int level, size_t start, size_t end);
+
+  /**
+   * Return true if level is kept in memory once built.
+   */
+  bool stored(int level) const;
+
+ private:
+  // Index of the window of level 0 kept for group of level.
+  size_t pick(int level, size_t group) const;
+  std::shared_ptr<const Level> gather(int level, size_t first_group,
+                                      size_t last_group) const;
+  std::shared_ptr<const Level> storedLevel(int level);
+
+  QByteArray data_;
+  std::shared_ptr<const void> owner_;
+  int levels_;
+  // Number of windows (groups of windows of level 0) on each level.
+  std::vector<size_t> groups_;
+
+  std::mutex mutex_;
+  std::condition_variable level_built_;
+  std::vector<std::shared_ptr<const Level>> stored_;
+  std::vector<bool> building_;
+
+  static const size_t k_window_size = 512;
+  static const size_t k_min_level_size = 64 * 1024;
+  static const size_t k_max_level_size = 64 * 1024 * 1024;
+  // Groups handled by one task while gathering.
+  static const size_t k_groups_per_chunk = 2048;
+
+  static std::mutex registry_mutex_;
+  static std::map<std::pair<const char*, int>,
+                  std::weak_ptr<SamplePyramid>> registry_;
+};
+
+}  // namespace util
+}  // namespace veles
+
+#endif
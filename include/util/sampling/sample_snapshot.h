@@ -0,0 +1,99 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef SAMPLE_SNAPSHOT_H
+#define SAMPLE_SNAPSHOT_H
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace veles {
+namespace util {
+
+/**
+ * Immutable sample, as left by one resample of a sampler (see
+ * ISampler::snapshot()).  It can be read like the sampler itself, but it
+ * never changes and needs no locking, so it can be used from any thread
+ * while the sampler goes on resampling.
+ *
+ * The sample is kept alive by the snapshot.  Snapshots of samplers working
+ * on in-memory data may point into that data, though, so they mustn't
+ * outlive it (just like the samplers).
+ */
+class SampleSnapshot {
+ public:
+  /**
+   * Where the sample is and how it maps to the data: size bytes at data,
+   * made of windows of window_size bytes, the ith at file offset
+   * window_base + windows[i].  window_size == 0 means the sample is the
+   * range itself.  owner keeps data and windows alive.
+   */
+  struct Layout {
+    const char *data;
+    size_t size;
+    size_t window_size, window_base;
+    const size_t *windows;
+    std::shared_ptr<const void> owner;
+  };
+
+  /**
+   * Layout of the range itself, not sampled.
+   */
+  static Layout unsampled(const char *data, size_t size);
+
+  /**
+   * Layout of windows of window_size bytes at data - takes (a share in)
+   * the ownership of both.
+   */
+  static Layout windowed(std::shared_ptr<const char> data, size_t size,
+                         size_t window_size, size_t window_base,
+                         std::vector<size_t> windows);
+
+  /**
+   * Empty sample.
+   */
+  SampleSnapshot();
+
+  /**
+   * Sample of range [start, end) of the data.
+   */
+  SampleSnapshot(size_t start, size_t end, Layout layout);
+
+  bool empty() const { return layout_.size == 0; }
+  std::pair<size_t, size_t> getRange() const {
+    return std::make_pair(start_, end_);
+  }
+  size_t getSampleSize() const { return layout_.size; }
+  const char* data() const { return layout_.data; }
+  char operator[](size_t index) const { return layout_.data[index]; }
+
+  /**
+   * Same as ISampler::getFileOffset() and ISampler::getSampleOffset().
+   */
+  size_t getFileOffset(size_t index) const;
+  size_t getSampleOffset(size_t address) const;
+
+ private:
+  size_t start_, end_;
+  Layout layout_;
+};
+
+}  // namespace util
+}  // namespace veles
+
+#endif
@@ -17,40 +17,76 @@
 #ifndef UNIFORM_SAMPLER_H
 #define UNIFORM_SAMPLER_H
 
+#include <cstdint>
+#include <memory>
 #include <vector>
-#include "util/sampling/isampler.h"
+#include "util/sampling/windowed_sampler.h"
 
 namespace veles {
 namespace util {
 
-class UniformSampler : public ISampler {
+class UniformSampler : public WindowedSampler {
  public:
   explicit UniformSampler(const QByteArray &data);
   ~UniformSampler();
 
   void setWindowSize(size_t size);
+
+  /**
+   * Set the seed windows are drawn with - the same data, seed and
+   * configuration always give the same sample. Causes re-sampling.
+   */
+  void setSeed(uint32_t seed);
+
+  /**
+   * In incremental mode windows of the current sample that are still in
+   * range after setRange() or setSampleSize() are kept (as long as window
+   * size stays the same), and only the missing ones are drawn and copied.
+   * This keeps the sample stable while zooming in and out. Off by default.
+   */
+  void setIncrementalResampling(bool incremental);
+
+ protected:
+  /**
+   * For samplers reading data from elsewhere - see ISampler(size_t).
+   * They have to override readWindows().
+   */
+  explicit UniformSampler(size_t data_size);
+  UniformSampler(const UniformSampler& other);
+
  private:
-  struct UniformSamplerResampleData : public ResampleData {
-    size_t window_size, windows_count;
-    std::vector<size_t> windows;
-    char *data;
+  struct UniformSamplerResampleData : public WindowedResampleData {
+    size_t start;
+    uint32_t seed;
   };
 
-  UniformSampler(const UniformSampler& other);
-  char getSampleByte(size_t index) override;
-  const char* getData() override;
-  size_t getRealSampleSize() override;
-  size_t getFileOffsetImpl(size_t index) override;
-  size_t getSampleOffsetImpl(size_t address) override;
   ResampleData* prepareResample(SamplerConfig *sc) override;
   void applyResample(ResampleData *rd) override;
   void cleanupResample(ResampleData *rd) override;
   UniformSampler* cloneImpl() override;
 
-  size_t window_size_, windows_count_;
+  // Draws sorted, non-overlapping windows from data_size bytes - base is
+  // only used to seed the generators.
+  std::vector<size_t> drawWindows(size_t data_size, size_t window_size,
+                                  size_t windows_count, size_t base = 0);
+  // Fills windows for sc, reusing the current ones where possible.  sources
+  // are indices of the reused windows in the current sample (k_new_window
+  // for new ones).  Returns false if it is better to draw all windows anew.
+  bool reuseWindows(SamplerConfig *sc, size_t windows_count,
+                    std::vector<size_t> *windows,
+                    std::vector<size_t> *sources);
+
   bool use_default_window_size_;
-  std::vector<size_t> windows_;
-  char *buffer_;
+  bool incremental_;
+  uint32_t seed_;
+  // Range start, seed and window size the current windows were drawn for.
+  size_t drawn_start_;
+  uint32_t drawn_seed_;
+  size_t drawn_window_size_;
+
+  // Windows drawn with one random generator, and sorted as one block.
+  static const size_t k_windows_per_block = 1024 * 16;
+  static const size_t k_gaps_per_task = 256;
 };
 
 }  // namespace util
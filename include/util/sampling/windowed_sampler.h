@@ -0,0 +1,92 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef WINDOWED_SAMPLER_H
+#define WINDOWED_SAMPLER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "util/sampling/isampler.h"
+
+namespace veles {
+namespace util {
+
+/**
+ * Base of samplers whose sample is made of windows of the same size, copied
+ * one after another from sorted, non-overlapping offsets in the range.  It
+ * keeps the current windows and maps between sample and file offsets -
+ * implementations only choose the windows (see gatherWindows()).
+ */
+class WindowedSampler : public ISampler {
+ protected:
+  explicit WindowedSampler(const QByteArray &data);
+  explicit WindowedSampler(size_t data_size);
+  WindowedSampler(const WindowedSampler& other);
+
+  struct WindowedResampleData : public ResampleData {
+    size_t window_size, windows_count;
+    std::vector<size_t> windows;
+    char *data;
+  };
+
+  // Source of windows that are not in the current sample.
+  static const size_t k_new_window = static_cast<size_t>(-1);
+
+  /**
+   * Copy windows of window_size bytes, starting at given offsets in the
+   * range of sc, one after another to a new buffer, in parallel chunks.
+   * If sources is given, windows whose source isn't k_new_window are copied
+   * from that window of the current sample instead.  Returns nullptr if
+   * resampling has been cancelled meanwhile.
+   */
+  char* gatherWindows(SamplerConfig *sc, const std::vector<size_t> &windows,
+                      size_t window_size,
+                      const std::vector<size_t> *sources = nullptr);
+
+  /**
+   * Copy count windows of window_size bytes, starting at given offsets in
+   * the range of sc, one after another to buffer.  This is called from
+   * several threads at once (for different windows).
+   */
+  virtual void readWindows(SamplerConfig *sc, const size_t *windows,
+                           size_t count, size_t window_size, char *buffer);
+
+  // Make the windows of rd the current sample, for applyResample().  The
+  // buffer is taken over, rd itself is left to the caller.
+  void applyWindows(WindowedResampleData *rd);
+
+  size_t window_size_, windows_count_;
+  std::vector<size_t> windows_;
+  std::shared_ptr<const char> buffer_;
+
+ private:
+  char getSampleByte(size_t index) override;
+  const char* getData() override;
+  size_t getRealSampleSize() override;
+  size_t getFileOffsetImpl(size_t index) override;
+  size_t getSampleOffsetImpl(size_t address) override;
+  SampleSnapshot::Layout getSampleLayout() override;
+
+  // Sample bytes copied per task - gatherWindows checks if resampling has
+  // been cancelled before each.
+  static const size_t k_bytes_per_copy_chunk = 1024 * 1024;
+};
+
+}  // namespace util
+}  // namespace veles
+
+#endif
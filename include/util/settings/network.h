@@ -29,6 +29,9 @@ uint32_t port ();
 void setPort (uint32_t port);
 QString ipAddress ();
 void setIpAddress (QString addr);
+// Name of the local socket for clients on the same machine, empty for none.
+QString localServerName ();
+void setLocalServerName (QString name);
 
 }  // namespace network
 }  // namespace settings
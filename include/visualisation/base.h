@@ -26,6 +26,7 @@
 #include <map>
 #include <memory>
 
+#include "util/histogram_index.h"
 #include "util/sampling/isampler.h"
 
 namespace veles {
@@ -39,7 +40,11 @@ class VisualisationWidget : public QOpenGLWidget,
   explicit VisualisationWidget(QWidget *parent = 0);
   ~VisualisationWidget();
 
-  void setSampler(util::ISampler *sampler);
+  // index (optional) is an index of the sampler's data, for visualisations
+  // that can use it.  Once it's built, the visualisation is resampled again.
+  void setSampler(util::ISampler *sampler,
+                  std::shared_ptr<util::HistogramIndex> index =
+                      std::shared_ptr<util::HistogramIndex>());
   // This method takes a QLayout* and add any widgets necessary to manipulate
   // options of this visualisation. Return true if anything was added to
   // QLayout.
@@ -75,11 +80,26 @@ class VisualisationWidget : public QOpenGLWidget,
    * Derive this method to do some additional processing in worker thread.
    * Keep in mind that this method will be executed while holding sampler
    * lock, so doing very expensive stuff here might hurt your performance.
+   * Read the new sample from the argument rather than through getData(),
+   * which only changes on refresh.
    * Return value of this method will be passed along with resampled() signal
    * and in particular will be passed to refresh().
    */
-  virtual AdditionalResampleData* onAsyncResample() {return nullptr;}
+  virtual AdditionalResampleData* onAsyncResample(
+      const util::SampleSnapshot &sample) {return nullptr;}
 
+  /**
+   * The sample being visualised - a snapshot taken on refresh, so it can be
+   * read without holding sampler lock.
+   */
+  const util::SampleSnapshot &sample() const { return *sample_; }
+  /**
+   * Index of the sampler's data, if any.  Can be used in onAsyncResample,
+   * but only if built() - onAsyncResample is called again when it is.
+   */
+  const std::shared_ptr<util::HistogramIndex> &histogramIndex() const {
+    return histogram_index_;
+  }
   size_t getDataSize();
   const char* getData();
   char getByte(size_t index);
@@ -90,6 +110,9 @@ class VisualisationWidget : public QOpenGLWidget,
   bool gl_initialised_, gl_broken_, error_message_set_;
   util::ISampler *sampler_;
   util::ResampleCallbackId resample_cb_id_;
+  std::shared_ptr<const util::SampleSnapshot> sample_;
+  std::shared_ptr<util::HistogramIndex> histogram_index_;
+  int index_cb_id_;
 };
 
 }  // namespace visualisation
@@ -28,6 +28,7 @@
 #include <QPair>
 
 
+#include "util/histogram_index.h"
 #include "util/sampling/isampler.h"
 
 namespace veles {
@@ -52,7 +53,13 @@ class VisualisationMinimap : public QOpenGLWidget,
   explicit VisualisationMinimap(QWidget *parent = 0);
   ~VisualisationMinimap();
 
-  void setSampler(util::ISampler * sampler);
+  // If given, index (of the sampler's data) is used for points covering
+  // large parts of the data, which then show the whole part, not just
+  // the sample.  Until the index is built the sample is used, and the
+  // minimap is refreshed once it is.
+  void setSampler(util::ISampler * sampler,
+                  std::shared_ptr<util::HistogramIndex> index =
+                      std::shared_ptr<util::HistogramIndex>());
   void setRange(size_t start, size_t end, bool reset_selection = true);
   QPair<size_t, size_t> getSelectedRange();
   void setSelectedRange(size_t start_address, size_t end_address);
@@ -63,6 +70,8 @@ class VisualisationMinimap : public QOpenGLWidget,
 
  signals:
   void selectionChanged(size_t start, size_t end);
+  // Emitted in the building thread.
+  void histogramIndexBuilt();
 
  protected:
   void mouseMoveEvent(QMouseEvent *event) override;
@@ -100,24 +109,9 @@ class VisualisationMinimap : public QOpenGLWidget,
   size_t lineToOffset(float line_position);
   float offsetToLine(size_t offset);
 
-  static float* calculateAverageValueTexture(
-      const uint8_t *sample, size_t sample_size,
-      size_t texture_size, double point_size);
-  static float* calculateEntropyTexture(
-      const uint8_t *sample, size_t sample_size,
-      size_t texture_size, double point_size);
-
-  static float* calculateEntropyTexturePerPixel(
-      const uint8_t *sample, size_t sample_size,
-      size_t texture_size, double point_size);
-  static float* calculateEntropyTextureSlidingWindow(
-      const uint8_t *sample, size_t sample_size,
-      size_t texture_size, double point_size);
-  static float* calculateEntropyTextureSingleWindow(
-      const uint8_t *sample, size_t sample_size,
-      size_t texture_size, double point_size);
-  static float calculateEntropyValue(uint64_t bytes_counts[],
-                                     uint64_t total_count);
+  static float* calculateIndexedTexture(
+      const util::HistogramIndex &index, const util::SampleSnapshot &sample,
+      MinimapMode mode, size_t texture_size, double point_size);
 
   bool empty();
 
@@ -128,7 +122,6 @@ class VisualisationMinimap : public QOpenGLWidget,
   const MinimapMode k_default_mode = MinimapMode::VALUE;
   const float k_line_selection_epsilon = 0.003f;
   const float k_minimum_line_distance = 0.02f;
-  static const int k_minimum_entropy_window = 256;
   const int k_bar_height = 7;
   const int k_bar_texture_width = 100;
   const float k_line_comparison_epsilon = 0.1f;
@@ -138,6 +131,8 @@ class VisualisationMinimap : public QOpenGLWidget,
   bool initialised_;
   bool gl_initialised_;
   util::ISampler *sampler_;
+  std::shared_ptr<util::HistogramIndex> histogram_index_;
+  int index_cb_id_;
 
   size_t rows_, cols_, texture_rows_, texture_cols_;
   size_t selection_start_, selection_end_;
@@ -37,7 +37,10 @@ class MinimapPanel : public QWidget {
   explicit MinimapPanel(QWidget *parent = 0);
   ~MinimapPanel();
 
-  void setSampler(util::ISampler *sampler);
+  // index (optional) is passed on to the minimaps.
+  void setSampler(util::ISampler *sampler,
+                  std::shared_ptr<util::HistogramIndex> index =
+                      std::shared_ptr<util::HistogramIndex>());
   QPair<size_t, size_t> getSelection();
 
  signals:
@@ -56,6 +59,7 @@ class MinimapPanel : public QWidget {
   VisualisationMinimap::MinimapColor getMinimapColor();
 
   util::ISampler *sampler_;
+  std::shared_ptr<util::HistogramIndex> histogram_index_;
   QVector<util::ISampler*> minimap_samplers_;
   QVector<VisualisationMinimap*> minimaps_;
   QVector<QSpacerItem*> minimap_spacers_;
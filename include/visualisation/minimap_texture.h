@@ -0,0 +1,98 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#ifndef VELES_VISUALISATION_MINIMAP_TEXTURE_H
+#define VELES_VISUALISATION_MINIMAP_TEXTURE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "util/concurrency/parallel.h"
+
+namespace veles {
+namespace visualisation {
+namespace minimap {
+
+/*
+ * Computation of minimap textures - every texture point gets a value
+ * (0 to 256) for point_size consecutive bytes of the sample.  Kept apart
+ * from VisualisationMinimap so that it can be benchmarked without GL.
+ * The returned textures are allocated with new[].
+ */
+
+// Sample bytes per chunk of the data-parallel loops.
+const size_t k_parallel_grain = 1024 * 256;
+// Points of at most this many bytes get the entropy of a window of this
+// size (plus one) around them instead.
+const int k_minimum_entropy_window = 256;
+
+// Returns the first sample byte of texture point index, i.e. the first i
+// with i / point_size >= index.
+size_t pointStart(size_t index, double point_size);
+
+// Calls f(index, begin, end) for the sample range [begin, end) of every
+// texture point, in parallel.  If the points run past the end of the sample
+// due to rounding, the rest of the sample goes to the last point and the
+// ones in between are left alone.  point_size has to be at least 1.
+template <typename F>
+void forEachPoint(size_t sample_size, size_t texture_size,
+                  double point_size, F f) {
+  if (sample_size == 0 || texture_size == 0) return;
+  size_t low = 0, high = texture_size - 1;
+  while (low < high) {
+    size_t mid = high - (high - low) / 2;
+    if (pointStart(mid, point_size) < sample_size) {
+      low = mid;
+    } else {
+      high = mid - 1;
+    }
+  }
+  size_t last = low;
+  f(texture_size - 1, pointStart(last, point_size), sample_size);
+  size_t grain = std::max(static_cast<size_t>(1), static_cast<size_t>(
+      k_parallel_grain / point_size));
+  util::threadpool::parallelFor("visualisation", 0, last, grain,
+      [point_size, &f](size_t begin, size_t end) {
+    size_t start = pointStart(begin, point_size);
+    for (size_t index = begin; index < end; ++index) {
+      size_t next = pointStart(index + 1, point_size);
+      f(index, start, next);
+      start = next;
+    }
+  });
+}
+
+float* calculateAverageValueTexture(const uint8_t *sample, size_t sample_size,
+                                    size_t texture_size, double point_size);
+float* calculateEntropyTexture(const uint8_t *sample, size_t sample_size,
+                               size_t texture_size, double point_size);
+
+float* calculateEntropyTexturePerPixel(
+    const uint8_t *sample, size_t sample_size,
+    size_t texture_size, double point_size);
+float* calculateEntropyTextureSlidingWindow(
+    const uint8_t *sample, size_t sample_size,
+    size_t texture_size, double point_size);
+float* calculateEntropyTextureSingleWindow(
+    const uint8_t *sample, size_t sample_size,
+    size_t texture_size, double point_size);
+
+}  // namespace minimap
+}  // namespace visualisation
+}  // namespace veles
+
+#endif  // VELES_VISUALISATION_MINIMAP_TEXTURE_H
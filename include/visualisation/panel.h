@@ -20,12 +20,14 @@
 #include <QWidget>
 #include <QBoxLayout>
 #include <QAction>
+#include <QComboBox>
 #include <QToolBar>
 #include <QSplitter>
 #include <QLabel>
 #include <QString>
 
 #include <map>
+#include <memory>
 
 #include "visualisation/base.h"
 #include "visualisation/minimap_panel.h"
@@ -40,7 +42,15 @@ class VisualisationPanel : public QWidget {
   explicit VisualisationPanel(QWidget *parent = 0);
   ~VisualisationPanel();
 
-  void setData(const QByteArray &data);
+  // data may be a view of bytes owned by someone else (see
+  // QByteArray::fromRawData()) - owner then has to keep them alive.  This
+  // way panels can share blob data instead of each having a copy.
+  void setData(
+      const QByteArray &data,
+      std::shared_ptr<const void> owner = std::shared_ptr<const void>());
+  // Visualises a file without reading it whole - for files too large to
+  // load.  Such files are always sampled uniformly.
+  void setFile(const QString &path);
   void setRange(const size_t start, const size_t end);
 
  private slots:
@@ -52,7 +62,8 @@ class VisualisationPanel : public QWidget {
   void minimapSelectionChanged(size_t start, size_t end);
 
  private:
-  enum class ESampler {NO_SAMPLER, UNIFORM_SAMPLER};
+  enum class ESampler {NO_SAMPLER, UNIFORM_SAMPLER, ENTROPY_SAMPLER,
+                       PYRAMID_SAMPLER};
   enum class EVisualisation {DIGRAM, TRIGRAM, LAYERED_DIGRAM};
 
   static const std::map<QString, ESampler> k_sampler_map;
@@ -63,11 +74,14 @@ class VisualisationPanel : public QWidget {
 
   static util::ISampler* getSampler(ESampler type,
                                     const QByteArray &data,
+                                    std::shared_ptr<const void> owner,
                                     int sample_size);
   static VisualisationWidget* getVisualisation(EVisualisation type,
                                                QWidget *parent = 0);
   static QString prepareAddressString(size_t start, size_t end);
 
+  util::ISampler* createSampler(ESampler type, int sample_size);
+  void setSamplers();
   void setVisualisation(EVisualisation type);
   void refreshVisualisation();
   void initLayout();
@@ -75,13 +89,19 @@ class VisualisationPanel : public QWidget {
   QBoxLayout* prepareVisualisationOptions();
 
   QByteArray data_;
+  std::shared_ptr<const void> data_owner_;
+  // Set if sampling from a file instead of data_.
+  QString file_path_;
   ESampler sampler_type_;
   EVisualisation visualisation_type_;
   int sample_size_;
   util::ISampler *sampler_, *minimap_sampler_;
+  // Of data_, if there is any.
+  std::shared_ptr<util::HistogramIndex> histogram_index_;
   MinimapPanel *minimap_;
   VisualisationWidget *visualisation_;
 
+  QComboBox *sampling_method_box_;
   QSpinBox *sample_size_box_;
   QBoxLayout *layout_, *options_layout_;
   QSplitter *splitter_;
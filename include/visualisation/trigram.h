@@ -127,7 +127,8 @@ class TrigramWidget : public VisualisationWidget {
   void resizeGLImpl(int w, int h) override;
   void paintGLImpl() override;
 
-  AdditionalResampleData* onAsyncResample() override;
+  AdditionalResampleData* onAsyncResample(
+      const util::SampleSnapshot &sample) override;
 
   void paintLabels(QMatrix4x4& scene_mp, QMatrix4x4& scene_m);
   void paintLabel(LabelPositionMixer& mixer, QMatrix4x4& scene_to_screen,
@@ -161,7 +162,7 @@ class TrigramWidget : public VisualisationWidget {
 
  private:
   void setBrightness(int value);
-  int suggestBrightness(); // heuristic
+  int suggestBrightness(const util::SampleSnapshot &sample); // heuristic
   void autoSetBrightness();
 
   QBasicTimer timer;
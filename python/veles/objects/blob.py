@@ -1,4 +1,3 @@
-from veles import network_pb2
 from veles.objects.base import LocalObject
 
 
@@ -10,11 +9,7 @@ class Blob(LocalObject):
 
     def fetch_data(self):
         if self._data is None:
-            req = network_pb2.Request()
-            req.type = network_pb2.Request.GET_BLOB_DATA
-            req.id.extend(self._id_path)
-            self._client._send_req(req)
-            self._data = self._client._recv_msg()
+            self._data = self._client.get_blob_data(self)
 
     def __iter__(self):
         self.fetch_data()
@@ -1,10 +1,14 @@
+import os
 import socket
 import struct
+import tempfile
 import unittest
+import zlib
 
 import mock
 
 from veles import exceptions
+from veles import network_pb2
 from veles import veles_api
 
 
@@ -47,6 +51,8 @@ class TestVelesApi(unittest.TestCase):
         msg = struct.pack('<I', 4) + b'foobar'
         self.socket_mock().recv.side_effect = [struct.pack('<I', 6), b'123456']
         self.socket_mock().send.side_effect = [4, 6]
+        RespClass().request_id = 1
+        RespClass.reset_mock()
         client._send_req(req)
 
         self.socket_mock().send.assert_has_calls(
@@ -54,3 +60,165 @@ class TestVelesApi(unittest.TestCase):
         self.socket_mock().recv.assert_has_calls([mock.call(4), mock.call(6)])
         RespClass.assert_called_once_with()
         RespClass().ParseFromString.assert_called_once_with(b'123456')
+
+    def test_responses_out_of_order(self):
+        client = self._create_client()
+        req = mock.MagicMock()
+        req.ByteSize.return_value = 0
+        req.SerializeToString.return_value = b''
+        self.socket_mock().send.side_effect = lambda msg: len(msg)
+        first = client.send_request(req)
+        second = client.send_request(req)
+        self.assertNotEqual(first, second)
+
+        responses = [mock.MagicMock(request_id=second, ok=True, results=[]),
+                     mock.MagicMock(request_id=first, ok=True, results=[])]
+        with mock.patch('veles.network_pb2.Response',
+                        side_effect=responses):
+            with mock.patch.object(client, '_recv_msg', return_value=b''):
+                client.get_response(first)
+                self.assertEqual(client._recv_msg.call_count, 2)
+                client.get_response(second)
+                self.assertEqual(client._recv_msg.call_count, 2)
+
+    def test_get_blob_data_streamed(self):
+        client = self._create_client()
+        self.socket_mock().send.side_effect = lambda msg: len(msg)
+        blob = mock.MagicMock(id=5)
+
+        parts = []
+        for offset, data, last in [(0, b'abc', False), (3, b'de', True)]:
+            resp = network_pb2.Response()
+            resp.request_id = 1
+            resp.ok = True
+            resp.compressed = True
+            resp.data = zlib.compress(data)
+            resp.data_offset = offset
+            resp.data_size = 5
+            resp.last_part = last
+            parts.append(resp.SerializeToString())
+        with mock.patch.object(client, '_recv_msg', side_effect=parts):
+            data = client.get_blob_data(blob, compress=True)
+        self.assertEqual(data, b'abcde')
+
+    def test_iter_chunk_tree_streamed(self):
+        client = self._create_client()
+        self.socket_mock().send.side_effect = lambda msg: len(msg)
+        blob = veles_api.objects.Blob(client, network_pb2.LocalObject(id=1))
+
+        pages = []
+        for objs, last in [([(2, 1), (3, 2)], False), ([(4, 1)], True)]:
+            resp = network_pb2.Response()
+            resp.request_id = 1
+            resp.ok = True
+            resp.last_part = last
+            for obj_id, parent_id in objs:
+                res = resp.results.add()
+                res.id = obj_id
+                res.parent_id = parent_id
+                res.type = veles_api.VelesClient.ObjectTypes.CHUNK
+            pages.append(resp.SerializeToString())
+        with mock.patch.object(client, '_recv_msg', side_effect=pages):
+            objs = list(client.iter_chunk_tree(blob))
+        self.assertEqual([obj.id for obj in objs], [2, 3, 4])
+        self.assertEqual([obj.parent.id for obj in objs], [1, 2, 1])
+
+    def test_subscription_events(self):
+        client = self._create_client()
+        self.socket_mock().send.side_effect = lambda msg: len(msg)
+        blob = veles_api.objects.Blob(client, network_pb2.LocalObject(id=1))
+        subscription_id = client.subscribe(
+            blob, network_pb2.Request.BLOB_DATA)
+
+        msgs = []
+        for request_id, data, last in [(subscription_id, b'abcd', False),
+                                       (subscription_id, b'x', False),
+                                       (subscription_id, b'', True),
+                                       (subscription_id + 1, b'', False)]:
+            resp = network_pb2.Response()
+            resp.request_id = request_id
+            resp.ok = True
+            resp.data = data
+            resp.last_part = last
+            msgs.append(resp.SerializeToString())
+        with mock.patch.object(client, '_recv_msg', side_effect=msgs):
+            self.assertEqual(client.get_event(subscription_id).data, b'abcd')
+            self.assertEqual(client.get_event(subscription_id).data, b'x')
+            client.unsubscribe(subscription_id)
+        self.assertEqual(client._pending, {})
+        self.assertEqual(client._responses, {})
+
+    def test_apply_batch(self):
+        client = self._create_client()
+        self.socket_mock().send.side_effect = lambda msg: len(msg)
+        blob = veles_api.objects.Blob(client, network_pb2.LocalObject(id=1))
+        chunk = veles_api.objects.Chunk(client, network_pb2.LocalObject(id=2))
+
+        resp = network_pb2.Response()
+        resp.request_id = 1
+        resp.ok = True
+        resp.new_ids.extend([7, 8])
+        with mock.patch.object(client, '_recv_msg',
+                               side_effect=[resp.SerializeToString()]):
+            new_ids = client.apply_batch(
+                blob,
+                create=[{'name': 'a', 'start': 0, 'end': 4},
+                        {'name': 'b', 'start': 0, 'end': 2, 'parent': 0,
+                         'items': [(0, 1, 'x')]}],
+                delete=[chunk],
+                fields=[(1, [(1, 2, 'y')])])
+        self.assertEqual(new_ids, [7, 8])
+
+        sent = self.socket_mock().send.call_args[0][0]
+        req = network_pb2.Request()
+        req.ParseFromString(sent[4:])
+        self.assertEqual(req.type, network_pb2.Request.BATCH)
+        self.assertEqual(list(req.batch_delete), [2])
+        self.assertEqual([c.parent_index for c in req.batch_create], [0, 1])
+        self.assertEqual(req.batch_create[1].items[0].name, 'x')
+        self.assertEqual(req.batch_fields[0].chunk_index, 2)
+
+    def test_get_blob_data_shared_memory(self):
+        client = veles_api.VelesClient(local_path='/tmp/veles')
+        self.socket_mock.assert_called_with(
+            socket.AF_UNIX, socket.SOCK_STREAM)
+        self.socket_mock().send.side_effect = lambda msg: len(msg)
+        blob = mock.MagicMock(id=5)
+
+        with tempfile.TemporaryFile() as shared:
+            shared.write(b'xyabcdez')
+            shared.flush()
+            client._fds.append(os.dup(shared.fileno()))
+        resp = network_pb2.Response()
+        resp.request_id = 1
+        resp.ok = True
+        resp.shared_memory = True
+        resp.data_offset = 2
+        resp.data_size = 5
+        with mock.patch.object(client, '_recv_msg',
+                               side_effect=[resp.SerializeToString()]):
+            data = client.get_blob_data(blob, shared_memory=True)
+        self.assertEqual(data[:], b'abcde')
+        self.assertEqual(client._fds, [])
+
+    def test_find(self):
+        client = self._create_client()
+        self.socket_mock().send.side_effect = lambda msg: len(msg)
+        blob = mock.MagicMock(id=5)
+
+        resp = network_pb2.Response()
+        resp.request_id = 1
+        resp.ok = True
+        resp.hits.extend([3, 10])
+        with mock.patch.object(client, '_recv_msg',
+                               side_effect=[resp.SerializeToString()]):
+            hits = client.find(blob, b'MZ', offset=2, max_hits=5)
+        self.assertEqual(hits, [3, 10])
+
+        sent = self.socket_mock().send.call_args[0][0]
+        req = network_pb2.Request()
+        req.ParseFromString(sent[4:])
+        self.assertEqual(req.type, network_pb2.Request.FIND)
+        self.assertEqual(req.pattern, b'MZ')
+        self.assertEqual(req.data_offset, 2)
+        self.assertEqual(req.max_hits, 5)
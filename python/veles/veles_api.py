@@ -11,9 +11,13 @@
 # WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
 # See the License for the specific language governing permissions and
 # limitations under the License.
+import array
+import mmap
+import os
 import socket
 import struct
 import weakref
+import zlib
 
 from veles import exceptions as exc
 from veles import network_pb2
@@ -22,6 +26,9 @@ from veles import objects
 
 class VelesClient(object):
 
+    # blob data is streamed in parts of at most this many bytes
+    DATA_PART_SIZE = 1024 * 1024
+
     # This corresponds to enum in types.h - we might think about moving it
     # to .proto file so we don't have to modify 2 independent places
     class ObjectTypes(object):
@@ -37,13 +44,34 @@ class VelesClient(object):
             CHUNK: objects.Chunk,
         }
 
-    def __init__(self, ip_addr='127.0.0.1', port=3135):
+    def __init__(self, ip_addr='127.0.0.1', port=3135, local_path=None):
+        """Connects to Veles over TCP, or to its local socket at local_path.
+
+        The local socket is named "veles" in the temporary directory by
+        default, and is needed for shared memory blob data.
+        """
         self.ip_addr = ip_addr
         self.port = port
-        self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+        self.local_path = local_path
+        if local_path is None:
+            self.sock = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+            address = (ip_addr, port)
+            # file descriptors are only passed over local sockets
+            self._fds = None
+        else:
+            self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+            address = local_path
+            # Python 2 cannot receive them
+            self._fds = [] if hasattr(self.sock, 'recvmsg') else None
         self._objects = weakref.WeakValueDictionary()
+        self._next_request_id = 1
+        # request id -> request still waiting for its response
+        self._pending = {}
+        # request id -> [(response, blob data, is last)] received out of
+        # order
+        self._responses = {}
         try:
-            self.sock.connect((ip_addr, port))
+            self.sock.connect(address)
         except socket.error as ex:
             raise exc.ConnectionException(str(ex))
 
@@ -57,7 +85,7 @@ class VelesClient(object):
         chunks = []
         while total_recv < length:
             try:
-                recv = self.sock.recv(min(4096, length - total_recv))
+                recv = self._recv(min(4096, length - total_recv))
             except socket.error as ex:
                 raise exc.ConnectionException(str(ex))
             if recv == b'':
@@ -66,7 +94,45 @@ class VelesClient(object):
             total_recv += len(recv)
         return b''.join(chunks)
 
-    def _send_req(self, req):
+    def _recv(self, length):
+        if self._fds is None:
+            return self.sock.recv(length)
+        fd_size = array.array('i').itemsize
+        recv, ancdata, _, _ = self.sock.recvmsg(
+            length, socket.CMSG_SPACE(fd_size))
+        for level, msg_type, data in ancdata:
+            if level == socket.SOL_SOCKET and msg_type == socket.SCM_RIGHTS:
+                fds = array.array('i')
+                fds.frombytes(data[:len(data) - len(data) % fd_size])
+                self._fds.extend(fds)
+        return recv
+
+    def _map_shared(self, resp):
+        # descriptors come in the order of the responses they belong to
+        fd = self._fds.pop(0)
+        try:
+            if not resp.data_size:
+                return b''
+            # the descriptor holds the whole blob, and mappings have to
+            # start at a multiple of the allocation granularity
+            skip = resp.data_offset % mmap.ALLOCATIONGRANULARITY
+            mapping = mmap.mmap(fd, skip + resp.data_size, mmap.MAP_SHARED,
+                                mmap.PROT_READ,
+                                offset=resp.data_offset - skip)
+            if not skip:
+                return mapping
+            return memoryview(mapping)[skip:]
+        finally:
+            os.close(fd)
+
+    def send_request(self, req):
+        """Sends request without waiting for the response.
+
+        Returns request id to be passed to get_response. Many requests can be
+        in flight at once, server may answer them in any order.
+        """
+        req.request_id = self._next_request_id
+        self._next_request_id += 1
         msg = struct.pack('<I', req.ByteSize()) + req.SerializeToString()
         total_sent = 0
         while total_sent < len(msg):
@@ -77,20 +143,86 @@ class VelesClient(object):
             if sent == 0:
                 raise exc.ConnectionException('socket connection broken')
             total_sent += sent
+        self._pending[req.request_id] = req
+        return req.request_id
+
+    @staticmethod
+    def _is_streamed(req):
+        if req.type == network_pb2.Request.GET_BLOB_DATA:
+            return bool(req.data_part_size) and not req.shared_memory
+        if req.type == network_pb2.Request.LIST_CHILDREN_RECURSIVE:
+            return req.stream
+        return req.type == network_pb2.Request.SUBSCRIBE
+
+    def _recv_part(self, request_id):
+        while not self._responses.get(request_id):
+            resp = network_pb2.Response()
+            resp.ParseFromString(self._recv_msg())
+            req = self._pending.get(resp.request_id)
+            streamed = req is not None and self._is_streamed(req)
+            data = None
+            if (resp.ok and req is not None and
+                    req.type == network_pb2.Request.GET_BLOB_DATA):
+                if resp.shared_memory:
+                    data = self._map_shared(resp)
+                elif streamed:
+                    data = self._decode_data(resp, resp.data)
+                else:
+                    # blob contents are sent in a separate message right
+                    # after the response
+                    data = self._decode_data(resp, self._recv_msg())
+            last = not streamed or resp.last_part or not resp.ok
+            if last:
+                self._pending.pop(resp.request_id, None)
+            self._responses.setdefault(resp.request_id, []).append(
+                (resp, data, last))
+        parts = self._responses[request_id]
+        part = parts.pop(0)
+        if not parts:
+            del self._responses[request_id]
+        return part
 
-        response = self._recv_msg()
+    def _recv_parts(self, request_id):
+        """Yields (response, data) for every response to a request.
 
-        resp = network_pb2.Response()
-        resp.ParseFromString(response)
+        Streamed requests get many responses, others just one.
+        """
+        last = False
+        while not last:
+            resp, data, last = self._recv_part(request_id)
+            yield resp, data
+
+    def _recv_response(self, request_id):
+        resp = None
+        data = []
+        for resp, part in self._recv_parts(request_id):
+            if part is not None:
+                data.append(part)
+        if len(data) == 1:
+            # don't copy, it may be a shared memory mapping
+            return resp, data[0]
+        return resp, b''.join(data) if data else None
+
+    @staticmethod
+    def _decode_data(resp, data):
+        if resp.compressed:
+            return zlib.decompress(data)
+        return data
+
+    def get_response(self, request_id, id_path=None):
+        resp, _ = self._recv_response(request_id)
         if not resp.ok:
             raise exc.RequestFailed(resp.error_msg)
 
         objs = []
         for res in resp.results:
-            obj = self._prepare_object(res, req.id)
+            obj = self._prepare_object(res, id_path or [])
             objs.append(obj)
         return objs
 
+    def _send_req(self, req, id_path=None):
+        return self.get_response(self.send_request(req), id_path)
+
     def _prepare_object(self, res, id_path, parent=None):
         if parent is None and id_path:
             parent = self._objects.get(id_path[-1])
@@ -110,40 +242,249 @@ class VelesClient(object):
         return results
 
     def get_chunk_tree(self, obj):
-        req = network_pb2.Request()
-        req.type = network_pb2.Request.LIST_CHILDREN_RECURSIVE
-        req.id.extend(obj._id_path)
-        results = self._send_req(req)
-
         obj.children = []
-        for res in results:
-            res.parent = obj
-            obj.children.append(res)
+        results = []
+        for child in self.iter_chunk_tree(obj):
+            child.parent.children.append(child)
+            if child.parent is obj:
+                results.append(child)
         return results
 
-    def create_chunk(self, parent, name,
-                     start, end, comment='', chunk_type=''):
+    def iter_chunk_tree(self, obj, page_size=0,
+                        skip_comments=False, skip_items=False):
+        """Yields all objects below obj, parents before their children.
+
+        The tree is streamed from the server page by page, so this works
+        for huge trees.  Yielded objects have parent set, but children are
+        left empty.
+        """
+        req = network_pb2.Request()
+        req.type = network_pb2.Request.LIST_CHILDREN_RECURSIVE
+        req.object_id = obj.id
+        req.stream = True
+        req.page_size = page_size
+        req.skip_comments = skip_comments
+        req.skip_items = skip_items
+        # ancestors of the object being listed
+        path = [obj]
+        for resp, _ in self._recv_parts(self.send_request(req)):
+            if not resp.ok:
+                raise exc.RequestFailed(resp.error_msg)
+            for res in resp.results:
+                while len(path) > 1 and path[-1].id != res.parent_id:
+                    path.pop()
+                child = self._prepare_object(res, path[-1]._id_path, path[-1])
+                path.append(child)
+                yield child
+
+    def _chunk_request(self, parent, name, start, end, comment, chunk_type):
         req = network_pb2.Request()
         req.type = network_pb2.Request.ADD_CHILD_CHUNK
-        req.id.extend(parent._id_path)
+        req.object_id = parent.id
 
         req.name = name
         req.comment = comment
         req.chunk_start = start
         req.chunk_end = end
         req.chunk_type = chunk_type
-        results = self._send_req(req)
+        return req
+
+    def create_chunk(self, parent, name,
+                     start, end, comment='', chunk_type=''):
+        req = self._chunk_request(parent, name, start, end,
+                                  comment, chunk_type)
+        results = self._send_req(req, parent._id_path)
         new_chunk = results[0]
         parent.children.append(new_chunk)
         return new_chunk
 
+    def create_chunks(self, parent, chunks):
+        """Creates many chunks in parent without a round trip per chunk.
+
+        chunks is an iterable of dicts with create_chunk arguments
+        (name, start, end and optionally comment and chunk_type).
+        """
+        request_ids = []
+        for chunk in chunks:
+            req = self._chunk_request(
+                parent, chunk['name'], chunk['start'], chunk['end'],
+                chunk.get('comment', ''), chunk.get('chunk_type', ''))
+            request_ids.append(self.send_request(req))
+
+        new_chunks = []
+        for request_id in request_ids:
+            new_chunk = self.get_response(request_id, parent._id_path)[0]
+            parent.children.append(new_chunk)
+            new_chunks.append(new_chunk)
+        return new_chunks
+
+    @staticmethod
+    def _add_items(packed_items, items):
+        for start, end, name in items:
+            packed_item = packed_items.add()
+            packed_item.start = start
+            packed_item.end = end
+            packed_item.name = name
+
+    def apply_batch(self, blob, create=(), delete=(), fields=()):
+        """Changes many chunks of blob at once, returns ids of new chunks.
+
+        create is an iterable of dicts with create_chunk arguments (name,
+        start, end and optionally chunk_type), plus optional parent - a
+        chunk, or the index of an earlier entry of create - and items, a
+        list of (start, end, name) fields.  delete is an iterable of chunks
+        and sub-blobs.  fields is an iterable of (chunk, items) pairs that
+        replace the fields of chunks, which can also be given by their
+        index in create.
+
+        The server applies all of it or nothing, deletions first.  Local
+        objects are not updated - list the blob again to see the changes.
+        """
+        req = network_pb2.Request()
+        req.type = network_pb2.Request.BATCH
+        req.object_id = blob.id
+        req.batch_delete.extend(obj.id for obj in delete)
+        for chunk in create:
+            packed = req.batch_create.add()
+            parent = chunk.get('parent')
+            if isinstance(parent, int):
+                packed.parent_index = parent + 1
+            elif parent is not None:
+                packed.parent_id = parent.id
+            packed.name = chunk['name']
+            packed.chunk_type = chunk.get('chunk_type', '')
+            packed.chunk_start = chunk['start']
+            packed.chunk_end = chunk['end']
+            self._add_items(packed.items, chunk.get('items', ()))
+        for chunk, items in fields:
+            packed = req.batch_fields.add()
+            if isinstance(chunk, int):
+                packed.chunk_index = chunk + 1
+            else:
+                packed.chunk_id = chunk.id
+            self._add_items(packed.items, items)
+        resp, _ = self._recv_response(self.send_request(req))
+        if not resp.ok:
+            raise exc.RequestFailed(resp.error_msg)
+        return list(resp.new_ids)
+
+    def get_blob_data(self, blob, offset=0, length=0, compress=False,
+                      shared_memory=False):
+        """Fetches blob data, or length bytes of it starting at offset.
+
+        length of 0 means up to the end of the blob.  With shared_memory
+        (only over a local socket, on Linux) the data is not sent through
+        the socket - a read-only mmap of the blob's shared memory (or a
+        memoryview of it) is returned instead.
+        """
+        if shared_memory and self._fds is None:
+            raise exc.VelesException(
+                'Shared memory needs a local connection and Python 3')
+        req = network_pb2.Request()
+        req.type = network_pb2.Request.GET_BLOB_DATA
+        req.object_id = blob.id
+        req.data_offset = offset
+        req.data_length = length
+        req.data_part_size = self.DATA_PART_SIZE
+        req.compress = compress
+        req.shared_memory = shared_memory
+        resp, data = self._recv_response(self.send_request(req))
+        if not resp.ok:
+            raise exc.RequestFailed(resp.error_msg)
+        return data
+
+    def _analyze(self, blob, op, offset, length, **fields):
+        req = network_pb2.Request()
+        req.type = op
+        req.object_id = blob.id
+        req.data_offset = offset
+        req.data_length = length
+        for name, value in fields.items():
+            setattr(req, name, value)
+        resp, _ = self._recv_response(self.send_request(req))
+        if not resp.ok:
+            raise exc.RequestFailed(resp.error_msg)
+        return resp
+
+    def find(self, blob, pattern, offset=0, length=0, max_hits=0):
+        """Searches blob data on the server, returns offsets of the hits.
+
+        At most max_hits hits are returned (0 means the server's limit).
+        The search covers length bytes starting at offset, length of 0
+        means up to the end of the blob.
+        """
+        resp = self._analyze(blob, network_pb2.Request.FIND, offset, length,
+                             pattern=pattern, max_hits=max_hits)
+        return list(resp.hits)
+
+    def byte_histogram(self, blob, offset=0, length=0):
+        """Returns counts of all 256 byte values in a range of blob data."""
+        resp = self._analyze(blob, network_pb2.Request.HISTOGRAM,
+                             offset, length)
+        return list(resp.histogram)
+
+    def entropy(self, blob, window_size=0, offset=0, length=0):
+        """Returns entropy of consecutive windows of blob data.
+
+        Values are in bits per byte, window_size of 0 means the server's
+        default.  The server refuses windows giving more than 1Mi values.
+        """
+        resp = self._analyze(blob, network_pb2.Request.ENTROPY, offset,
+                             length, window_size=window_size)
+        return list(resp.entropy)
+
+    def hash_data(self, blob, algorithm=network_pb2.Request.SHA256,
+                  offset=0, length=0):
+        """Returns the digest of a range of blob data."""
+        resp = self._analyze(blob, network_pb2.Request.HASH, offset, length,
+                             hash_algorithm=algorithm)
+        return resp.hash
+
+    def subscribe(self, obj, subscription, offset=0, length=0):
+        """Starts watching obj for changes, returns subscription id.
+
+        subscription is one of network_pb2.Request.CHILDREN, DESCRIPTION,
+        CHUNK_DATA or BLOB_DATA - the last one watches length bytes of blob
+        data starting at offset (length of 0 means up to the end).  Changes
+        are received with get_event, the first event describes the current
+        state.
+        """
+        req = network_pb2.Request()
+        req.type = network_pb2.Request.SUBSCRIBE
+        req.object_id = obj.id
+        req.subscription = subscription
+        req.data_offset = offset
+        req.data_length = length
+        return self.send_request(req)
+
+    def get_event(self, subscription_id):
+        """Waits for the next change event of a subscription.
+
+        Returns the raw response - objects in results for children,
+        description and chunk data subscriptions, changed bytes in data
+        (starting at data_offset) for blob data ones - one change may come
+        as several such events.
+        """
+        resp, _, _ = self._recv_part(subscription_id)
+        if not resp.ok:
+            raise exc.RequestFailed(resp.error_msg)
+        return resp
+
+    def unsubscribe(self, subscription_id):
+        req = network_pb2.Request()
+        req.type = network_pb2.Request.UNSUBSCRIBE
+        req.subscription_id = subscription_id
+        self._send_req(req)
+        # events sent before the subscription ended are of no use anymore
+        self._responses.pop(subscription_id, None)
+
     def delete_object(self, obj):
         if obj.type not in [self.ObjectTypes.SUB_BLOB, self.ObjectTypes.CHUNK]:
             raise exc.VelesException('Unsupported object type to delete')
 
         req = network_pb2.Request()
         req.type = network_pb2.Request.DELETE_OBJECT
-        req.id.extend(obj._id_path)
+        req.object_id = obj.id
         self._send_req(req)
         if obj.parent:
             obj.parent.children.remove(obj)
@@ -0,0 +1,77 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <QtGlobal>
+
+#include "data/sealed_memory.h"
+
+#ifdef Q_OS_LINUX
+#include <cstring>
+
+#include <fcntl.h>
+#include <linux/memfd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace veles {
+namespace data {
+
+std::shared_ptr<const SealedMemory> SealedMemory::create(const uint8_t *data,
+                                                         uint64_t size) {
+#ifdef Q_OS_LINUX
+  int fd = syscall(SYS_memfd_create, "veles-blob-data",
+                   MFD_CLOEXEC | MFD_ALLOW_SEALING);
+  if (fd < 0) {
+    return nullptr;
+  }
+  if (ftruncate(fd, size) != 0) {
+    close(fd);
+    return nullptr;
+  }
+  if (size) {
+    void *mapping = mmap(nullptr, size, PROT_WRITE, MAP_SHARED, fd, 0);
+    if (mapping == MAP_FAILED) {
+      close(fd);
+      return nullptr;
+    }
+    memcpy(mapping, data, size);
+    munmap(mapping, size);
+  }
+  // Clients may keep the mapping as long as they like - make sure it
+  // cannot change under them.
+  if (fcntl(fd, F_ADD_SEALS,
+            F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL) != 0) {
+    close(fd);
+    return nullptr;
+  }
+  return std::shared_ptr<const SealedMemory>(new SealedMemory(fd, size));
+#else
+  Q_UNUSED(data);
+  Q_UNUSED(size);
+  return nullptr;
+#endif
+}
+
+SealedMemory::~SealedMemory() {
+#ifdef Q_OS_LINUX
+  close(fd_);
+#endif
+}
+
+}  // namespace data
+}  // namespace veles
@@ -14,6 +14,11 @@
  * limitations under the License.
  *
  */
+#include <algorithm>
+#include <limits>
+
+#include <QHash>
+
 #include "db/handle.h"
 #include "db/object.h"
 #include "db/getter.h"
@@ -27,6 +32,31 @@ namespace db {
 
 std::atomic<uint64_t> LocalObject::static_id_;
 
+namespace {
+
+// One level of a subtree walk: the children of object (ordered by id) that
+// are yet to be listed.
+struct WalkLevel {
+  PLocalObject object;
+  std::vector<PLocalObject> children;
+  size_t next;
+  // Set if children only holds the first limit ones.
+  bool truncated;
+};
+
+WalkLevel walkLevel(PLocalObject object, uint64_t min_id, size_t limit) {
+  WalkLevel level{object, std::vector<PLocalObject>(), 0, false};
+  const auto &children = object->children();
+  auto it = children.lowerBound(min_id);
+  for (; it != children.end() && level.children.size() < limit; ++it) {
+    level.children.push_back(it.value());
+  }
+  level.truncated = it != children.end();
+  return level;
+}
+
+}  // namespace
+
 void LocalObject::getInfo(InfoGetter *getter, PInfoRequest req, bool once) {
   if (req.dynamicCast<dbif::ChildrenRequest>()) {
     children_reply(getter);
@@ -37,6 +67,9 @@ void LocalObject::getInfo(InfoGetter *getter, PInfoRequest req, bool once) {
         shared_this->remove_children_watcher(getter);
       });
     }
+  } else if (auto subtreereq = req.dynamicCast<dbif::SubtreeRequest>()) {
+    // Listings are one-shot - subscribe to children to watch for changes.
+    subtree_reply(getter, *subtreereq);
   } else if (req.dynamicCast<dbif::DescriptionRequest>()) {
     description_reply(getter);
     if (!once) {
@@ -77,13 +110,44 @@ void LocalObject::runMethod(MethodRunner *runner, PMethodRequest req) {
 }
 
 void LocalObject::addChild(PLocalObject obj) {
-  children_.insert(obj);
-  children_updated();
+  children_.insert(obj->id(), obj);
+  db_->registerObject(obj);
+  children_changed();
 }
 
 void LocalObject::delChild(PLocalObject obj) {
-  children_.remove(obj);
-  children_updated();
+  children_.remove(obj->id());
+  children_changed();
+}
+
+void LocalObject::children_changed() {
+  if (db_ && db_->inBatch()) {
+    children_dirty_ = true;
+    defer_updates();
+  } else {
+    children_updated();
+  }
+}
+
+void LocalObject::defer_updates() {
+  if (!updates_deferred_) {
+    updates_deferred_ = true;
+    db_->deferUpdates(sharedFromThis());
+  }
+}
+
+void LocalObject::flushUpdates() {
+  updates_deferred_ = false;
+  if (!dead()) {
+    flush_updates();
+  }
+}
+
+void LocalObject::flush_updates() {
+  if (children_dirty_) {
+    children_dirty_ = false;
+    children_updated();
+  }
 }
 
 void LocalObject::setComment(QString comment) {
@@ -98,10 +162,75 @@ void LocalObject::children_reply(InfoGetter *getter) {
   getter->sendInfo<dbif::ChildrenReply>(res);
 }
 
+void LocalObject::subtree_reply(InfoGetter *getter, const dbif::SubtreeRequest &req) {
+  // The walk is rebuilt from the cursor every time, so the tree may change
+  // between requests - objects created meanwhile are listed if the walk has
+  // not passed them yet, and a deleted cursor object resumes at its next
+  // sibling.
+  size_t limit = req.limit ? req.limit : std::numeric_limits<size_t>::max() - 1;
+  std::vector<WalkLevel> stack;
+  uint64_t min_id = req.cursor.empty() ? 0 : req.cursor[0];
+  stack.push_back(walkLevel(sharedFromThis(), min_id, limit + 1));
+  for (size_t i = 0; i < req.cursor.size(); i++) {
+    WalkLevel &level = stack.back();
+    if (level.children.empty() || level.children[0]->id() != req.cursor[i]) {
+      break;
+    }
+    level.next = 1;
+    if (!req.recursive) {
+      break;
+    }
+    min_id = i + 1 < req.cursor.size() ? req.cursor[i + 1] : 0;
+    PLocalObject obj = level.children[0];
+    stack.push_back(walkLevel(obj, min_id, limit + 1));
+  }
+
+  std::vector<dbif::ObjectSnapshot> objects;
+  while (!stack.empty() && objects.size() < limit) {
+    WalkLevel &level = stack.back();
+    if (level.next == level.children.size()) {
+      stack.pop_back();
+      continue;
+    }
+    PLocalObject obj = level.children[level.next++];
+    objects.push_back(dbif::ObjectSnapshot());
+    obj->snapshot(&objects.back(), req.with_items);
+    objects.back().parent_id = level.object->id();
+    if (req.recursive) {
+      stack.push_back(walkLevel(obj, 0, limit));
+    }
+  }
+
+  std::vector<uint64_t> cursor;
+  bool more = false;
+  for (size_t i = 0; i < stack.size(); i++) {
+    if (i) {
+      cursor.push_back(stack[i].object->id());
+    }
+    if (stack[i].next < stack[i].children.size() || stack[i].truncated) {
+      more = true;
+    }
+  }
+  if (!more) {
+    cursor.clear();
+  } else if (!req.recursive) {
+    cursor.push_back(objects.back().id);
+  }
+  getter->sendInfo<dbif::SubtreeReply>(objects, cursor);
+}
+
 void LocalObject::description_reply(InfoGetter *getter) {
   getter->sendInfo<dbif::DescriptionReply>(name(), comment());
 }
 
+void LocalObject::snapshot(dbif::ObjectSnapshot *res, bool with_items) {
+  Q_UNUSED(with_items);
+  res->id = id();
+  res->type = type();
+  res->name = name();
+  res->comment = comment();
+}
+
 void LocalObject::children_updated() {
   for (InfoGetter *getter : children_watchers_) {
     children_reply(getter);
@@ -115,25 +244,40 @@ void LocalObject::description_updated() {
 }
 
 void LocalObject::kill() {
-  db_ = nullptr;
-  killed();
-
-  auto children = children_;
-  for (auto obj: children) {
-    obj->kill();
+  if (dead()) {
+    return;
   }
-
-  auto children_watchers = children_watchers_;
-  for (auto getter: children_watchers) {
-    getter->sendError<dbif::ObjectGoneError>();
+  // Walk the subtree iteratively - parsed files can be both huge and deep.
+  std::vector<PLocalObject> dying;
+  dying.push_back(sharedFromThis());
+  for (size_t i = 0; i < dying.size(); i++) {
+    PLocalObject obj = dying[i];
+    for (auto child : obj->children_) {
+      dying.push_back(child);
+    }
   }
 
-  auto description_watchers = description_watchers_;
-  for (auto getter: description_watchers) {
-    getter->sendError<dbif::ObjectGoneError>();
+  // Dead parents don't care about losing children, so once everything is
+  // marked dead only the surviving parent of this object gets notified.
+  for (auto obj : dying) {
+    obj->db_->unregisterObject(obj->id());
+    obj->db_ = nullptr;
+  }
+  for (auto obj : dying) {
+    QSet<InfoGetter *> watchers;
+    obj->killed(&watchers);
+    obj->children_.clear();
+    for (auto getter : watchers) {
+      getter->sendError<dbif::ObjectGoneError>();
+    }
   }
+}
 
-  Q_ASSERT(children_.empty());
+void LocalObject::killed(QSet<InfoGetter *> *watchers) {
+  watchers->unite(children_watchers_);
+  watchers->unite(description_watchers_);
+  children_watchers_.clear();
+  description_watchers_.clear();
 }
 
 void RootLocalObject::runMethod(MethodRunner *runner, PMethodRequest req) {
@@ -146,7 +290,38 @@ void RootLocalObject::runMethod(MethodRunner *runner, PMethodRequest req) {
 }
 
 void RootLocalObject::getInfo(InfoGetter *getter, PInfoRequest req, bool once) {
-    if (auto parsersreq = req.dynamicCast<dbif::ParsersListRequest>()) {
+    if (auto idreq = req.dynamicCast<dbif::ObjectByIdRequest>()) {
+      PLocalObject obj = db()->findObject(idreq->id);
+      if (obj && !idreq->path.empty()) {
+        // Children are kept by id, so checking the path is cheap.
+        PLocalObject walked = sharedFromThis();
+        for (auto id : idreq->path) {
+          walked = walked->children().value(id);
+          if (!walked) {
+            break;
+          }
+        }
+        if (walked != obj) {
+          obj.clear();
+        }
+      }
+      if (obj) {
+        getter->sendInfo<dbif::ObjectByIdReply>(db()->handle(obj));
+      } else {
+        getter->sendError<dbif::ObjectGoneError>();
+      }
+    } else if (auto idsreq = req.dynamicCast<dbif::ObjectsByIdRequest>()) {
+      std::vector<dbif::ObjectHandle> objects;
+      for (auto id : idsreq->ids) {
+        PLocalObject obj = db()->findObject(id);
+        if (!obj) {
+          getter->sendError<dbif::ObjectGoneError>();
+          return;
+        }
+        objects.push_back(db()->handle(obj));
+      }
+      getter->sendInfo<dbif::ObjectsByIdReply>(objects);
+    } else if (auto parsersreq = req.dynamicCast<dbif::ParsersListRequest>()) {
         parsers_list_reply(getter);
         if (!once) {
           parsers_list_watchers_.insert(getter);
@@ -162,13 +337,13 @@ void RootLocalObject::getInfo(InfoGetter *getter, PInfoRequest req, bool once) {
 
 void DataBlobObject::description_reply(InfoGetter *getter) {
   getter->sendInfo<dbif::BlobDescriptionReply>(
-    name(), comment(), 0, data().size(), 8
+    name(), comment(), 0, data().size(), data().width()
   );
 }
 
 void DataBlobObject::data_reply(InfoGetter *getter, uint64_t start, uint64_t end) {
-    end = std::min(end, uint64_t(data_.size()));
-    getter->sendInfo<dbif::BlobDataReply>(data_.data(start, end));
+    end = std::min(end, uint64_t(data_->size()));
+    getter->sendInfo<dbif::BlobDataReply>(data_->data(start, end));
 }
 
 void DataBlobObject::remove_data_watcher(InfoGetter *getter) {
@@ -177,7 +352,7 @@ void DataBlobObject::remove_data_watcher(InfoGetter *getter) {
 
 void DataBlobObject::getInfo(InfoGetter *getter, PInfoRequest req, bool once) {
   if (auto datareq = req.dynamicCast<dbif::BlobDataRequest>()) {
-    if (datareq->start > data_.size()) {
+    if (datareq->start > data_->size()) {
       getter->sendError<dbif::BlobDataInvalidRangeError>();
       return;
     }
@@ -189,6 +364,32 @@ void DataBlobObject::getInfo(InfoGetter *getter, PInfoRequest req, bool once) {
         shared_this.dynamicCast<DataBlobObject>()->remove_data_watcher(getter);
       });
     }
+  } else if (auto snapreq = req.dynamicCast<dbif::BlobSnapshotRequest>()) {
+    std::shared_ptr<util::HistogramIndex> index;
+    if (snapreq->histogram_index) {
+      // QByteArray sizes are ints.
+      if (!histogram_index_ &&
+          data_->octets() <= size_t(std::numeric_limits<int>::max())) {
+        std::shared_ptr<const data::BinData> snapshot = data_;
+        histogram_index_ = util::HistogramIndex::forData(
+            QByteArray::fromRawData(
+                reinterpret_cast<const char *>(snapshot->rawData()),
+                static_cast<int>(snapshot->octets())),
+            snapshot);
+      }
+      index = histogram_index_;
+    }
+    getter->sendInfo<dbif::BlobSnapshotReply>(data_, index);
+  } else if (req.dynamicCast<dbif::BlobSharedDataRequest>()) {
+    if (!sealed_data_) {
+      sealed_data_ = data::SealedMemory::create(data_->rawData(),
+                                                data_->octets());
+    }
+    if (sealed_data_) {
+      getter->sendInfo<dbif::BlobSharedDataReply>(sealed_data_);
+    } else {
+      getter->sendError<dbif::ObjectInvalidRequestError>();
+    }
   } else {
     LocalObject::getInfo(getter, req, once);
   }
@@ -196,28 +397,39 @@ void DataBlobObject::getInfo(InfoGetter *getter, PInfoRequest req, bool once) {
 
 void DataBlobObject::runMethod(MethodRunner *runner, PMethodRequest req) {
   if (auto datareq = req.dynamicCast<dbif::ChangeDataRequest>()) {
-    if (datareq->start >= data_.size()) {
+    if (datareq->start >= data_->size()) {
       runner->sendError<dbif::BlobDataInvalidRangeError>();
       return;
     }
     uint64_t start = datareq->start;
-    uint64_t end = std::min(datareq->end, uint64_t(data_.size()));
+    uint64_t end = std::min(datareq->end, uint64_t(data_->size()));
     uint64_t oldsize = end - start;
     const data::BinData &newdata = datareq->data;
-    if (newdata.width() != data_.width()) {
+    if (newdata.width() != data_->width()) {
       runner->sendError<dbif::BlobDataInvalidWidthError>();
       return;
     }
+    // It holds a snapshot - drop it before checking for them.
+    histogram_index_.reset();
     if (oldsize == newdata.size()) {
-      data_.setData(start, end, newdata);
+      // Snapshots only ever go away meanwhile, so a count of 1 means there
+      // are none.  The fence orders their last reads before our writes.
+      if (data_.use_count() > 1) {
+        data_ = std::make_shared<data::BinData>(*data_);
+      } else {
+        std::atomic_thread_fence(std::memory_order_acquire);
+      }
+      data_->setData(start, end, newdata);
     } else {
-      data::BinData merged(data_.width(), data_.size() - oldsize + newdata.size());
-      merged.setData(0, start, data_.data(0, start));
+      auto merged = std::make_shared<data::BinData>(
+          data_->width(), data_->size() - oldsize + newdata.size());
+      merged->setData(0, start, data_->data(0, start));
       uint64_t newend = start + newdata.size();
-      merged.setData(start, newend, newdata);
-      merged.setData(newend, merged.size(), data_.data(end, data_.size()));
-      std::swap(data_, merged);
+      merged->setData(start, newend, newdata);
+      merged->setData(newend, merged->size(), data_->data(end, data_->size()));
+      data_ = std::move(merged);
     }
+    sealed_data_.reset();
     bool moved = newdata.size() != oldsize;
     for (auto iter = data_watchers_.begin(); iter != data_watchers_.end(); iter++) {
       if (iter.value().second >= start &&
@@ -238,6 +450,11 @@ void DataBlobObject::runMethod(MethodRunner *runner, PMethodRequest req) {
     PLocalObject obj = ChunkObject::create(sharedFromThis(), parent_chunk,
       chreq->start, chreq->end, chreq->chunk_type, chreq->name);
     runner->sendResult<dbif::CreatedReply>(db()->handle(obj));
+  } else if (auto editreq = req.dynamicCast<dbif::ChunkTreeEditRequest>()) {
+    editTree(runner, *editreq, editreq->updates, editreq->deleted);
+  } else if (auto treereq = req.dynamicCast<dbif::ChunkCreateTreeRequest>()) {
+    editTree(runner, *treereq, std::vector<dbif::ChunkFieldsUpdate>(),
+             std::vector<dbif::ObjectHandle>());
   } else if (auto parse_req = req.dynamicCast<dbif::BlobParseRequest>()) {
     emit db()->parse(
         db()->handle(sharedFromThis()), runner->forwarder(db()->parserThread()),
@@ -247,24 +464,203 @@ void DataBlobObject::runMethod(MethodRunner *runner, PMethodRequest req) {
   }
 }
 
-void DataBlobObject::killed() {
-  LocalObject::killed();
-  parent_->delChild(sharedFromThis());
-  auto data_watchers = data_watchers_.keys();
-  for (auto getter: data_watchers) {
-    getter->sendError<dbif::ObjectGoneError>();
+void DataBlobObject::editTree(MethodRunner *runner,
+                              const dbif::ChunkCreateTreeRequest &req,
+                              const std::vector<dbif::ChunkFieldsUpdate> &updates,
+                              const std::vector<dbif::ObjectHandle> &deleted) {
+  // Objects to delete - together with their subtrees, nothing of this
+  // request may refer to them.
+  QSet<LocalObject *> dying;
+  for (auto &handle : deleted) {
+    auto local = handle.dynamicCast<LocalObjectHandle>();
+    if (!local) {
+      runner->sendError<dbif::InvalidTypeError>();
+      return;
+    }
+    PLocalObject obj = local->obj();
+    if (obj->dead()) {
+      runner->sendError<dbif::ObjectGoneError>();
+      return;
+    }
+    ChunkObject *chunk = dynamic_cast<ChunkObject *>(obj.data());
+    if (auto sub_blob = obj.dynamicCast<SubBlobObject>()) {
+      chunk = dynamic_cast<ChunkObject *>(sub_blob->parent());
+    }
+    if (!chunk || chunk->blob().data() != this) {
+      runner->sendError<dbif::InvalidTypeError>();
+      return;
+    }
+    dying.insert(obj.data());
+  }
+  auto is_dying = [&dying] (PLocalObject chunk) -> bool {
+    for (; chunk; chunk = chunk.staticCast<ChunkObject>()->parentChunk()) {
+      if (dying.contains(chunk.data())) {
+        return true;
+      }
+    }
+    return false;
+  };
+  // Existing chunks of this blob that the request builds on or changes.
+  auto find_chunk = [this, &is_dying] (const dbif::ObjectHandle &handle,
+                                       PLocalObject *res) -> bool {
+    auto local = handle.dynamicCast<LocalObjectHandle>();
+    if (!local || local->obj()->dead()) {
+      return false;
+    }
+    auto chunk = local->obj().dynamicCast<ChunkObject>();
+    if (!chunk || chunk->blob().data() != this || is_dying(chunk)) {
+      return false;
+    }
+    *res = local->obj();
+    return true;
+  };
+
+  // Placeholders of the request's nodes, mapped to their index in chunks
+  // (or to -1 - index for sub-blobs).
+  QHash<dbif::ObjectHandleBase *, int64_t> placeholders;
+  std::vector<PLocalObject> parents;
+  auto find_parent = [&placeholders, &find_chunk] (
+      const dbif::ObjectHandle &handle, PLocalObject *res) -> bool {
+    if (!handle) {
+      return true;
+    }
+    auto iter = placeholders.find(handle.data());
+    if (iter != placeholders.end()) {
+      return iter.value() >= 0;
+    }
+    return find_chunk(handle, res);
+  };
+
+  // Validate everything before touching the tree, so that a bad request
+  // leaves no half-built subtree behind.
+  for (size_t i = 0; i < req.chunks.size(); i++) {
+    PLocalObject parent;
+    if (!find_parent(req.chunks[i].parent_chunk, &parent)) {
+      runner->sendError<dbif::InvalidTypeError>();
+      return;
+    }
+    parents.push_back(parent);
+    if (req.chunks[i].placeholder) {
+      placeholders[req.chunks[i].placeholder.data()] = i;
+    }
+  }
+  for (size_t i = 0; i < req.sub_blobs.size(); i++) {
+    PLocalObject parent;
+    if (!req.sub_blobs[i].parent_chunk ||
+        !find_parent(req.sub_blobs[i].parent_chunk, &parent)) {
+      runner->sendError<dbif::InvalidTypeError>();
+      return;
+    }
+    parents.push_back(parent);
+    if (req.sub_blobs[i].placeholder) {
+      placeholders[req.sub_blobs[i].placeholder.data()] = -1 - int64_t(i);
+    }
+  }
+  std::vector<PLocalObject> updated;
+  for (auto &update : updates) {
+    PLocalObject chunk;
+    if (!update.chunk || !find_parent(update.chunk, &chunk)) {
+      runner->sendError<dbif::InvalidTypeError>();
+      return;
+    }
+    updated.push_back(chunk);
+  }
+
+  std::vector<PLocalObject> chunks;
+  std::vector<PLocalObject> sub_blobs;
+  auto resolve = [&placeholders, &chunks, &sub_blobs] (
+      const dbif::ObjectHandle &handle) -> PLocalObject {
+    auto iter = placeholders.find(handle.data());
+    if (iter == placeholders.end()) {
+      return PLocalObject();
+    }
+    if (iter.value() >= 0) {
+      return chunks[iter.value()];
+    }
+    return sub_blobs[-1 - iter.value()];
+  };
+  auto resolve_refs = [this, &resolve] (std::vector<data::ChunkDataItem> *items) {
+    for (auto &item : *items) {
+      for (auto &ref : item.ref) {
+        if (PLocalObject obj = resolve(ref)) {
+          ref = db()->handle(obj);
+        }
+      }
+    }
+  };
+
+  db()->beginBatch();
+  for (auto &handle : deleted) {
+    handle.staticCast<LocalObjectHandle>()->obj()->kill();
+  }
+  for (size_t i = 0; i < req.chunks.size(); i++) {
+    const dbif::ChunkTreeNode &node = req.chunks[i];
+    PLocalObject parent = parents[i];
+    if (!parent && node.parent_chunk) {
+      parent = resolve(node.parent_chunk);
+    }
+    chunks.push_back(ChunkObject::create(sharedFromThis(), parent,
+      node.start, node.end, node.chunk_type, node.name));
+  }
+  for (size_t i = 0; i < req.sub_blobs.size(); i++) {
+    const dbif::SubBlobTreeNode &node = req.sub_blobs[i];
+    PLocalObject parent = parents[req.chunks.size() + i];
+    if (!parent) {
+      parent = resolve(node.parent_chunk);
+    }
+    sub_blobs.push_back(SubBlobObject::create(parent.data(), node.data, node.name));
+  }
+  for (size_t i = 0; i < req.chunks.size(); i++) {
+    const dbif::ChunkTreeNode &node = req.chunks[i];
+    std::vector<data::ChunkDataItem> items = node.items;
+    resolve_refs(&items);
+    chunks[i].dynamicCast<ChunkObject>()->setParse(node.start, node.end, items);
+  }
+  for (size_t i = 0; i < updates.size(); i++) {
+    PLocalObject chunk = updated[i] ? updated[i] : resolve(updates[i].chunk);
+    std::vector<data::ChunkDataItem> fields = updates[i].fields;
+    resolve_refs(&fields);
+    chunk.staticCast<ChunkObject>()->setFields(fields);
+  }
+  db()->endBatch();
+
+  std::vector<dbif::ObjectHandle> chunk_handles;
+  for (auto &obj : chunks) {
+    chunk_handles.push_back(db()->handle(obj));
+  }
+  std::vector<dbif::ObjectHandle> sub_blob_handles;
+  for (auto &obj : sub_blobs) {
+    sub_blob_handles.push_back(db()->handle(obj));
+  }
+  runner->sendResult<dbif::ChunkTreeCreatedReply>(chunk_handles, sub_blob_handles);
+}
+
+void DataBlobObject::killed(QSet<InfoGetter *> *watchers) {
+  LocalObject::killed(watchers);
+  if (!parent_->dead()) {
+    parent_->delChild(sharedFromThis());
   }
+  for (auto getter : data_watchers_.keys()) {
+    watchers->insert(getter);
+  }
+  data_watchers_.clear();
 }
 
 void FileBlobObject::description_reply(InfoGetter *getter) {
   getter->sendInfo<dbif::FileBlobDescriptionReply>(
-    name(), comment(), 0, data().size(), 8, path()
+    name(), comment(), 0, data().size(), data().width(), path()
   );
 }
 
+void FileBlobObject::snapshot(dbif::ObjectSnapshot *res, bool with_items) {
+  LocalObject::snapshot(res, with_items);
+  res->path = path();
+}
+
 void SubBlobObject::description_reply(InfoGetter *getter) {
   getter->sendInfo<dbif::SubBlobDescriptionReply>(
-    name(), comment(), 0, data().size(), 8, db()->handle(parent()->sharedFromThis())
+    name(), comment(), 0, data().size(), data().width(),
+    db()->handle(parent()->sharedFromThis())
   );
 }
 
@@ -280,6 +676,52 @@ void ChunkObject::parse_updated() {
   }
 }
 
+void ChunkObject::parse_changed() {
+  if (db()->inBatch()) {
+    parse_dirty_ = true;
+    defer_updates();
+  } else {
+    parse_updated();
+  }
+}
+
+void ChunkObject::flush_updates() {
+  bool parse_dirty = parse_dirty_;
+  parse_dirty_ = false;
+  if (children_dirty()) {
+    // children_updated() recalculates the parse reply as well.
+    LocalObject::flush_updates();
+  } else if (parse_dirty) {
+    parse_updated();
+  }
+}
+
+void ChunkObject::setParse(uint64_t start, uint64_t end,
+                           const std::vector<data::ChunkDataItem> &items) {
+  start_ = start;
+  end_ = end;
+  items_ = items;
+  description_updated();
+  parse_changed();
+}
+
+void ChunkObject::setFields(const std::vector<data::ChunkDataItem> &fields) {
+  std::vector<data::ChunkDataItem> items;
+  bool in_field = false;
+  for (auto &item : items_) {
+    if (item.type == data::ChunkDataItem::FIELD) {
+      in_field = true;
+    } else if (item.type != data::ChunkDataItem::BITFIELD) {
+      in_field = false;
+    }
+    if (!in_field) {
+      items.push_back(item);
+    }
+  }
+  items.insert(items.end(), fields.begin(), fields.end());
+  setParse(start_, end_, items);
+}
+
 void ChunkObject::calcParseReplyItems() {
   parseReplyItems_ = items_;
 
@@ -333,6 +775,16 @@ void ChunkObject::description_reply(InfoGetter *getter) {
   );
 }
 
+void ChunkObject::snapshot(dbif::ObjectSnapshot *res, bool with_items) {
+  LocalObject::snapshot(res, with_items);
+  res->start = start_;
+  res->end = end_;
+  res->chunk_type = chunk_type_;
+  if (with_items) {
+    res->items = items_;
+  }
+}
+
 void ChunkObject::remove_parse_watcher(InfoGetter *getter) {
   parse_watchers_.remove(getter);
 }
@@ -359,11 +811,7 @@ void ChunkObject::runMethod(MethodRunner *runner, PMethodRequest req) {
     description_updated();
     runner->sendResult<dbif::NullReply>();
   } else if (auto preq = req.dynamicCast<dbif::SetChunkParseRequest>()) {
-    start_ = preq->start;
-    end_ = preq->end;
-    items_ = preq->items;
-    description_updated();
-    parse_updated();
+    setParse(preq->start, preq->end, preq->items);
     runner->sendResult<dbif::NullReply>();
   } else if (auto blobreq = req.dynamicCast<dbif::ChunkCreateSubBlobRequest>()) {
     PLocalObject obj = SubBlobObject::create(this, blobreq->data, blobreq->name);
@@ -373,17 +821,19 @@ void ChunkObject::runMethod(MethodRunner *runner, PMethodRequest req) {
   }
 }
 
-void ChunkObject::killed() {
-  LocalObject::killed();
-  if (parent_chunk_)
-    parent_chunk_->delChild(sharedFromThis());
-  else
-    blob_->delChild(sharedFromThis());
-
-  auto parse_watchers = parse_watchers_;
-  for (auto getter: parse_watchers) {
-    getter->sendError<dbif::ObjectGoneError>();
+void ChunkObject::killed(QSet<InfoGetter *> *watchers) {
+  LocalObject::killed(watchers);
+  PLocalObject parent = parent_chunk_ ? parent_chunk_ : blob_;
+  if (!parent->dead()) {
+    parent->delChild(sharedFromThis());
   }
+  watchers->unite(parse_watchers_);
+  parse_watchers_.clear();
+  // Drop references into the rest of the dead tree, so that it gets freed
+  // object by object instead of through a deep chain of destructors.
+  parent_chunk_.clear();
+  items_.clear();
+  parseReplyItems_.clear();
 }
 
 namespace {
@@ -58,7 +58,7 @@ dbif::ObjectHandle create_db() {
     root.dynamicCast<RootLocalObject>()->parsers_list_updated();
   });
   if (util::settings::network::enabled()) {
-    NetworkServer *network = new NetworkServer(root);
+    NetworkServer *network = new NetworkServer(db->handle(root));
     DbThread *network_thr = new DbThread;
     network->moveToThread(network_thr);
     QObject::connect(network, &QObject::destroyed, network_thr, &QThread::quit);
@@ -78,6 +78,32 @@ dbif::ObjectHandle Universe::handle(PLocalObject obj) {
   return objHandle;
 }
 
+void Universe::registerObject(PLocalObject obj) {
+  objects_.insert(obj->id(), obj);
+}
+
+PLocalObject Universe::findObject(uint64_t id) const {
+  PLocalObject obj = objects_.value(id).toStrongRef();
+  if (obj && obj->dead()) {
+    return PLocalObject();
+  }
+  return obj;
+}
+
+void Universe::endBatch() {
+  Q_ASSERT(batch_depth_ > 0);
+  if (--batch_depth_) {
+    return;
+  }
+  while (!deferred_.empty()) {
+    QList<PLocalObject> deferred;
+    std::swap(deferred, deferred_);
+    for (auto obj : deferred) {
+      obj->flushUpdates();
+    }
+  }
+}
+
 Universe::~Universe() {
   root_->kill();
 }
@@ -0,0 +1,201 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "util/concurrency/threadpool.h"
+#include "visualisation/minimap_texture.h"
+
+// Measures how fast minimap textures are computed from a large sample,
+// comparing the kernels against their previous implementations.
+
+namespace {
+
+namespace minimap = veles::visualisation::minimap;
+
+const size_t k_sample_size = 256 * 1024 * 1024;
+const int k_rounds = 5;
+
+typedef float* (*TextureFunction)(const uint8_t *sample, size_t sample_size,
+                                  size_t texture_size, double point_size);
+
+/*****************************************************************************/
+/* Previous implementations */
+/*****************************************************************************/
+
+float* oldAverageValueTexture(const uint8_t *sample, size_t sample_size,
+                              size_t texture_size, double point_size) {
+  auto bigtab = new float[texture_size];
+  memset(bigtab, 0, texture_size * sizeof(*bigtab));
+  minimap::forEachPoint(sample_size, texture_size, point_size,
+                        [sample, bigtab](size_t index, size_t begin,
+                                         size_t end) {
+    uint64_t point_sum = 0;
+    for (size_t i = begin; i < end; ++i) {
+      point_sum += sample[i];
+    }
+    uint8_t result = (end == begin) ? 0 : point_sum / (end - begin);
+    bigtab[index] = static_cast<float>(result);
+  });
+  return bigtab;
+}
+
+float calculateEntropyValue(uint64_t bytes_counts[], uint64_t total_count) {
+  if (total_count == 0) {
+    return 0.0f;
+  }
+  float entropy = 0.0f;
+  for (int i = 0; i < 256; ++i) {
+    if (bytes_counts[i] > 0) {
+      float fcounts = static_cast<float>(bytes_counts[i]) / total_count;
+      entropy -= fcounts * log2(fcounts);
+    }
+  }
+  entropy *= 32;
+  return entropy;
+}
+
+float* oldEntropyTexturePerPixel(const uint8_t *sample, size_t sample_size,
+                                 size_t texture_size, double point_size) {
+  auto bigtab = new float[texture_size];
+  memset(bigtab, 0, texture_size * sizeof(*bigtab));
+  minimap::forEachPoint(sample_size, texture_size, point_size,
+                        [sample, bigtab](size_t index, size_t begin,
+                                         size_t end) {
+    uint64_t counts[256] = {};
+    for (size_t i = begin; i < end; ++i) {
+      counts[sample[i]] += 1;
+    }
+    bigtab[index] = calculateEntropyValue(counts, end - begin);
+  });
+  return bigtab;
+}
+
+float* oldEntropyTextureSlidingWindow(const uint8_t *sample,
+                                      size_t sample_size, size_t texture_size,
+                                      double point_size) {
+  auto bigtab = new float[texture_size];
+  memset(bigtab, 0, texture_size * sizeof(*bigtab));
+  const size_t window = minimap::k_minimum_entropy_window + 1;
+  const size_t steps = sample_size + window;
+  auto windowStart = [window](size_t step) {
+    return step > window ? step - window : 0;
+  };
+  auto windowEnd = [sample_size](size_t step) {
+    return std::min(step, sample_size);
+  };
+  auto windowMid = [windowStart, windowEnd](size_t step) {
+    return (windowStart(step) + windowEnd(step)) / 2;
+  };
+  veles::util::threadpool::parallelFor(
+      "visualisation", 0, steps, minimap::k_parallel_grain,
+      [=](size_t begin, size_t end_step) {
+    uint64_t counts[256] = {};
+    size_t start = windowStart(begin), end = windowEnd(begin);
+    for (size_t i = start; i < end; ++i) {
+      counts[sample[i]] += 1;
+    }
+    for (size_t step = begin; step < end_step; ++step) {
+      size_t mid = (start + end) / 2;
+      if (mid > 0 && std::floor(mid / point_size) != std::floor((mid - 1) / point_size)
+          && (step + 1 == steps || windowMid(step + 1) != mid)) {
+        bigtab[static_cast<size_t>(mid / point_size)] = calculateEntropyValue(
+            counts, end - start);
+      }
+      if (end >= window || end >= sample_size) {
+        counts[sample[start++]] -= 1;
+      }
+      if (end < sample_size) {
+        counts[sample[end++]] += 1;
+      }
+    }
+  });
+  return bigtab;
+}
+
+/*****************************************************************************/
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+// Best time of k_rounds runs, in seconds.  Leaves the last texture in
+// *texture.
+double measure(TextureFunction function, const std::vector<uint8_t> &sample,
+               size_t texture_size, std::unique_ptr<float[]> *texture) {
+  double point_size = static_cast<double>(sample.size()) / texture_size;
+  double best = 0;
+  for (int round = 0; round < k_rounds; round++) {
+    auto start = std::chrono::steady_clock::now();
+    texture->reset(function(sample.data(), sample.size(), texture_size,
+                            point_size));
+    double time = secondsSince(start);
+    if (round == 0 || time < best) {
+      best = time;
+    }
+  }
+  return best;
+}
+
+void compare(const char *name, TextureFunction before, TextureFunction after,
+             const std::vector<uint8_t> &sample, size_t texture_size) {
+  std::unique_ptr<float[]> expected, result;
+  double before_time = measure(before, sample, texture_size, &expected);
+  double after_time = measure(after, sample, texture_size, &result);
+  float max_error = 0;
+  for (size_t i = 0; i < texture_size; i++) {
+    max_error = std::max(max_error, std::abs(expected[i] - result[i]));
+  }
+  double mib = static_cast<double>(sample.size()) / (1024 * 1024);
+  printf("%s (%zu points): %.1f MiB/s before, %.1f MiB/s after, "
+         "max difference %g\n", name, texture_size, mib / before_time,
+         mib / after_time, max_error);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  veles::util::threadpool::createTopic("visualisation");
+
+  printf("Creating a %zu MiB sample...\n", k_sample_size >> 20);
+  // Parts of differing entropy, from constant to random.
+  std::vector<uint8_t> sample(k_sample_size);
+  std::mt19937 generator(1);
+  for (size_t i = 0; i < k_sample_size; i++) {
+    int bits = static_cast<int>(i / (1024 * 1024)) % 9;
+    sample[i] = static_cast<uint8_t>(generator() & ((1 << bits) - 1));
+  }
+
+  compare("value", oldAverageValueTexture,
+          minimap::calculateAverageValueTexture, sample, 1000 * 200);
+  // A tall minimap - points much larger than the entropy window.
+  compare("entropy, per point", oldEntropyTexturePerPixel,
+          minimap::calculateEntropyTexturePerPixel, sample, 1000 * 200);
+  // Points smaller than the window.
+  compare("entropy, sliding window", oldEntropyTextureSlidingWindow,
+          minimap::calculateEntropyTextureSlidingWindow, sample,
+          k_sample_size / 64);
+
+  veles::util::threadpool::shutdown();
+  return 0;
+}
@@ -0,0 +1,1218 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include <zlib.h>
+
+#include "data/field.h"
+#include "db/handle.h"
+#include "db/object.h"
+#include "dbif/error.h"
+#include "dbif/info.h"
+#include "dbif/method.h"
+#include "dbif/promise.h"
+#include "dbif/universe.h"
+#include "network/connection.h"
+#include "util/analysis.h"
+#include "util/histogram_index.h"
+
+#include <QCryptographicHash>
+#include <QtEndian>
+#include <QtNetwork/QLocalSocket>
+#include <QtNetwork/QTcpSocket>
+
+#ifdef Q_OS_LINUX
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace veles {
+namespace db {
+
+namespace {
+
+bool compressData(const char *data, uint64_t length, std::string *result) {
+  uLongf result_len = compressBound(length);
+  result->resize(result_len);
+  if (compress2(reinterpret_cast<Bytef *>(&(*result)[0]), &result_len,
+                reinterpret_cast<const Bytef *>(data), length,
+                Z_BEST_SPEED) != Z_OK) {
+    return false;
+  }
+  result->resize(result_len);
+  return true;
+}
+
+// Responses are built in a block owned by the connection, so that resetting
+// the arena after each of them does not give the memory back.
+google::protobuf::ArenaOptions arenaOptions(std::vector<char> *initial_block) {
+  google::protobuf::ArenaOptions options;
+  options.initial_block = initial_block->data();
+  options.initial_block_size = initial_block->size();
+  return options;
+}
+
+// Object ids never change, so they can be read from any thread.
+uint64_t objectId(dbif::ObjectHandle obj) {
+  return obj.dynamicCast<LocalObjectHandle>()->obj()->id();
+}
+
+// Blob data is requested in whole elements - returns the octets [start, end)
+// out of data, which starts at the element containing octet start.  Less is
+// returned if the blob has shrunk in the meantime.
+std::pair<const char *, uint64_t> octetRange(const data::BinData &data,
+                                             uint64_t element_size,
+                                             uint64_t start, uint64_t end) {
+  uint64_t skip = start % element_size;
+  uint64_t available = data.octets() > skip ? data.octets() - skip : 0;
+  return std::make_pair(reinterpret_cast<const char *>(data.rawData()) + skip,
+                        std::min(end - start, available));
+}
+
+// Hash of a page of watched blob data.  It's only compared with earlier
+// hashes of the same page, so it just has to be quick and well mixed.
+uint64_t pageHash(const char *data, uint64_t length) {
+  const uint64_t k_multiplier = 0xff51afd7ed558ccdull;
+  uint64_t hash = length * 0x9e3779b97f4a7c15ull;
+  uint64_t i = 0;
+  for (; i + sizeof(uint64_t) <= length; i += sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    hash = (hash ^ word) * k_multiplier;
+    hash ^= hash >> 32;
+  }
+  for (; i < length; ++i) {
+    hash = (hash ^ static_cast<uint8_t>(data[i])) * k_multiplier;
+    hash ^= hash >> 32;
+  }
+  return hash;
+}
+
+// Converts straight into the message's own string, skipping the temporary
+// std::string of toStdString().  Empty strings are the default anyway.
+void setUtf8(std::string *(network::LocalObject::*field)(),
+             network::LocalObject *result, const QString &value) {
+  if (value.isEmpty()) {
+    return;
+  }
+  QByteArray utf8 = value.toUtf8();
+  (result->*field)()->assign(utf8.constData(), utf8.size());
+}
+
+// Stands in for a chunk of a BATCH request, so that other parts of the
+// batch can refer to it - the database never passes requests to it.
+class BatchPlaceholder : public dbif::ObjectHandleBase {
+ public:
+  dbif::InfoPromise *getInfo(dbif::PInfoRequest) override { return nullptr; }
+  dbif::InfoPromise *subInfo(dbif::PInfoRequest) override { return nullptr; }
+  dbif::MethodResultPromise *runMethod(dbif::PMethodRequest) override {
+    return nullptr;
+  }
+  dbif::ObjectType type() const override { return dbif::CHUNK; }
+};
+
+// Clients only give names and positions of fields, so they are untyped and
+// have no value.
+std::vector<data::ChunkDataItem> unpackFields(
+    const google::protobuf::RepeatedPtrField<network::ChunkDataItem> &items) {
+  data::RepackFormat repack{data::RepackEndian::LITTLE, 8, 0, 0};
+  data::FieldHighType high_type = data::FieldHighType();
+  high_type.mode = data::FieldHighType::NONE;
+  std::vector<data::ChunkDataItem> res;
+  for (auto &item : items) {
+    res.push_back(data::ChunkDataItem::field(
+        item.start(), item.end(), QString::fromStdString(item.name()), repack,
+        0, high_type, data::BinData()));
+  }
+  return res;
+}
+
+#ifdef Q_OS_LINUX
+// Sends data over a non-blocking Unix socket, with fd attached to its first
+// byte.  Returns how much was sent, or -1 with errno set (EAGAIN if the
+// socket is full).
+int64_t sendWithDescriptor(int socket, const char *data, uint64_t length,
+                           int fd) {
+  iovec iov;
+  iov.iov_base = const_cast<char *>(data);
+  iov.iov_len = length;
+  char control[CMSG_SPACE(sizeof(fd))];
+  memset(control, 0, sizeof(control));
+  msghdr msg;
+  memset(&msg, 0, sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control;
+  msg.msg_controllen = sizeof(control);
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(fd));
+  memcpy(CMSG_DATA(cmsg), &fd, sizeof(fd));
+  while (true) {
+    ssize_t sent = sendmsg(socket, &msg, MSG_NOSIGNAL);
+    if (sent >= 0 || errno != EINTR) {
+      return sent;
+    }
+  }
+}
+#endif
+
+void packItems(const std::vector<data::ChunkDataItem> &items,
+               network::LocalObject *result) {
+  for (auto &item : items) {
+    if (item.type != data::ChunkDataItem::FIELD) {
+      continue;
+    }
+    network::ChunkDataItem* packed_item = result->add_items();
+    packed_item->set_start(item.start);
+    packed_item->set_end(item.end);
+    if (!item.name.isEmpty()) {
+      QByteArray name = item.name.toUtf8();
+      packed_item->mutable_name()->assign(name.constData(), name.size());
+    }
+  }
+}
+
+}  // namespace
+
+NetworkConnection::NetworkConnection(dbif::ObjectHandle root,
+                                     qintptr socket_descriptor, bool local) :
+  root_(root), socket_descriptor_(socket_descriptor), local_(local),
+  socket_(nullptr),
+  data_stream_busy_(false), list_stream_busy_(false), write_notifier_(nullptr),
+  arena_block_(k_arena_block_size_), arena_(arenaOptions(&arena_block_)) {}
+
+NetworkConnection::~NetworkConnection() {
+#ifdef Q_OS_LINUX
+  for (auto &output : pending_output_) {
+    if (output.fd >= 0) {
+      close(output.fd);
+    }
+  }
+#endif
+}
+
+void NetworkConnection::start() {
+  if (local_) {
+    QLocalSocket *socket = new QLocalSocket(this);
+    socket_ = socket;
+    if (!socket->setSocketDescriptor(socket_descriptor_)) {
+      // TODO some error logging here
+      deleteLater();
+      return;
+    }
+    connect(socket, &QLocalSocket::disconnected, this, &QObject::deleteLater);
+  } else {
+    QTcpSocket *socket = new QTcpSocket(this);
+    socket_ = socket;
+    if (!socket->setSocketDescriptor(socket_descriptor_)) {
+      // TODO some error logging here
+      deleteLater();
+      return;
+    }
+    connect(socket, &QAbstractSocket::disconnected, this, &QObject::deleteLater);
+  }
+  connect(socket_, &QIODevice::readyRead, this, &NetworkConnection::readMessages);
+  connect(socket_, &QIODevice::bytesWritten,
+          this, &NetworkConnection::flushPendingOutput);
+}
+
+template<typename Request, typename... Args>
+void NetworkConnection::getInfo(
+    dbif::ObjectHandle obj,
+    std::function<void(QSharedPointer<typename Request::ReplyType>)> done,
+    ErrorHandler failed, Args... args) {
+  // Promises are children of the connection, so callbacks never outlive it.
+  dbif::InfoPromise *promise = obj->asyncGetInfo<Request>(this, args...);
+  connect(promise, &dbif::InfoPromise::gotInfo, [done] (dbif::PInfoReply reply) {
+    done(reply.dynamicCast<typename Request::ReplyType>());
+  });
+  connect(promise, &dbif::InfoPromise::gotError, failed);
+}
+
+template<typename Request, typename... Args>
+void NetworkConnection::runMethod(
+    dbif::ObjectHandle obj,
+    std::function<void(QSharedPointer<typename Request::ReplyType>)> done,
+    ErrorHandler failed, Args... args) {
+  dbif::MethodResultPromise *promise = obj->asyncRunMethod<Request>(this, args...);
+  connect(promise, &dbif::MethodResultPromise::gotResult, [done] (dbif::PMethodReply reply) {
+    done(reply.dynamicCast<typename Request::ReplyType>());
+  });
+  connect(promise, &dbif::MethodResultPromise::gotError, failed);
+}
+
+NetworkConnection::ErrorHandler NetworkConnection::failRequest(uint64_t request_id) {
+  return [this, request_id] (dbif::PError error) {
+    if (error.dynamicCast<dbif::ObjectGoneError>()) {
+      sendFailure(request_id, "Bad ID provided.");
+    } else if (error.dynamicCast<dbif::BlobDataInvalidRangeError>()) {
+      sendFailure(request_id, "Data range out of bounds.");
+    } else if (error.dynamicCast<dbif::InvalidTypeError>()) {
+      sendFailure(request_id, "Invalid object type.");
+    } else {
+      sendFailure(request_id, "Request failed.");
+    }
+  };
+}
+
+void NetworkConnection::readMessages() {
+  // Clients may pipeline requests, so handle every complete message that
+  // is already buffered, not just the first one.
+  while (true) {
+    uint32_t msg_len;
+    if (socket_->bytesAvailable() < static_cast<int32_t>(sizeof(msg_len))) {
+      return;
+    }
+
+    socket_->peek(reinterpret_cast<char*>(&msg_len), sizeof(msg_len));
+    msg_len = qFromLittleEndian(msg_len);
+    if (msg_len > k_max_msg_len_) {
+      sendFailure(0, "Request too long - breaking conection.");
+      socket_->close();
+      return;
+    }
+    if (socket_->bytesAvailable() <
+        static_cast<int64_t>(sizeof(msg_len)) + msg_len) {
+      return;
+    }
+    // We don't need it anymore, but we need to get rid of it either way.
+    socket_->read(reinterpret_cast<char*>(&msg_len), sizeof(msg_len));
+    if (read_buffer_.size() < msg_len) {
+      read_buffer_.resize(msg_len);
+    }
+    socket_->read(read_buffer_.data(), msg_len);
+    // Parsing into the same message reuses its already allocated fields,
+    // unless an earlier request still waits for the database with it.
+    if (!request_ || request_.use_count() > 1) {
+      request_ = std::make_shared<network::Request>();
+    }
+    if (!request_->ParseFromArray(read_buffer_.data(), msg_len)) {
+      sendFailure(0, "Failed to decode request.");
+      continue;
+    }
+    handleRequest(request_);
+  }
+}
+
+void NetworkConnection::handleRequest(const PRequest &req) {
+  if (req->type() == network::Request::UNSUBSCRIBE) {
+    unsubscribe(req);
+    return;
+  }
+
+  // Objects are looked up directly by id - either the one given in
+  // object_id or the last one of the id path, whose other ids have to be
+  // its ancestors.
+  uint64_t target_id = req->object_id();
+  std::vector<uint64_t> path;
+  if (!target_id && req->id_size() > 0) {
+    target_id = req->id(req->id_size() - 1);
+    path.assign(req->id().begin(), req->id().end());
+  }
+  if (!target_id) {
+    handleRequest(req, root_);
+    return;
+  }
+  getInfo<dbif::ObjectByIdRequest>(root_,
+      [this, req] (QSharedPointer<dbif::ObjectByIdReply> reply) {
+    handleRequest(req, reply->object);
+  }, failRequest(req->request_id()), target_id, path);
+}
+
+void NetworkConnection::handleRequest(const PRequest &req,
+                                      dbif::ObjectHandle target) {
+  switch (req->type()) {
+  case network::Request::LIST_CHILDREN:
+    listChildren(req, target);
+    break;
+  case network::Request::LIST_CHILDREN_RECURSIVE:
+    listChildrenRecursive(req, target);
+    break;
+  case network::Request::ADD_CHILD_CHUNK:
+    if (target->type() == dbif::FILE_BLOB) {
+      createChunk(req, target, dbif::ObjectHandle());
+    } else if (target->type() == dbif::CHUNK) {
+      getInfo<dbif::DescriptionRequest>(target,
+          [this, req, target] (QSharedPointer<dbif::DescriptionReply> reply) {
+        createChunk(req, reply.staticCast<dbif::ChunkDescriptionReply>()->blob,
+                    target);
+      }, failRequest(req->request_id()));
+    } else {
+      sendFailure(req->request_id(), "Bad ID provided.");
+    }
+    break;
+  case network::Request::DELETE_OBJECT:
+    deleteObject(req, target);
+    break;
+  case network::Request::GET_BLOB_DATA:
+    getBlobData(req, target);
+    break;
+  case network::Request::SUBSCRIBE:
+    if (req->subscription() == network::Request::BLOB_DATA &&
+        (target->type() == dbif::FILE_BLOB || target->type() == dbif::SUB_BLOB)) {
+      getInfo<dbif::DescriptionRequest>(target,
+          [this, req, target] (QSharedPointer<dbif::DescriptionReply> reply) {
+        auto description = reply.staticCast<dbif::BlobDescriptionReply>();
+        subscribe(req, target, (description->width + 7) / 8);
+      }, failRequest(req->request_id()));
+    } else {
+      subscribe(req, target, 1);
+    }
+    break;
+  case network::Request::BATCH:
+    applyBatch(req, target);
+    break;
+  case network::Request::FIND:
+  case network::Request::HISTOGRAM:
+  case network::Request::ENTROPY:
+  case network::Request::HASH:
+    analyzeBlob(req, target);
+    break;
+  default:
+    sendFailure(req->request_id(), "Unknown request type.");
+    break;
+  }
+}
+
+void NetworkConnection::listChildren(const PRequest &req,
+                                     dbif::ObjectHandle target) {
+  getInfo<dbif::SubtreeRequest>(target,
+      [this, req] (QSharedPointer<dbif::SubtreeReply> reply) {
+    network::Response *resp = newResponse(req->request_id());
+    for (auto &object : reply->objects) {
+      packObject(object, resp->add_results());
+    }
+    resp->set_ok(true);
+    sendResponse(resp);
+  }, failRequest(req->request_id()), false);
+}
+
+void NetworkConnection::listChildrenRecursive(const PRequest &req,
+                                              dbif::ObjectHandle target) {
+  if (!req->page_size() && !req->stream()) {
+    getInfo<dbif::SubtreeRequest>(target,
+        [this, req] (QSharedPointer<dbif::SubtreeReply> reply) {
+      network::Response *resp = newResponse(req->request_id());
+      // Rebuild the nesting from the flattened pre-order listing.
+      std::vector<std::pair<uint64_t, network::LocalObject *>> path;
+      for (auto &object : reply->objects) {
+        while (!path.empty() && path.back().first != object.parent_id) {
+          path.pop_back();
+        }
+        network::LocalObject *result = path.empty() ?
+          resp->add_results() : path.back().second->add_children();
+        packObject(object, result, req->skip_comments());
+        path.push_back(std::make_pair(object.id, result));
+      }
+      resp->set_ok(true);
+      sendResponse(resp);
+    }, failRequest(req->request_id()), true, std::vector<uint64_t>(),
+    uint64_t(0), !req->skip_items());
+    return;
+  }
+
+  uint64_t page_size = req->page_size();
+  if (!page_size) {
+    page_size = k_default_page_size_;
+  } else if (page_size > k_max_page_size_) {
+    page_size = k_max_page_size_;
+  }
+  ListStream stream{req->request_id(), target,
+                    std::vector<uint64_t>(req->cursor().begin(), req->cursor().end()),
+                    page_size, req->skip_comments(), req->skip_items()};
+  if (req->stream()) {
+    list_streams_.enqueue(stream);
+    pumpStreams();
+    return;
+  }
+  listPage(stream, [this] (network::Response *resp,
+                           const std::vector<uint64_t> &) {
+    sendResponse(resp);
+  }, failRequest(req->request_id()));
+}
+
+void NetworkConnection::listPage(
+    const ListStream &stream,
+    std::function<void(network::Response *, const std::vector<uint64_t> &)> done,
+    ErrorHandler failed) {
+  uint64_t request_id = stream.request_id;
+  bool skip_comments = stream.skip_comments;
+  getInfo<dbif::SubtreeRequest>(stream.root,
+      [this, request_id, skip_comments, done] (QSharedPointer<dbif::SubtreeReply> reply) {
+    network::Response *resp = newResponse(request_id);
+    for (auto &object : reply->objects) {
+      network::LocalObject *result = resp->add_results();
+      packObject(object, result, skip_comments);
+      result->set_parent_id(object.parent_id);
+    }
+    for (auto id : reply->cursor) {
+      resp->add_cursor(id);
+    }
+    resp->set_ok(true);
+    done(resp, reply->cursor);
+  }, failed, true, stream.cursor, stream.page_size, !stream.skip_items);
+}
+
+void NetworkConnection::createChunk(const PRequest &req,
+                                    dbif::ObjectHandle blob,
+                                    dbif::ObjectHandle parent_chunk) {
+  auto respond = [this, req] (dbif::ObjectHandle created) {
+    network::Response *resp = newResponse(req->request_id());
+    network::LocalObject *result = resp->add_results();
+    result->set_id(objectId(created));
+    result->set_name(req->name());
+    result->set_comment(req->comment());
+    result->set_type(dbif::CHUNK);
+    result->set_chunk_start(req->chunk_start());
+    result->set_chunk_end(req->chunk_end());
+    result->set_chunk_type(req->chunk_type());
+    resp->set_ok(true);
+    sendResponse(resp);
+  };
+  runMethod<dbif::ChunkCreateRequest>(blob,
+      [this, req, respond] (QSharedPointer<dbif::CreatedReply> reply) {
+    dbif::ObjectHandle created = reply->object;
+    if (req->comment().empty()) {
+      respond(created);
+      return;
+    }
+    runMethod<dbif::SetCommentRequest>(created,
+        [respond, created] (QSharedPointer<dbif::NullReply>) {
+      respond(created);
+    }, failRequest(req->request_id()), QString::fromStdString(req->comment()));
+  }, failRequest(req->request_id()),
+  QString::fromStdString(req->name()), QString::fromStdString(req->chunk_type()),
+  parent_chunk, req->chunk_start(), req->chunk_end());
+}
+
+void NetworkConnection::deleteObject(const PRequest &req,
+                                     dbif::ObjectHandle target) {
+  if (target->type() == dbif::ROOT || target->type() == dbif::FILE_BLOB) {
+    sendFailure(req->request_id(), "Unsupported object type to delete.");
+    return;
+  }
+  uint64_t request_id = req->request_id();
+  runMethod<dbif::DeleteRequest>(target,
+      [this, request_id] (QSharedPointer<dbif::NullReply>) {
+    network::Response *resp = newResponse(request_id);
+    resp->set_ok(true);
+    sendResponse(resp);
+  }, failRequest(request_id));
+}
+
+void NetworkConnection::applyBatch(const PRequest &req,
+                                   dbif::ObjectHandle blob) {
+  if (blob->type() != dbif::FILE_BLOB && blob->type() != dbif::SUB_BLOB) {
+    sendFailure(req->request_id(), "Unsupported object type for a batch.");
+    return;
+  }
+  // All existing objects the batch refers to are looked up at once, in the
+  // order they are used below.
+  std::vector<uint64_t> ids(req->batch_delete().begin(), req->batch_delete().end());
+  for (int i = 0; i < req->batch_create_size(); i++) {
+    const network::BatchChunk &chunk = req->batch_create(i);
+    if (chunk.parent_index() > static_cast<uint64_t>(i)) {
+      sendFailure(req->request_id(), "Invalid parent index.");
+      return;
+    }
+    if (!chunk.parent_index() && chunk.parent_id()) {
+      ids.push_back(chunk.parent_id());
+    }
+  }
+  for (auto &fields : req->batch_fields()) {
+    if (fields.chunk_index() > static_cast<uint64_t>(req->batch_create_size())) {
+      sendFailure(req->request_id(), "Invalid chunk index.");
+      return;
+    }
+    if (!fields.chunk_index()) {
+      ids.push_back(fields.chunk_id());
+    }
+  }
+
+  uint64_t request_id = req->request_id();
+  getInfo<dbif::ObjectsByIdRequest>(root_,
+      [this, req, blob, request_id] (QSharedPointer<dbif::ObjectsByIdReply> reply) {
+    auto next = reply->objects.begin();
+    std::vector<dbif::ObjectHandle> deleted(next, next + req->batch_delete_size());
+    next += req->batch_delete_size();
+    std::vector<dbif::ChunkTreeNode> chunks;
+    for (auto &chunk : req->batch_create()) {
+      dbif::ObjectHandle parent;
+      if (chunk.parent_index()) {
+        parent = chunks[chunk.parent_index() - 1].placeholder;
+      } else if (chunk.parent_id()) {
+        parent = *next++;
+      }
+      chunks.push_back(dbif::ChunkTreeNode{
+          QSharedPointer<BatchPlaceholder>::create(), parent,
+          QString::fromStdString(chunk.name()),
+          QString::fromStdString(chunk.chunk_type()),
+          chunk.chunk_start(), chunk.chunk_end(), unpackFields(chunk.items())});
+    }
+    std::vector<dbif::ChunkFieldsUpdate> updates;
+    for (auto &fields : req->batch_fields()) {
+      dbif::ObjectHandle chunk = fields.chunk_index() ?
+          chunks[fields.chunk_index() - 1].placeholder : *next++;
+      updates.push_back(dbif::ChunkFieldsUpdate{chunk, unpackFields(fields.items())});
+    }
+    runMethod<dbif::ChunkTreeEditRequest>(blob,
+        [this, request_id] (QSharedPointer<dbif::ChunkTreeCreatedReply> reply) {
+      network::Response *resp = newResponse(request_id);
+      for (auto &chunk : reply->chunks) {
+        resp->add_new_ids(objectId(chunk));
+      }
+      resp->set_ok(true);
+      sendResponse(resp);
+    }, failRequest(request_id), chunks, std::vector<dbif::SubBlobTreeNode>(),
+    updates, deleted);
+  }, failRequest(request_id), ids);
+}
+
+void NetworkConnection::getBlobData(const PRequest &req,
+                                    dbif::ObjectHandle target) {
+  if (target->type() != dbif::FILE_BLOB && target->type() != dbif::SUB_BLOB) {
+    sendFailure(req->request_id(), "Unsupported object type to get file data.");
+    return;
+  }
+  getInfo<dbif::DescriptionRequest>(target,
+      [this, req, target] (QSharedPointer<dbif::DescriptionReply> reply) {
+    auto description = reply.staticCast<dbif::BlobDescriptionReply>();
+    uint64_t element_size = (description->width + 7) / 8;
+    uint64_t size = description->size * element_size;
+    uint64_t start = req->data_offset();
+    if (start > size) {
+      sendFailure(req->request_id(), "Data offset out of range.");
+      return;
+    }
+    uint64_t end = size;
+    if (req->data_length() && req->data_length() < size - start) {
+      end = start + req->data_length();
+    }
+
+    if (req->shared_memory()) {
+      // The blob keeps its data in shared memory until it changes, so this
+      // only copies it on the first request after a change.
+      getInfo<dbif::BlobSharedDataRequest>(target,
+          [this, req, start, end] (QSharedPointer<dbif::BlobSharedDataReply> reply) {
+        sendSharedData(req->request_id(), reply->memory, start, end - start);
+      }, failRequest(req->request_id()));
+      return;
+    }
+    if (req->data_part_size()) {
+      uint64_t part_size = req->data_part_size();
+      if (part_size > k_max_part_size_) {
+        part_size = k_max_part_size_;
+      }
+      data_streams_.enqueue(DataStream{req->request_id(), target, element_size,
+                                       start, start, end, part_size,
+                                       req->compress()});
+      pumpStreams();
+      return;
+    }
+    // A single raw message is buffered whole, and its length has to fit in
+    // the prefix - larger ranges have to be streamed.
+    if (end - start > k_max_msg_len_) {
+      sendFailure(req->request_id(),
+                  "Data range too large - use data_part_size to stream it.");
+      return;
+    }
+
+    getInfo<dbif::BlobDataRequest>(target,
+        [this, req, element_size, start, end] (QSharedPointer<dbif::BlobDataReply> reply) {
+      auto range = octetRange(reply->data, element_size, start, end);
+      const char *data = range.first;
+      uint64_t length = range.second;
+      uint64_t data_size = length;
+      std::string compressed;
+      if (req->compress()) {
+        if (!compressData(data, length, &compressed)) {
+          sendFailure(req->request_id(), "Failed to compress data.");
+          return;
+        }
+        data = compressed.data();
+        length = compressed.size();
+      }
+      network::Response *resp = newResponse(req->request_id());
+      resp->set_ok(true);
+      resp->set_data_size(data_size);
+      resp->set_compressed(req->compress());
+      sendResponse(resp);
+      sendData(data, length);
+    }, failRequest(req->request_id()),
+    start / element_size, (end + element_size - 1) / element_size);
+  }, failRequest(req->request_id()));
+}
+
+void NetworkConnection::analyzeBlob(const PRequest &req,
+                                    dbif::ObjectHandle target) {
+  if (target->type() != dbif::FILE_BLOB && target->type() != dbif::SUB_BLOB) {
+    sendFailure(req->request_id(), "Unsupported object type to analyze.");
+    return;
+  }
+  if (req->type() == network::Request::FIND && req->pattern().empty()) {
+    sendFailure(req->request_id(), "Empty pattern.");
+    return;
+  }
+  getInfo<dbif::DescriptionRequest>(target,
+      [this, req, target] (QSharedPointer<dbif::DescriptionReply> reply) {
+    auto description = reply.staticCast<dbif::BlobDescriptionReply>();
+    uint64_t element_size = (description->width + 7) / 8;
+    uint64_t size = description->size * element_size;
+    uint64_t start = req->data_offset();
+    if (start > size) {
+      sendFailure(req->request_id(), "Data offset out of range.");
+      return;
+    }
+    uint64_t end = size;
+    if (req->data_length() && req->data_length() < size - start) {
+      end = start + req->data_length();
+    }
+    // The default window grows with the data, so that the series fits in a
+    // response.
+    uint64_t window_size = req->window_size();
+    if (!window_size) {
+      window_size = std::max(uint64_t(k_default_window_size_),
+                             (end - start) / k_max_entropy_values_ + 1);
+    }
+    if (req->type() == network::Request::ENTROPY &&
+        (end - start + window_size - 1) / window_size > k_max_entropy_values_) {
+      sendFailure(req->request_id(), "Window size too small for the data.");
+      return;
+    }
+    bool histogram_index = req->type() == network::Request::HISTOGRAM ||
+        req->type() == network::Request::ENTROPY;
+    getInfo<dbif::BlobSnapshotRequest>(target,
+        [this, req, start, end, window_size] (QSharedPointer<dbif::BlobSnapshotReply> reply) {
+      // The snapshot stays as it is while the database carries on, so the
+      // work is done in place, on this thread and the analysis workers.
+      const data::BinData &snapshot = *reply->data;
+      // The blob may have shrunk since the description.
+      uint64_t available = std::min(end, uint64_t(snapshot.octets()));
+      uint64_t length = available > start ? available - start : 0;
+      const uint8_t *data = snapshot.rawData() + (length ? start : 0);
+      // The index is of the same snapshot.  Until it's built, queries would
+      // scan the data single-threaded.
+      auto index = reply->histogram_index;
+      if (index && (!index->built() || length == 0)) {
+        index.reset();
+      }
+      network::Response *resp = newResponse(req->request_id());
+      resp->set_ok(true);
+      switch (req->type()) {
+      case network::Request::FIND: {
+        uint64_t max_hits = req->max_hits();
+        if (!max_hits || max_hits > k_max_hits_) {
+          max_hits = k_max_hits_;
+        }
+        // Look for one more to know if there are more.
+        auto hits = util::analysis::parallelFindAll(
+            "analysis", data, length,
+            reinterpret_cast<const uint8_t *>(req->pattern().data()),
+            req->pattern().size(), max_hits + 1);
+        resp->set_more_hits(hits.size() > max_hits);
+        hits.resize(std::min<uint64_t>(hits.size(), max_hits));
+        for (auto hit : hits) {
+          resp->add_hits(start + hit);
+        }
+        break;
+      }
+      case network::Request::HISTOGRAM: {
+        util::analysis::ByteHistogram counts;
+        if (index) {
+          counts = index->histogram(start, start + length);
+        } else {
+          counts = util::analysis::parallelByteHistogram("analysis", data,
+                                                         length);
+        }
+        for (auto count : counts) {
+          resp->add_histogram(count);
+        }
+        break;
+      }
+      case network::Request::ENTROPY: {
+        // The index reads windows smaller than a leaf from the data anyway.
+        if (index && window_size >= util::HistogramIndex::k_leaf_size) {
+          for (uint64_t pos = 0; pos < length; pos += window_size) {
+            uint64_t window_end = std::min(length, pos + window_size);
+            resp->add_entropy(index->entropy(start + pos, start + window_end));
+          }
+          break;
+        }
+        for (auto value : util::analysis::parallelEntropySeries(
+                 "analysis", data, length, window_size)) {
+          resp->add_entropy(value);
+        }
+        break;
+      }
+      default: {
+        QCryptographicHash::Algorithm algorithm = QCryptographicHash::Sha256;
+        if (req->hash_algorithm() == network::Request::SHA1) {
+          algorithm = QCryptographicHash::Sha1;
+        } else if (req->hash_algorithm() == network::Request::MD5) {
+          algorithm = QCryptographicHash::Md5;
+        }
+        // The digests are sequential by definition, so unlike the rest this
+        // stays a single pass (over the snapshot, not a copy).
+        QCryptographicHash hash(algorithm);
+        // addData takes an int length.
+        for (uint64_t pos = 0; pos < length; pos += k_max_part_size_) {
+          uint64_t part = length - pos;
+          if (part > k_max_part_size_) {
+            part = k_max_part_size_;
+          }
+          hash.addData(reinterpret_cast<const char *>(data) + pos,
+                       static_cast<int>(part));
+        }
+        QByteArray digest = hash.result();
+        resp->set_hash(digest.constData(), digest.size());
+        break;
+      }
+      }
+      sendResponse(resp);
+    }, failRequest(req->request_id()), histogram_index);
+  }, failRequest(req->request_id()));
+}
+
+void NetworkConnection::subscribe(const PRequest &req,
+                                  dbif::ObjectHandle target,
+                                  uint64_t element_size) {
+  uint64_t subscription_id = req->request_id();
+  if (subscriptions_.contains(subscription_id)) {
+    sendFailure(subscription_id, "Subscription id already in use.");
+    return;
+  }
+  Subscription subscription{nullptr, objectId(target), 0,
+                            std::vector<uint64_t>()};
+  dbif::PInfoRequest info_req;
+  switch (req->subscription()) {
+  case network::Request::CHILDREN:
+    info_req = QSharedPointer<dbif::ChildrenRequest>::create();
+    break;
+  case network::Request::DESCRIPTION:
+    info_req = QSharedPointer<dbif::DescriptionRequest>::create();
+    break;
+  case network::Request::CHUNK_DATA:
+    if (target->type() != dbif::CHUNK) {
+      sendFailure(subscription_id, "Unsupported object type to watch chunk data.");
+      return;
+    }
+    info_req = QSharedPointer<dbif::ChunkDataRequest>::create();
+    break;
+  case network::Request::BLOB_DATA: {
+    if (target->type() != dbif::FILE_BLOB &&
+        target->type() != dbif::SUB_BLOB) {
+      sendFailure(subscription_id, "Unsupported object type to watch blob data.");
+      return;
+    }
+    // The db watches whole elements - round the octet range out to them.
+    uint64_t start = req->data_offset() / element_size;
+    uint64_t end = UINT64_MAX;
+    if (req->data_length()) {
+      end = (req->data_offset() + req->data_length() + element_size - 1) /
+            element_size;
+    }
+    subscription.data_offset = start * element_size;
+    info_req = QSharedPointer<dbif::BlobDataRequest>::create(start, end);
+    break;
+  }
+  default:
+    sendFailure(subscription_id, "Unknown subscription type.");
+    return;
+  }
+
+  subscription.promise = target->subInfo(info_req);
+  subscription.promise->setParent(this);
+  connect(subscription.promise, &dbif::InfoPromise::gotInfo,
+          [this, subscription_id] (dbif::PInfoReply reply) {
+    sendEvent(subscription_id, reply);
+  });
+  connect(subscription.promise, &dbif::InfoPromise::gotError,
+          [this, subscription_id] (dbif::PError error) {
+    // The promise is gone after an error, so is the subscription.
+    subscriptions_.remove(subscription_id);
+    network::Response *resp = newResponse(subscription_id);
+    resp->set_ok(false);
+    if (error.dynamicCast<dbif::ObjectGoneError>()) {
+      resp->set_error_msg("Object deleted.");
+    } else {
+      resp->set_error_msg("Subscription failed.");
+    }
+    resp->set_last_part(true);
+    sendResponse(resp);
+  });
+  subscriptions_.insert(subscription_id, subscription);
+}
+
+void NetworkConnection::unsubscribe(const PRequest &req) {
+  if (!subscriptions_.contains(req->subscription_id())) {
+    sendFailure(req->request_id(), "Unknown subscription id.");
+    return;
+  }
+  delete subscriptions_.take(req->subscription_id()).promise;
+  // Close the stream of events before acknowledging.
+  network::Response *last_event = newResponse(req->subscription_id());
+  last_event->set_ok(true);
+  last_event->set_last_part(true);
+  sendResponse(last_event);
+
+  network::Response *resp = newResponse(req->request_id());
+  resp->set_ok(true);
+  sendResponse(resp);
+}
+
+void NetworkConnection::sendEvent(uint64_t subscription_id,
+                                  dbif::PInfoReply reply) {
+  auto iter = subscriptions_.find(subscription_id);
+  if (iter == subscriptions_.end()) {
+    return;
+  }
+  Subscription &subscription = iter.value();
+  if (auto data_reply = reply.dynamicCast<dbif::BlobDataReply>()) {
+    sendDataChanges(subscription_id, &subscription, data_reply->data);
+    return;
+  }
+  network::Response *resp = newResponse(subscription_id);
+  resp->set_ok(true);
+  if (auto children_reply = reply.dynamicCast<dbif::ChildrenReply>()) {
+    // Only ids and types - the client can list the ones it is interested in.
+    for (auto &child : children_reply->objects) {
+      network::LocalObject *result = resp->add_results();
+      result->set_id(objectId(child));
+      result->set_type(child->type());
+    }
+  } else if (auto parse_reply = reply.dynamicCast<dbif::ChunkDataReply>()) {
+    network::LocalObject *result = resp->add_results();
+    result->set_id(subscription.object_id);
+    result->set_type(dbif::CHUNK);
+    packItems(parse_reply->items, result);
+  } else if (auto description = reply.dynamicCast<dbif::DescriptionReply>()) {
+    network::LocalObject *result = resp->add_results();
+    result->set_id(subscription.object_id);
+    result->set_name(description->name.toStdString());
+    result->set_comment(description->comment.toStdString());
+    if (auto chunk = description.dynamicCast<dbif::ChunkDescriptionReply>()) {
+      result->set_type(dbif::CHUNK);
+      result->set_chunk_start(chunk->start);
+      result->set_chunk_end(chunk->end);
+      result->set_chunk_type(chunk->chunk_type.toStdString());
+    } else if (auto file = description.dynamicCast<dbif::FileBlobDescriptionReply>()) {
+      result->set_type(dbif::FILE_BLOB);
+      result->set_file_blob_path(file->path.toStdString());
+    } else if (description.dynamicCast<dbif::SubBlobDescriptionReply>()) {
+      result->set_type(dbif::SUB_BLOB);
+    }
+  }
+  sendResponse(resp);
+}
+
+void NetworkConnection::sendDataChanges(uint64_t subscription_id,
+                                        Subscription *subscription,
+                                        const data::BinData &new_data) {
+  // Only the pages that changed since the last event are sent, in runs of
+  // at most k_max_part_size_, so neither the client's copy of the data nor
+  // a large change has to be held here.
+  const char *data = reinterpret_cast<const char *>(new_data.rawData());
+  uint64_t size = new_data.octets();
+  uint64_t pages = (size + k_subscription_page_size_ - 1) /
+                   k_subscription_page_size_;
+  std::vector<uint64_t> hashes(pages);
+  for (uint64_t page = 0; page < pages; ++page) {
+    uint64_t start = page * k_subscription_page_size_;
+    hashes[page] = pageHash(data + start, std::min(
+        size - start, uint64_t(k_subscription_page_size_)));
+  }
+  const std::vector<uint64_t> &old_hashes = subscription->page_hashes;
+  auto changed = [&hashes, &old_hashes] (uint64_t page) {
+    return page >= old_hashes.size() || old_hashes[page] != hashes[page];
+  };
+  bool sent = false;
+  uint64_t page = 0;
+  while (page < pages || !sent) {
+    if (page < pages && !changed(page)) {
+      ++page;
+      continue;
+    }
+    // With nothing changed, an empty event still tells the current size.
+    uint64_t start = std::min(size, page * k_subscription_page_size_);
+    uint64_t end = start;
+    while (page < pages && changed(page) && end - start < k_max_part_size_) {
+      ++page;
+      end = std::min(size, page * k_subscription_page_size_);
+    }
+    network::Response *resp = newResponse(subscription_id);
+    resp->set_ok(true);
+    resp->set_data(data + start, end - start);
+    resp->set_data_offset(subscription->data_offset + start);
+    resp->set_data_size(size);
+    sendResponse(resp);
+    sent = true;
+  }
+  subscription->page_hashes.swap(hashes);
+}
+
+void NetworkConnection::pumpStreams() {
+  pumpDataStream();
+  pumpListStream();
+}
+
+void NetworkConnection::pumpDataStream() {
+  if (data_stream_busy_ || data_streams_.isEmpty() ||
+      !pending_output_.isEmpty() ||
+      socket_->bytesToWrite() >= k_max_buffered_) {
+    return;
+  }
+  data_stream_busy_ = true;
+  const DataStream &stream = data_streams_.head();
+  uint64_t request_id = stream.request_id;
+  uint64_t part_end = std::min(stream.end, stream.pos + stream.part_size);
+  getInfo<dbif::BlobDataRequest>(stream.blob,
+      [this, part_end] (QSharedPointer<dbif::BlobDataReply> reply) {
+    data_stream_busy_ = false;
+    DataStream &stream = data_streams_.head();
+    auto part = octetRange(reply->data, stream.element_size, stream.pos, part_end);
+    network::Response *resp = newResponse(stream.request_id);
+    if (stream.compress) {
+      if (!compressData(part.first, part.second, resp->mutable_data())) {
+        sendFailure(stream.request_id, "Failed to compress data.");
+        data_streams_.dequeue();
+        pumpStreams();
+        return;
+      }
+    } else {
+      resp->set_data(part.first, part.second);
+    }
+    // The data may have shrunk since the request was made.
+    bool last = part_end == stream.end || stream.pos + part.second < part_end;
+    resp->set_ok(true);
+    resp->set_data_size(stream.end - stream.start);
+    resp->set_compressed(stream.compress);
+    resp->set_data_offset(stream.pos);
+    resp->set_last_part(last);
+    sendResponse(resp);
+    stream.pos = part_end;
+    if (last) {
+      data_streams_.dequeue();
+    }
+    pumpStreams();
+  }, [this, request_id] (dbif::PError error) {
+    data_stream_busy_ = false;
+    data_streams_.dequeue();
+    failRequest(request_id)(error);
+    pumpStreams();
+  }, stream.pos / stream.element_size,
+  (part_end + stream.element_size - 1) / stream.element_size);
+}
+
+void NetworkConnection::pumpListStream() {
+  if (list_stream_busy_ || list_streams_.isEmpty() ||
+      !pending_output_.isEmpty() ||
+      socket_->bytesToWrite() >= k_max_buffered_) {
+    return;
+  }
+  list_stream_busy_ = true;
+  uint64_t request_id = list_streams_.head().request_id;
+  listPage(list_streams_.head(), [this] (network::Response *resp,
+                                         const std::vector<uint64_t> &cursor) {
+    list_stream_busy_ = false;
+    resp->set_last_part(cursor.empty());
+    sendResponse(resp);
+    if (cursor.empty()) {
+      list_streams_.dequeue();
+    } else {
+      list_streams_.head().cursor = cursor;
+    }
+    pumpStreams();
+  }, [this, request_id] (dbif::PError error) {
+    list_stream_busy_ = false;
+    list_streams_.dequeue();
+    failRequest(request_id)(error);
+    pumpStreams();
+  });
+}
+
+void NetworkConnection::sendFailure(uint64_t request_id,
+                                    const std::string &error_msg) {
+  network::Response *resp = newResponse(request_id);
+  resp->set_ok(false);
+  resp->set_error_msg(error_msg);
+  sendResponse(resp);
+}
+
+network::Response *NetworkConnection::newResponse(uint64_t request_id) {
+  network::Response *resp =
+      google::protobuf::Arena::CreateMessage<network::Response>(&arena_);
+  resp->set_request_id(request_id);
+  return resp;
+}
+
+void NetworkConnection::serializeResponse(network::Response *resp) {
+  // The length prefix and the message go out in a single write, serialized
+  // into a buffer that is kept around for the next response.
+  uint32_t resp_len = resp->ByteSize();
+  write_buffer_.resize(sizeof(resp_len) + resp_len);
+  qToLittleEndian(resp_len, reinterpret_cast<uchar *>(&write_buffer_[0]));
+  resp->SerializeWithCachedSizesToArray(
+      reinterpret_cast<google::protobuf::uint8 *>(&write_buffer_[sizeof(resp_len)]));
+}
+
+void NetworkConnection::sendResponse(network::Response *resp) {
+  serializeResponse(resp);
+  writeAll(&write_buffer_[0], write_buffer_.size());
+  // Every response is sent as soon as it is built, so nothing refers to
+  // the arena anymore.
+  arena_.Reset();
+}
+
+void NetworkConnection::sendSharedData(
+    uint64_t request_id, const std::shared_ptr<const data::SealedMemory> &memory,
+    uint64_t offset, uint64_t length) {
+  if (!local_) {
+    sendFailure(request_id, "Shared memory needs a local connection.");
+    return;
+  }
+#ifdef Q_OS_LINUX
+  // The memory can go away once the data changes, but the client's copy of
+  // the descriptor keeps it alive.
+  int fd = fcntl(memory->fd(), F_DUPFD_CLOEXEC, 0);
+  if (fd < 0) {
+    sendFailure(request_id, "Failed to share memory.");
+    return;
+  }
+  network::Response *resp = newResponse(request_id);
+  resp->set_ok(true);
+  resp->set_data_size(length);
+  resp->set_data_offset(offset);
+  resp->set_shared_memory(true);
+  serializeResponse(resp);
+  arena_.Reset();
+  // The descriptor goes with the first byte of the response, so everything
+  // before it has to leave Qt's buffer first.  Waiting for that would stall
+  // every other connection on this thread, so the response is queued, and
+  // so is all later output until it is sent.
+  pending_output_.enqueue(PendingOutput{
+      std::string(write_buffer_.data(), write_buffer_.size()), fd});
+  flushPendingOutput();
+#else
+  Q_UNUSED(memory);
+  Q_UNUSED(offset);
+  Q_UNUSED(length);
+  sendFailure(request_id, "Shared memory is not supported on this platform.");
+#endif
+}
+
+void NetworkConnection::flushPendingOutput() {
+  while (!pending_output_.isEmpty()) {
+    PendingOutput &output = pending_output_.head();
+    if (output.fd < 0) {
+      socket_->write(output.data.data(), output.data.size());
+      pending_output_.dequeue();
+      continue;
+    }
+#ifdef Q_OS_LINUX
+    if (socket_->bytesToWrite() > 0) {
+      // Called again on bytesWritten.
+      if (write_notifier_ != nullptr) {
+        write_notifier_->setEnabled(false);
+      }
+      return;
+    }
+    int socket = static_cast<QLocalSocket *>(socket_)->socketDescriptor();
+    int64_t sent = sendWithDescriptor(socket, output.data.data(),
+                                      output.data.size(), output.fd);
+    if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      if (write_notifier_ == nullptr) {
+        write_notifier_ = new QSocketNotifier(socket, QSocketNotifier::Write,
+                                              this);
+        // activated is overloaded in newer Qt versions.
+        connect(write_notifier_, SIGNAL(activated(int)),
+                this, SLOT(flushPendingOutput()));
+      }
+      write_notifier_->setEnabled(true);
+      return;
+    }
+    close(output.fd);
+    output.fd = -1;
+    if (sent < 0) {
+      // TODO log some error message here
+      static_cast<QLocalSocket *>(socket_)->abort();
+      return;
+    }
+    output.data.erase(0, sent);
+#endif
+  }
+  if (write_notifier_ != nullptr) {
+    write_notifier_->setEnabled(false);
+  }
+  pumpStreams();
+}
+
+void NetworkConnection::sendData(const char *data, uint64_t length) {
+  uint32_t len = qToLittleEndian(static_cast<uint32_t>(length));
+  writeAll(reinterpret_cast<const char *>(&len), sizeof(len));
+  writeAll(data, length);
+}
+
+void NetworkConnection::writeAll(const char *data, uint64_t length) {
+  if (!pending_output_.isEmpty()) {
+    if (pending_output_.back().fd >= 0) {
+      pending_output_.enqueue(PendingOutput{std::string(), -1});
+    }
+    pending_output_.back().data.append(data, length);
+    return;
+  }
+  uint64_t total_written = 0;
+  while (total_written < length) {
+    int64_t written = socket_->write(data + total_written,
+                                     length - total_written);
+    if (written == -1) {
+      // TODO log some error message here
+      return;
+    }
+    total_written += written;
+  }
+}
+
+void NetworkConnection::packObject(const dbif::ObjectSnapshot &object,
+                                   network::LocalObject *result,
+                                   bool skip_comments) {
+  result->set_id(object.id);
+  setUtf8(&network::LocalObject::mutable_name, result, object.name);
+  if (!skip_comments) {
+    setUtf8(&network::LocalObject::mutable_comment, result, object.comment);
+  }
+  result->set_type(object.type);
+
+  if (object.type == dbif::FILE_BLOB) {
+    setUtf8(&network::LocalObject::mutable_file_blob_path, result, object.path);
+  } else if (object.type == dbif::CHUNK) {
+    result->set_chunk_start(object.start);
+    result->set_chunk_end(object.end);
+    setUtf8(&network::LocalObject::mutable_chunk_type, result,
+            object.chunk_type);
+    packItems(object.items, result);
+  }
+}
+
+}  // namespace db
+}  // namespace veles
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <QCoreApplication>
+#include <QThread>
+#include <QtEndian>
+#include <QtNetwork/QTcpSocket>
+
+#include "db/db.h"
+#include "db/handle.h"
+#include "db/object.h"
+#include "dbif/method.h"
+#include "dbif/universe.h"
+#include "network.pb.h"
+#include "network/server.h"
+
+// Measures how fast NetworkServer answers a client on the loopback
+// interface: small pipelined requests, a streamed recursive listing and
+// a streamed blob download.
+
+namespace {
+
+const uint64_t k_blob_size = 64 * 1024 * 1024;
+const uint64_t k_chunk_count = 100000;
+const int k_small_requests = 20000;
+const int k_pipeline_depth = 64;
+const int k_rounds = 5;
+
+uint64_t objectId(veles::dbif::ObjectHandle obj) {
+  return obj.dynamicCast<veles::db::LocalObjectHandle>()->obj()->id();
+}
+
+bool sendRequest(QTcpSocket *socket, const veles::network::Request &req) {
+  std::string msg = req.SerializeAsString();
+  uint32_t len = qToLittleEndian(static_cast<uint32_t>(msg.size()));
+  msg.insert(0, reinterpret_cast<const char *>(&len), sizeof(len));
+  return socket->write(msg.data(), msg.size()) == static_cast<int64_t>(msg.size());
+}
+
+bool waitForBytes(QTcpSocket *socket, int64_t count) {
+  while (socket->bytesAvailable() < count) {
+    if (!socket->waitForReadyRead(30000)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool readResponse(QTcpSocket *socket, std::vector<char> *buffer,
+                  veles::network::Response *resp) {
+  uint32_t len;
+  if (!waitForBytes(socket, sizeof(len))) {
+    return false;
+  }
+  socket->read(reinterpret_cast<char *>(&len), sizeof(len));
+  len = qFromLittleEndian(len);
+  if (!waitForBytes(socket, len)) {
+    return false;
+  }
+  buffer->resize(len);
+  socket->read(buffer->data(), len);
+  return resp->ParseFromArray(buffer->data(), len) && resp->ok();
+}
+
+double secondsSince(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  QCoreApplication app(argc, argv);
+  veles::dbif::ObjectHandle root = veles::db::create_db();
+
+  printf("Creating a %llu MiB blob with %llu chunks...\n",
+         static_cast<unsigned long long>(k_blob_size >> 20),
+         static_cast<unsigned long long>(k_chunk_count));
+  std::vector<uint8_t> contents(k_blob_size);
+  for (uint64_t i = 0; i < k_blob_size; i++) {
+    contents[i] = static_cast<uint8_t>(i * 2654435761u >> 24);
+  }
+  veles::data::BinData data(8, contents.size(), contents.data());
+  auto blob = root->syncRunMethod<veles::dbif::RootCreateFileBlobFromDataRequest>(
+      data, "bench")->object;
+  std::vector<veles::dbif::ChunkTreeNode> chunks;
+  uint64_t chunk_size = k_blob_size / k_chunk_count;
+  for (uint64_t i = 0; i < k_chunk_count; i++) {
+    chunks.push_back(veles::dbif::ChunkTreeNode{
+        veles::dbif::ObjectHandle(), veles::dbif::ObjectHandle(),
+        QString("chunk_%1").arg(i), "bench", i * chunk_size,
+        (i + 1) * chunk_size, std::vector<veles::data::ChunkDataItem>()});
+  }
+  auto created = blob->syncRunMethod<veles::dbif::ChunkCreateTreeRequest>(
+      chunks, std::vector<veles::dbif::SubBlobTreeNode>());
+  uint64_t blob_id = objectId(blob);
+  uint64_t leaf_id = objectId(created->chunks.front());
+
+  // The client below blocks, so the server needs an event loop of its own.
+  QThread server_thread;
+  veles::db::NetworkServer *server = new veles::db::NetworkServer(
+      root, QHostAddress::LocalHost, 0);
+  server->moveToThread(&server_thread);
+  QObject::connect(server, &QObject::destroyed, &server_thread, &QThread::quit);
+  server_thread.start();
+
+  QTcpSocket socket;
+  socket.connectToHost(QHostAddress::LocalHost, server->port());
+  if (!socket.waitForConnected(30000)) {
+    fprintf(stderr, "Failed to connect to the server.\n");
+    return 1;
+  }
+  std::vector<char> buffer;
+  veles::network::Response resp;
+  uint64_t request_id = 0;
+
+  for (int round = 0; round < k_rounds; round++) {
+    // Small requests, pipelined.
+    auto start = std::chrono::steady_clock::now();
+    int sent = 0;
+    int received = 0;
+    veles::network::Request req;
+    req.set_type(veles::network::Request::LIST_CHILDREN);
+    req.set_object_id(leaf_id);
+    while (received < k_small_requests) {
+      while (sent < k_small_requests && sent - received < k_pipeline_depth) {
+        req.set_request_id(++request_id);
+        sendRequest(&socket, req);
+        sent++;
+      }
+      if (!readResponse(&socket, &buffer, &resp)) {
+        fprintf(stderr, "LIST_CHILDREN failed.\n");
+        return 1;
+      }
+      received++;
+    }
+    double small_time = secondsSince(start);
+
+    // The whole chunk tree, streamed.
+    start = std::chrono::steady_clock::now();
+    req.Clear();
+    req.set_type(veles::network::Request::LIST_CHILDREN_RECURSIVE);
+    req.set_object_id(blob_id);
+    req.set_request_id(++request_id);
+    req.set_stream(true);
+    sendRequest(&socket, req);
+    uint64_t objects = 0;
+    do {
+      if (!readResponse(&socket, &buffer, &resp)) {
+        fprintf(stderr, "LIST_CHILDREN_RECURSIVE failed.\n");
+        return 1;
+      }
+      objects += resp.results_size();
+    } while (!resp.last_part());
+    double list_time = secondsSince(start);
+
+    // The whole blob, streamed.
+    start = std::chrono::steady_clock::now();
+    req.Clear();
+    req.set_type(veles::network::Request::GET_BLOB_DATA);
+    req.set_object_id(blob_id);
+    req.set_request_id(++request_id);
+    req.set_data_part_size(1024 * 1024);
+    sendRequest(&socket, req);
+    uint64_t octets = 0;
+    do {
+      if (!readResponse(&socket, &buffer, &resp)) {
+        fprintf(stderr, "GET_BLOB_DATA failed.\n");
+        return 1;
+      }
+      octets += resp.data().size();
+    } while (!resp.last_part());
+    double data_time = secondsSince(start);
+
+    printf("round %d: %.0f requests/s, %.0f objects/s, %.1f MiB/s\n", round,
+           k_small_requests / small_time, objects / list_time,
+           octets / data_time / (1024 * 1024));
+  }
+
+  socket.disconnectFromHost();
+  QMetaObject::invokeMethod(server, "deleteLater", Qt::QueuedConnection);
+  server_thread.wait();
+  return 0;
+}
@@ -0,0 +1,179 @@
+/*
+ * Copyright 2016 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <algorithm>
+
+#include "parser/batch.h"
+#include "dbif/error.h"
+#include "dbif/method.h"
+
+namespace veles {
+namespace parser {
+
+dbif::InfoPromise *PendingObjectHandle::getInfo(dbif::PInfoRequest req) {
+  return resolve()->getInfo(req);
+}
+
+dbif::InfoPromise *PendingObjectHandle::subInfo(dbif::PInfoRequest req) {
+  return resolve()->subInfo(req);
+}
+
+dbif::MethodResultPromise *PendingObjectHandle::runMethod(dbif::PMethodRequest req) {
+  return resolve()->runMethod(req);
+}
+
+dbif::ObjectHandle PendingObjectHandle::resolve() {
+  if (!resolved_) {
+    if (auto batch = batch_.toStrongRef()) {
+      batch->commit();
+    }
+  }
+  if (!resolved_) {
+    throw dbif::PError(QSharedPointer<dbif::ObjectGoneError>::create());
+  }
+  return resolved_;
+}
+
+ChunkTreeBatch::~ChunkTreeBatch() {
+  // Chunks left open by a failed parse still get created, like they would
+  // have been without batching.
+  try {
+    commit();
+  } catch (dbif::PError) {
+  }
+}
+
+QSharedPointer<ChunkTreeBatch> ChunkTreeBatch::forParent(
+    dbif::ObjectHandle blob, dbif::ObjectHandle *parent_chunk) {
+  if (auto pending = parent_chunk->dynamicCast<PendingObjectHandle>()) {
+    auto batch = queuedIn(*parent_chunk);
+    if (batch && batch->blob() == blob) {
+      return batch;
+    }
+    *parent_chunk = pending->resolve();
+  }
+  return QSharedPointer<ChunkTreeBatch>::create(blob);
+}
+
+QSharedPointer<ChunkTreeBatch> ChunkTreeBatch::queuedIn(dbif::ObjectHandle obj) {
+  auto pending = obj.dynamicCast<PendingObjectHandle>();
+  if (!pending || pending->resolved()) {
+    return QSharedPointer<ChunkTreeBatch>();
+  }
+  return pending->batch();
+}
+
+dbif::ObjectHandle ChunkTreeBatch::settle(dbif::ObjectHandle obj, bool allow_queued) {
+  auto pending = obj.dynamicCast<PendingObjectHandle>();
+  if (!pending) {
+    return obj;
+  }
+  if (pending->resolved()) {
+    return pending->resolved();
+  }
+  if (allow_queued && pending->owner() == this) {
+    return obj;
+  }
+  return pending->resolve();
+}
+
+std::vector<data::ChunkDataItem> ChunkTreeBatch::settleItems(
+    const std::vector<data::ChunkDataItem> &items, bool allow_queued) {
+  std::vector<data::ChunkDataItem> res = items;
+  for (auto &item : res) {
+    for (auto &ref : item.ref) {
+      ref = settle(ref, allow_queued);
+    }
+  }
+  return res;
+}
+
+dbif::ObjectHandle ChunkTreeBatch::startChunk(dbif::ObjectHandle parent_chunk,
+                                              uint64_t start, const QString &type,
+                                              const QString &name) {
+  auto placeholder = QSharedPointer<PendingObjectHandle>::create(
+    sharedFromThis(), dbif::CHUNK);
+  chunk_index_[placeholder.data()] = chunks_.size();
+  chunks_.push_back(dbif::ChunkTreeNode{placeholder, parent_chunk, name, type,
+                                        start, start,
+                                        std::vector<data::ChunkDataItem>()});
+  open_++;
+  return placeholder;
+}
+
+void ChunkTreeBatch::endChunk(dbif::ObjectHandle chunk, uint64_t start,
+                              uint64_t end,
+                              const std::vector<data::ChunkDataItem> &items) {
+  auto iter = chunk_index_.find(chunk.data());
+  if (iter != chunk_index_.end()) {
+    dbif::ChunkTreeNode &node = chunks_[iter.value()];
+    node.start = start;
+    node.end = end;
+    node.items = items;
+  } else {
+    // The chunk was committed while still open - update it in place.
+    commit();
+    settle(chunk, false)->syncRunMethod<dbif::SetChunkParseRequest>(
+      start, end, settleItems(items, false));
+  }
+  abandonChunks(1);
+  if (!open_) {
+    commit();
+  }
+}
+
+void ChunkTreeBatch::abandonChunks(unsigned count) {
+  open_ -= std::min(count, open_);
+}
+
+dbif::ObjectHandle ChunkTreeBatch::addSubBlob(dbif::ObjectHandle parent_chunk,
+                                              const QString &name,
+                                              const data::BinData &data) {
+  auto placeholder = QSharedPointer<PendingObjectHandle>::create(
+    sharedFromThis(), dbif::SUB_BLOB);
+  sub_blobs_.push_back(dbif::SubBlobTreeNode{placeholder, parent_chunk, data, name});
+  return placeholder;
+}
+
+void ChunkTreeBatch::commit() {
+  if (empty()) {
+    return;
+  }
+  std::vector<dbif::ChunkTreeNode> chunks;
+  std::vector<dbif::SubBlobTreeNode> sub_blobs;
+  std::swap(chunks, chunks_);
+  std::swap(sub_blobs, sub_blobs_);
+  chunk_index_.clear();
+  for (auto &node : chunks) {
+    node.parent_chunk = settle(node.parent_chunk, true);
+    node.items = settleItems(node.items, true);
+  }
+  for (auto &node : sub_blobs) {
+    node.parent_chunk = settle(node.parent_chunk, true);
+  }
+  auto reply = blob_->syncRunMethod<dbif::ChunkCreateTreeRequest>(chunks, sub_blobs);
+  for (size_t i = 0; i < chunks.size(); i++) {
+    chunks[i].placeholder.dynamicCast<PendingObjectHandle>()->setResolved(
+      reply->chunks[i]);
+  }
+  for (size_t i = 0; i < sub_blobs.size(); i++) {
+    sub_blobs[i].placeholder.dynamicCast<PendingObjectHandle>()->setResolved(
+      reply->sub_blobs[i]);
+  }
+}
+
+};
+};
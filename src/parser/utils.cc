@@ -16,6 +16,7 @@
  */
 #include "dbif/universe.h"
 #include "parser/utils.h"
+#include "parser/batch.h"
 
 #include "parser/unpng.h"
 #include "parser/unpyc.h"
@@ -54,6 +55,9 @@ data::ChunkDataItem findField(dbif::ObjectHandle parent, const QString &name) {
 }
 
 dbif::ObjectHandle makeSubBlob(dbif::ObjectHandle parent, const QString &name, const data::BinData &data) {
+  if (auto batch = ChunkTreeBatch::queuedIn(parent)) {
+    return batch->addSubBlob(parent, name, data);
+  }
   return parent->syncRunMethod<dbif::ChunkCreateSubBlobRequest>(data, name)->object;
 }
 
@@ -99,7 +99,8 @@ FileBlobModel::FileBlobModel(dbif::ObjectHandle fileBlob,
       fileBlob_(fileBlob),
       bytesPromise_(nullptr),
       bytesCount_(0),
-      path_(path) {
+      path_(path),
+      binData_(std::make_shared<data::BinData>()) {
   item_ = new RootFileBlobItem(fileBlob, this);
 
   connect(item_, &FileBlobItem::removingChildren,
@@ -135,7 +136,7 @@ FileBlobModel::FileBlobModel(dbif::ObjectHandle fileBlob,
 void FileBlobModel::gotBytesResponse(veles::dbif::PInfoReply reply) {
   if (auto bytesReply =
           reply.dynamicCast<dbif::BlobDataRequest::ReplyType>()) {
-    binData_ = bytesReply->data;
+    binData_ = std::make_shared<data::BinData>(bytesReply->data);
     emit newBinData();
   }
 }
@@ -354,6 +355,14 @@ Qt::ItemFlags FileBlobModel::flags(const QModelIndex& index) const {
   return flags;
 }
 
+QByteArray FileBlobModel::visualisationData(
+    std::shared_ptr<const void> *owner) {
+  *owner = binData_;
+  return QByteArray::fromRawData(
+      reinterpret_cast<const char *>(binData_->rawData()),
+      static_cast<int>(binData_->octets()));
+}
+
 void FileBlobModel::uploadNewData(const QByteArray& buf) {
   std::vector<uint8_t> data;
   data.insert(data.begin(), buf.begin(), buf.end());
@@ -55,7 +55,9 @@ int main(int argc, char *argv[]) {
   translator.load(QString("hexedit_") + locale);
   app.installTranslator(&translator);
 
-  veles::util::threadpool::createTopic("visualisation", 3);
+  veles::util::threadpool::createTopic("visualisation");
+  // Server-side FIND, HISTOGRAM and ENTROPY requests.
+  veles::util::threadpool::createTopic("analysis");
 
   qRegisterMetaType<veles::visualisation::VisualisationWidget::AdditionalResampleDataPtr>("AdditionalResampleDataPtr");
 
@@ -108,5 +110,7 @@ int main(int argc, char *argv[]) {
     mainWin->addFile(file);
   }
 
-  return app.exec();
+  int res = app.exec();
+  veles::util::threadpool::shutdown();
+  return res;
 }
@@ -270,8 +270,9 @@ bool NodeTreeWidget::saveAs() {
 
 void NodeTreeWidget::showVisualisation() {
   auto *panel = new visualisation::VisualisationPanel;
-  panel->setData(QByteArray((const char *)data_model_->binData().rawData(),
-      static_cast<int>(data_model_->binData().size())));
+  std::shared_ptr<const void> data_owner;
+  QByteArray data = data_model_->visualisationData(&data_owner);
+  panel->setData(data, data_owner);
   panel->setWindowTitle(cur_file_path_);
   panel->setAttribute(Qt::WA_DeleteOnClose);
 
@@ -16,6 +16,7 @@
  */
 #include <QAction>
 #include <QApplication>
+#include <QFile>
 #include <QFileDialog>
 #include <QMenuBar>
 #include <QMessageBox>
@@ -31,6 +32,7 @@
 #include "dbif/types.h"
 #include "dbif/universe.h"
 #include "util/version.h"
+#include "visualisation/panel.h"
 #include "ui/databaseinfo.h"
 #include "ui/veles_mainwindow.h"
 #include "ui/hexeditwidget.h"
@@ -1017,6 +1019,33 @@ void VelesMainWindow::open() {
   }
 }
 
+void VelesMainWindow::visualiseFile() {
+  QString fileName = QFileDialog::getOpenFileName(this);
+  if (fileName.isEmpty()) {
+    return;
+  }
+  // The panel samples the file directly, and has nothing to show (or map
+  // offsets to) if it can't.
+  QFile file(fileName);
+  if (!file.open(QIODevice::ReadOnly)) {
+    QMessageBox::information(this, tr("Unable to open file"),
+                             file.errorString());
+    return;
+  }
+  if (file.size() == 0) {
+    QMessageBox::information(this, tr("Unable to visualise file"),
+                             tr("The file is empty."));
+    return;
+  }
+  file.close();
+  auto *panel = new visualisation::VisualisationPanel;
+  panel->setFile(fileName);
+  panel->setWindowTitle(fileName);
+  panel->setAttribute(Qt::WA_DeleteOnClose);
+
+  addTab(panel, QFileInfo(fileName).fileName() + " - Visualisation");
+}
+
 void VelesMainWindow::newFile() { createFileBlob(""); }
 
 void VelesMainWindow::about() {
@@ -1066,6 +1095,13 @@ void VelesMainWindow::createActions() {
   open_act_->setStatusTip(tr("Open an existing file"));
   connect(open_act_, SIGNAL(triggered()), this, SLOT(open()));
 
+  visualise_file_act_ = new QAction(tr("&Visualise file..."), this);
+  visualise_file_act_->setStatusTip(
+      tr("Visualise a file without loading it (works for files of any "
+         "size)"));
+  connect(visualise_file_act_, SIGNAL(triggered()), this,
+          SLOT(visualiseFile()));
+
   exit_act_ = new QAction(tr("E&xit"), this);
   exit_act_->setShortcuts(QKeySequence::Quit);
   exit_act_->setStatusTip(tr("Exit the application"));
@@ -1101,6 +1137,7 @@ void VelesMainWindow::createMenus() {
   //fileMenu->addAction(newFileAct);
 
   file_menu_->addAction(open_act_);
+  file_menu_->addAction(visualise_file_act_);
   file_menu_->addSeparator();
   file_menu_->addAction(options_act_);
   file_menu_->addSeparator();
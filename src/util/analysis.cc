@@ -0,0 +1,222 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "util/analysis.h"
+#include "util/concurrency/parallel.h"
+
+namespace veles {
+namespace util {
+namespace analysis {
+
+std::vector<uint64_t> findAll(const uint8_t *data, size_t size,
+                              const uint8_t *pattern, size_t pattern_size,
+                              size_t max_hits) {
+  std::vector<uint64_t> hits;
+  if (pattern_size == 0 || pattern_size > size) {
+    return hits;
+  }
+  // memchr is vectorized by the C library - use it to skip to candidates.
+  const uint8_t *pos = data;
+  const uint8_t *last = data + size - pattern_size;
+  while (hits.size() < max_hits && pos <= last) {
+    pos = static_cast<const uint8_t *>(
+        memchr(pos, pattern[0], last - pos + 1));
+    if (pos == nullptr) {
+      break;
+    }
+    if (memcmp(pos + 1, pattern + 1, pattern_size - 1) == 0) {
+      hits.push_back(pos - data);
+    }
+    pos++;
+  }
+  return hits;
+}
+
+ByteHistogram byteHistogram(const uint8_t *data, size_t size) {
+  // Four tables, so that runs of the same byte don't stall on updating
+  // a single counter.
+  uint64_t counts[4][256];
+  memset(counts, 0, sizeof(counts));
+  size_t i = 0;
+  for (; i + 4 <= size; i += 4) {
+    counts[0][data[i]]++;
+    counts[1][data[i + 1]]++;
+    counts[2][data[i + 2]]++;
+    counts[3][data[i + 3]]++;
+  }
+  for (; i < size; i++) {
+    counts[0][data[i]]++;
+  }
+  ByteHistogram res;
+  for (int value = 0; value < 256; value++) {
+    res[value] = counts[0][value] + counts[1][value] +
+                 counts[2][value] + counts[3][value];
+  }
+  return res;
+}
+
+uint64_t byteSum(const uint8_t *data, size_t size) {
+  uint64_t sum = 0;
+  size_t i = 0;
+#ifdef __SSE2__
+  // psadbw against zero adds up every 8 bytes into a 64-bit lane.
+  const __m128i zero = _mm_setzero_si128();
+  __m128i acc[2] = {zero, zero};
+  for (; i + 32 <= size; i += 32) {
+    __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    __m128i high = _mm_loadu_si128(
+        reinterpret_cast<const __m128i *>(data + i + 16));
+    acc[0] = _mm_add_epi64(acc[0], _mm_sad_epu8(low, zero));
+    acc[1] = _mm_add_epi64(acc[1], _mm_sad_epu8(high, zero));
+  }
+  uint64_t lanes[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i *>(lanes),
+                   _mm_add_epi64(acc[0], acc[1]));
+  sum = lanes[0] + lanes[1];
+#endif
+  for (; i < size; i++) {
+    sum += data[i];
+  }
+  return sum;
+}
+
+double entropy(const ByteHistogram &counts, uint64_t total) {
+  if (total == 0) {
+    return 0;
+  }
+  double res = 0;
+  for (auto count : counts) {
+    if (count) {
+      double p = static_cast<double>(count) / total;
+      res -= p * std::log2(p);
+    }
+  }
+  return res;
+}
+
+std::vector<float> entropySeries(const uint8_t *data, size_t size,
+                                 size_t window_size) {
+  std::vector<float> res;
+  if (window_size == 0) {
+    return res;
+  }
+  ByteHistogram counts;
+  for (size_t start = 0; start < size; start += window_size) {
+    size_t length = std::min(window_size, size - start);
+    // Windows are usually small, so a single table is cheaper to clear.
+    counts.fill(0);
+    for (size_t i = start; i < start + length; i++) {
+      counts[data[i]]++;
+    }
+    res.push_back(entropy(counts, length));
+  }
+  return res;
+}
+
+std::vector<uint64_t> parallelFindAll(const std::string &topic,
+                                      const uint8_t *data, size_t size,
+                                      const uint8_t *pattern,
+                                      size_t pattern_size, size_t max_hits) {
+  if (pattern_size == 0 || pattern_size > size) {
+    return std::vector<uint64_t>();
+  }
+  // Chunks are the ranges where matches start - they may end after it.
+  size_t starts = size - pattern_size + 1;
+  size_t chunks = (starts - 1) / k_chunk_size + 1;
+  std::vector<std::vector<uint64_t>> chunk_hits(chunks);
+  // Chunks after one with max_hits of its own can't contribute.
+  std::atomic<size_t> last_needed(chunks - 1);
+  threadpool::parallelFor(topic, 0, chunks, 1,
+      [&](size_t begin, size_t end) {
+    for (size_t chunk = begin; chunk < end; chunk++) {
+      if (chunk > last_needed.load(std::memory_order_relaxed)) {
+        return;
+      }
+      size_t offset = chunk * k_chunk_size;
+      size_t length = std::min(k_chunk_size, starts - offset) +
+                      pattern_size - 1;
+      auto &hits = chunk_hits[chunk];
+      hits = findAll(data + offset, length, pattern, pattern_size, max_hits);
+      for (auto &hit : hits) {
+        hit += offset;
+      }
+      if (hits.size() == max_hits) {
+        size_t last = last_needed.load();
+        while (chunk < last &&
+               !last_needed.compare_exchange_weak(last, chunk)) {}
+      }
+    }
+  });
+  std::vector<uint64_t> res;
+  for (auto &hits : chunk_hits) {
+    res.insert(res.end(), hits.begin(), hits.end());
+    if (res.size() >= max_hits) {
+      res.resize(max_hits);
+      break;
+    }
+  }
+  return res;
+}
+
+ByteHistogram parallelByteHistogram(const std::string &topic,
+                                    const uint8_t *data, size_t size) {
+  ByteHistogram zero = {};
+  return threadpool::parallelReduce(topic, 0, size, k_chunk_size, zero,
+      [data](ByteHistogram &counts, size_t begin, size_t end) {
+    auto chunk_counts = byteHistogram(data + begin, end - begin);
+    for (int value = 0; value < 256; value++) {
+      counts[value] += chunk_counts[value];
+    }
+  }, [](ByteHistogram &into, ByteHistogram &&from) {
+    for (int value = 0; value < 256; value++) {
+      into[value] += from[value];
+    }
+  });
+}
+
+std::vector<float> parallelEntropySeries(const std::string &topic,
+                                         const uint8_t *data, size_t size,
+                                         size_t window_size) {
+  if (window_size == 0) {
+    return std::vector<float>();
+  }
+  std::vector<float> res((size + window_size - 1) / window_size);
+  float *values = res.data();
+  threadpool::parallelFor(topic, 0, res.size(),
+                          std::max(size_t(1), k_chunk_size / window_size),
+      [=](size_t begin, size_t end) {
+    size_t offset = begin * window_size;
+    auto series = entropySeries(data + offset,
+                                std::min(size - offset,
+                                         (end - begin) * window_size),
+                                window_size);
+    std::copy(series.begin(), series.end(), values + begin);
+  });
+  return res;
+}
+
+}  // namespace analysis
+}  // namespace util
+}  // namespace veles
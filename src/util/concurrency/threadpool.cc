@@ -15,83 +15,283 @@
  *
  */
 #include "util/concurrency/threadpool.h"
-#include <thread>
-#include <mutex>
+#include "util/concurrency/work_stealing_deque.h"
+
+#include <algorithm>
+#include <atomic>
 #include <condition_variable>
+#include <deque>
 #include <map>
+#include <mutex>
+#include <random>
+#include <thread>
 #include <vector>
-#include <deque>
 
 
 namespace veles {
 namespace util {
 namespace threadpool {
 
-struct TopicInfo {
+namespace {
+
+// Tasks scheduled from outside the pool, for all topics of one priority.
+struct InjectionQueue {
+  int priority;
   std::mutex mutex;
-  std::condition_variable cv;
-  std::vector<std::thread> workers;
-  std::deque<Task> tasks;
+  std::deque<Task *> tasks;
+  std::atomic<size_t> size;
+
+  explicit InjectionQueue(int priority) : priority(priority), size(0) {}
+};
+
+struct TopicInfo {
+  InjectionQueue *queue;
   bool mock;
+  // Of the highest priority, so tasks scheduled from workers can go to
+  // their own deques.
+  bool local;
 };
 
-std::map<std::string, TopicInfo*> topics_;
-std::mutex map_mutex_;
+typedef std::map<std::string, TopicInfo> TopicMap;
+typedef std::vector<InjectionQueue *> QueueList;
 
-void threadFunction(TopicInfo *ti) {
-  while (true) {
-    std::unique_lock<std::mutex> lc(ti->mutex);
-    while (ti->tasks.empty()) {
-      ti->cv.wait(lc);
-    }
-    Task t = ti->tasks.front();
-    ti->tasks.pop_front();
-    lc.unlock();
-    t();
-  }
+class Pool {
+ public:
+  Pool();
+  ~Pool() { shutdown(); }
+
+  void setWorkerCount(size_t workers);
+  size_t workerCount();
+  void createTopic(const std::string &topic, int priority, bool mock);
+  SchedulingResult runTask(const std::string &topic, Task t);
+  void shutdown();
+
+ private:
+  // Topics and queues are only ever added, so submitters and workers read
+  // immutable snapshots instead of taking a lock.
+  std::shared_ptr<const TopicMap> topics_;
+  // Ordered by decreasing priority.
+  std::shared_ptr<const QueueList> queues_;
+  std::vector<std::unique_ptr<InjectionQueue>> queue_storage_;
+  std::mutex config_mutex_;
+
+  // Read without config_mutex_, which shutdown() holds while tasks finish.
+  std::atomic<size_t> worker_count_;
+  std::vector<std::thread> workers_;
+  std::vector<std::unique_ptr<WorkStealingDeque<Task>>> deques_;
+  std::atomic<bool> started_;
+  std::atomic<bool> stopping_;
+
+  // Tasks scheduled but not yet taken by a worker.  Counted before they are
+  // queued, so that a worker never sleeps or quits while one is on its way.
+  std::atomic<int64_t> queued_;
+  std::atomic<int> sleepers_;
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+
+  static thread_local int worker_index_;
+
+  void start();
+  void wakeOne();
+  void workerFunction(int index);
+  Task *findTask(int index, std::minstd_rand *random);
+};
+
+thread_local int Pool::worker_index_ = -1;
+
+Pool::Pool() : topics_(std::make_shared<TopicMap>()),
+    queues_(std::make_shared<QueueList>()),
+    worker_count_(std::max(std::thread::hardware_concurrency(), 1u)),
+    started_(false), stopping_(false), queued_(0), sleepers_(0) {}
+
+void Pool::setWorkerCount(size_t workers) {
+  std::unique_lock<std::mutex> lc(config_mutex_);
+  worker_count_ = std::max(workers, size_t(1));
+}
+
+size_t Pool::workerCount() {
+  return worker_count_.load();
 }
 
-void createTopic(std::string topic, size_t workers) {
-  std::unique_lock<std::mutex> lc(map_mutex_);
-  if (topics_.find(topic) != topics_.end()) return;
-  TopicInfo *ti = new TopicInfo();
-  ti->mock = false;
-  topics_[topic] = ti;
-  std::unique_lock<std::mutex> topic_lc(ti->mutex);
-  for (size_t i = 0; i < workers; ++i) {
-    ti->workers.push_back(std::thread(threadFunction, ti));
+void Pool::createTopic(const std::string &topic, int priority, bool mock) {
+  std::unique_lock<std::mutex> lc(config_mutex_);
+  if (topics_->find(topic) != topics_->end()) return;
+  InjectionQueue *queue = nullptr;
+  for (auto existing : *queues_) {
+    if (existing->priority == priority) {
+      queue = existing;
+    }
+  }
+  if (queue == nullptr) {
+    queue_storage_.emplace_back(new InjectionQueue(priority));
+    queue = queue_storage_.back().get();
+    auto queues = std::make_shared<QueueList>(*queues_);
+    queues->push_back(queue);
+    std::sort(queues->begin(), queues->end(),
+        [](InjectionQueue *a, InjectionQueue *b) {
+      return a->priority > b->priority;
+    });
+    std::atomic_store(&queues_, std::shared_ptr<const QueueList>(queues));
   }
+  auto topics = std::make_shared<TopicMap>(*topics_);
+  (*topics)[topic] = TopicInfo{queue, mock, false};
+  int highest = (*queues_)[0]->priority;
+  for (auto &info : *topics) {
+    info.second.local = info.second.queue->priority == highest;
+  }
+  std::atomic_store(&topics_, std::shared_ptr<const TopicMap>(topics));
 }
 
-void mockTopic(std::string topic) {
-  std::unique_lock<std::mutex> lc(map_mutex_);
-  if (topics_.find(topic) != topics_.end()) return;
-  TopicInfo *ti = new TopicInfo();
-  ti->mock = true;
-  topics_[topic] = ti;
+void Pool::start() {
+  std::unique_lock<std::mutex> lc(config_mutex_);
+  if (started_.load() || stopping_.load()) return;
+  for (size_t i = 0; i < worker_count_; ++i) {
+    deques_.emplace_back(new WorkStealingDeque<Task>());
+  }
+  for (size_t i = 0; i < worker_count_; ++i) {
+    workers_.push_back(std::thread(&Pool::workerFunction, this, int(i)));
+  }
+  started_.store(true);
 }
 
-SchedulingResult runTask(std::string topic, Task t) {
-  std::unique_lock<std::mutex> lc(map_mutex_);
-  if (topics_.find(topic) == topics_.end()) {
+SchedulingResult Pool::runTask(const std::string &topic, Task t) {
+  auto topics = std::atomic_load(&topics_);
+  auto it = topics->find(topic);
+  if (it == topics->end()) {
     return SchedulingResult::ERR_UNKNOWN_TOPIC;
   }
-  TopicInfo *ti = topics_[topic];
-  std::unique_lock<std::mutex> topic_lc(ti->mutex);
-  lc.unlock();
-  if (ti->mock) {
+  if (it->second.mock) {
     t();
     return SchedulingResult::SCHEDULED;
   }
-  if (ti->workers.size() == 0) {
+  if (!started_.load(std::memory_order_acquire)) {
+    start();
+  }
+  queued_.fetch_add(1);
+  if (stopping_.load() && worker_index_ < 0) {
+    queued_.fetch_sub(1);
     return SchedulingResult::ERR_NO_WORKERS;
   }
-  ti->tasks.push_back(t);
-  topic_lc.unlock();
-  ti->cv.notify_one();
+  Task *task = new Task(std::move(t));
+  if (worker_index_ >= 0 && it->second.local) {
+    deques_[worker_index_]->push(task);
+  } else {
+    InjectionQueue *queue = it->second.queue;
+    std::unique_lock<std::mutex> lc(queue->mutex);
+    queue->tasks.push_back(task);
+    queue->size.fetch_add(1);
+  }
+  wakeOne();
   return SchedulingResult::SCHEDULED;
 }
 
+void Pool::wakeOne() {
+  if (sleepers_.load() > 0) {
+    // Taking the mutex makes sure that a worker that is about to sleep
+    // already waits and gets the notification.
+    std::unique_lock<std::mutex> lc(sleep_mutex_);
+    wake_.notify_one();
+  }
+}
+
+Task *Pool::findTask(int index, std::minstd_rand *random) {
+  if (Task *task = deques_[index]->pop()) {
+    return task;
+  }
+  auto queues = std::atomic_load(&queues_);
+  for (auto queue : *queues) {
+    if (queue->size.load() == 0) continue;
+    std::unique_lock<std::mutex> lc(queue->mutex);
+    if (!queue->tasks.empty()) {
+      Task *task = queue->tasks.front();
+      queue->tasks.pop_front();
+      queue->size.fetch_sub(1);
+      return task;
+    }
+  }
+  size_t count = deques_.size();
+  size_t first = (*random)() % count;
+  for (size_t i = 0; i < count; ++i) {
+    size_t victim = (first + i) % count;
+    if (victim == size_t(index)) continue;
+    if (Task *task = deques_[victim]->steal()) {
+      return task;
+    }
+  }
+  return nullptr;
+}
+
+void Pool::workerFunction(int index) {
+  worker_index_ = index;
+  std::minstd_rand random(index + 1);
+  while (true) {
+    if (Task *task = findTask(index, &random)) {
+      queued_.fetch_sub(1);
+      (*task)();
+      delete task;
+      continue;
+    }
+    if (queued_.load() > 0) {
+      // Some task is counted but not queued yet, or a thief beat us to it.
+      std::this_thread::yield();
+      continue;
+    }
+    std::unique_lock<std::mutex> lc(sleep_mutex_);
+    sleepers_.fetch_add(1);
+    while (queued_.load() == 0 && !stopping_.load()) {
+      wake_.wait(lc);
+    }
+    sleepers_.fetch_sub(1);
+    if (queued_.load() == 0 && stopping_.load()) {
+      return;
+    }
+  }
+}
+
+void Pool::shutdown() {
+  std::unique_lock<std::mutex> lc(config_mutex_);
+  stopping_.store(true);
+  {
+    std::unique_lock<std::mutex> sleep_lc(sleep_mutex_);
+    wake_.notify_all();
+  }
+  for (auto &worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+  started_.store(false);
+}
+
+Pool &pool() {
+  static Pool pool;
+  return pool;
+}
+
+}  // namespace
+
+void setWorkerCount(size_t workers) {
+  pool().setWorkerCount(workers);
+}
+
+size_t workerCount() {
+  return pool().workerCount();
+}
+
+void createTopic(std::string topic, int priority) {
+  pool().createTopic(topic, priority, false);
+}
+
+void mockTopic(std::string topic) {
+  pool().createTopic(topic, 0, true);
+}
+
+SchedulingResult runTask(const std::string &topic, Task t) {
+  return pool().runTask(topic, std::move(t));
+}
+
+void shutdown() {
+  pool().shutdown();
+}
 
 }  // namespace threadpool
 }  // namespace util
@@ -0,0 +1,218 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <cassert>
+
+#include "util/concurrency/parallel.h"
+#include "util/histogram_index.h"
+
+namespace veles {
+namespace util {
+
+std::mutex HistogramIndex::registry_mutex_;
+std::map<std::pair<const char*, int>, std::weak_ptr<HistogramIndex>>
+    HistogramIndex::registry_;
+
+/*****************************************************************************/
+/* Public methods */
+/*****************************************************************************/
+
+HistogramIndex::HistogramIndex(const QByteArray &data,
+                               std::shared_ptr<const void> owner) :
+    data_(data), owner_(std::move(owner)), built_(false), next_cb_id_(0) {}
+
+std::shared_ptr<HistogramIndex> HistogramIndex::forData(
+    const QByteArray &data, std::shared_ptr<const void> owner) {
+  auto key = std::make_pair(data.constData(), data.size());
+  std::shared_ptr<HistogramIndex> index;
+  {
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    auto found = registry_.find(key);
+    if (found != registry_.end()) {
+      index = found->second.lock();
+      if (index) {
+        return index;
+      }
+    }
+    for (auto i = registry_.begin(); i != registry_.end();) {
+      if (i->second.expired()) {
+        i = registry_.erase(i);
+      } else {
+        ++i;
+      }
+    }
+    index = std::make_shared<HistogramIndex>(data, std::move(owner));
+    registry_[key] = index;
+  }
+
+  std::weak_ptr<HistogramIndex> weak_index = index;
+  threadpool::runTask("visualisation", [weak_index]() {
+    if (auto index = weak_index.lock()) {
+      index->build();
+    }
+  });
+  return index;
+}
+
+void HistogramIndex::build() {
+  std::lock_guard<std::mutex> lock(build_mutex_);
+  if (built()) {
+    return;
+  }
+  auto data = reinterpret_cast<const uint8_t *>(data_.constData());
+  size_t nodes = static_cast<size_t>(data_.size()) / k_leaf_size;
+  leaves_.assign(nodes * 256, 0);
+  uint16_t *leaves = leaves_.data();
+  threadpool::parallelFor("visualisation", 0, nodes, k_leaves_per_chunk,
+      [data, leaves](size_t begin, size_t end) {
+    for (size_t leaf = begin; leaf < end; ++leaf) {
+      uint16_t *counts = leaves + leaf * 256;
+      const uint8_t *bytes = data + leaf * k_leaf_size;
+      for (size_t i = 0; i < k_leaf_size; ++i) {
+        counts[bytes[i]]++;
+      }
+    }
+  });
+
+  levels_.clear();
+  while (nodes >= k_fanout) {
+    nodes /= k_fanout;
+    std::vector<uint64_t> level(nodes * 256, 0);
+    uint64_t *sums = level.data();
+    if (levels_.empty()) {
+      threadpool::parallelFor("visualisation", 0, nodes,
+                              k_leaves_per_chunk / k_fanout,
+          [sums, leaves](size_t begin, size_t end) {
+        for (size_t i = begin * 256; i < end * 256; ++i) {
+          size_t value = i % 256;
+          const uint16_t *children = leaves + (i - value) * k_fanout + value;
+          for (size_t child = 0; child < k_fanout; ++child) {
+            sums[i] += children[child * 256];
+          }
+        }
+      });
+    } else {
+      const uint64_t *lower = levels_.back().data();
+      for (size_t i = 0; i < nodes * 256; ++i) {
+        size_t value = i % 256;
+        const uint64_t *children = lower + (i - value) * k_fanout + value;
+        for (size_t child = 0; child < k_fanout; ++child) {
+          sums[i] += children[child * 256];
+        }
+      }
+    }
+    levels_.push_back(std::move(level));
+  }
+  built_.store(true, std::memory_order_release);
+
+  std::lock_guard<std::mutex> callbacks_lock(callbacks_mutex_);
+  for (auto &cb : callbacks_) {
+    cb.second();
+  }
+}
+
+int HistogramIndex::registerBuiltCallback(BuiltCallback cb) {
+  std::lock_guard<std::mutex> lock(callbacks_mutex_);
+  int cb_id = next_cb_id_++;
+  callbacks_[cb_id] = std::move(cb);
+  return cb_id;
+}
+
+void HistogramIndex::removeBuiltCallback(int cb_id) {
+  std::lock_guard<std::mutex> lock(callbacks_mutex_);
+  callbacks_.erase(cb_id);
+}
+
+analysis::ByteHistogram HistogramIndex::histogram(size_t start,
+                                                  size_t end) const {
+  assert(start <= end);
+  assert(end <= static_cast<size_t>(data_.size()));
+  analysis::ByteHistogram counts;
+  counts.fill(0);
+  // Leaves [first, last) are whole inside the range.
+  size_t first = (start + k_leaf_size - 1) / k_leaf_size;
+  size_t last = end / k_leaf_size;
+  if (!built() || first >= last) {
+    addBytes(start, end, &counts);
+    return counts;
+  }
+  addBytes(start, first * k_leaf_size, &counts);
+  addBytes(last * k_leaf_size, end, &counts);
+  for (int level = 0; first < last; ++level) {
+    size_t parent_first = (first + k_fanout - 1) / k_fanout;
+    size_t parent_last = last / k_fanout;
+    if (static_cast<size_t>(level) == levels_.size()
+        || parent_first >= parent_last) {
+      addNodes(level, first, last, &counts);
+      break;
+    }
+    addNodes(level, first, parent_first * k_fanout, &counts);
+    addNodes(level, parent_last * k_fanout, last, &counts);
+    first = parent_first;
+    last = parent_last;
+  }
+  return counts;
+}
+
+double HistogramIndex::entropy(size_t start, size_t end) const {
+  return analysis::entropy(histogram(start, end), end - start);
+}
+
+double HistogramIndex::mean(size_t start, size_t end) const {
+  if (start == end) {
+    return 0;
+  }
+  auto counts = histogram(start, end);
+  uint64_t sum = 0;
+  for (int value = 0; value < 256; ++value) {
+    sum += counts[value] * value;
+  }
+  return static_cast<double>(sum) / (end - start);
+}
+
+/*****************************************************************************/
+/* Private methods */
+/*****************************************************************************/
+
+void HistogramIndex::addNodes(int level, size_t first, size_t last,
+                              analysis::ByteHistogram *counts) const {
+  for (size_t node = first; node < last; ++node) {
+    if (level == 0) {
+      const uint16_t *node_counts = leaves_.data() + node * 256;
+      for (int value = 0; value < 256; ++value) {
+        (*counts)[value] += node_counts[value];
+      }
+    } else {
+      const uint64_t *node_counts = levels_[level - 1].data() + node * 256;
+      for (int value = 0; value < 256; ++value) {
+        (*counts)[value] += node_counts[value];
+      }
+    }
+  }
+}
+
+void HistogramIndex::addBytes(size_t start, size_t end,
+                              analysis::ByteHistogram *counts) const {
+  auto bytes = analysis::byteHistogram(
+      reinterpret_cast<const uint8_t *>(data_.constData()) + start,
+      end - start);
+  for (int value = 0; value < 256; ++value) {
+    (*counts)[value] += bytes[value];
+  }
+}
+
+}  // namespace util
+}  // namespace veles
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+
+#include "util/analysis.h"
+#include "util/concurrency/parallel.h"
+#include "util/sampling/entropy_sampler.h"
+
+
+namespace veles {
+namespace util {
+
+// Weight of a block with no information at all, compared to 8 for random
+// data.
+const double k_base_weight = 0.25;
+
+/*****************************************************************************/
+/* Public methods */
+/*****************************************************************************/
+
+EntropySampler::EntropySampler(const QByteArray &data) :
+    WindowedSampler(data) {}
+
+EntropySampler::~EntropySampler() {
+  stopResampling();
+}
+
+/*****************************************************************************/
+/* Private methods */
+/*****************************************************************************/
+
+EntropySampler::EntropySampler(const EntropySampler& other) :
+    WindowedSampler(other) {}
+
+std::vector<double> EntropySampler::blockEntropies(SamplerConfig *sc,
+                                                   size_t block_size,
+                                                   size_t blocks) {
+  size_t data_size = getDataSize(sc);
+  auto raw_data = reinterpret_cast<const uint8_t *>(getRawData(sc));
+  std::vector<double> entropies(blocks);
+  threadpool::parallelFor("visualisation", 0, blocks, 64,
+                          [&](size_t begin, size_t end) {
+    for (size_t block = begin; block < end; ++block) {
+      size_t block_start = block * block_size;
+      size_t length = std::min(block_size, data_size - block_start);
+      size_t probe_size = std::min(length, k_probe_size * k_probes) / k_probes;
+      analysis::ByteHistogram counts = {};
+      uint64_t total = 0;
+      for (size_t probe = 0; probe < k_probes; ++probe) {
+        size_t offset = block_start + (length - probe_size) * probe
+                        / (k_probes - 1);
+        auto probe_counts = analysis::byteHistogram(raw_data + offset,
+                                                    probe_size);
+        for (int i = 0; i < 256; ++i) {
+          counts[i] += probe_counts[i];
+        }
+        total += probe_size;
+      }
+      entropies[block] = analysis::entropy(counts, total);
+    }
+  });
+  return entropies;
+}
+
+ISampler::ResampleData* EntropySampler::prepareResample(SamplerConfig *sc) {
+  size_t data_size = getDataSize(sc);
+  size_t size = getRequestedSampleSize(sc);
+  size_t window_size = std::max(static_cast<size_t>(1),
+                                static_cast<size_t>(floor(sqrt(size))));
+  size_t windows_count = size / window_size;
+
+  size_t blocks = std::max(static_cast<size_t>(1), std::min(
+      static_cast<size_t>(k_max_blocks),
+      data_size / (window_size * k_min_windows_per_block)));
+  size_t block_size = (data_size - 1) / blocks + 1;
+  blocks = (data_size - 1) / block_size + 1;
+  auto entropies = blockEntropies(sc, block_size, blocks);
+  if (resampleCancelled(sc)) {
+    return nullptr;
+  }
+
+  // Every block gets its share of windows (rounded down), as far as it has
+  // room for them.  The rest goes to blocks with the largest remainders.
+  std::vector<size_t> room(blocks), count(blocks);
+  std::vector<double> share(blocks);
+  size_t total_room = 0;
+  double total_weight = 0;
+  for (size_t block = 0; block < blocks; ++block) {
+    size_t length = std::min(block_size, data_size - block * block_size);
+    room[block] = length / window_size;
+    total_room += room[block];
+    share[block] = (entropies[block] + k_base_weight) * length;
+    total_weight += share[block];
+  }
+  windows_count = std::min(windows_count, total_room);
+  size_t assigned = 0;
+  for (size_t block = 0; block < blocks; ++block) {
+    share[block] *= windows_count / total_weight;
+    count[block] = std::min(room[block],
+                            static_cast<size_t>(share[block]));
+    assigned += count[block];
+  }
+  std::vector<size_t> order(blocks);
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    return share[a] - count[a] > share[b] - count[b];
+  });
+  while (assigned < windows_count) {
+    for (auto block : order) {
+      if (assigned < windows_count && count[block] < room[block]) {
+        count[block]++;
+        assigned++;
+      }
+    }
+  }
+
+  // Within blocks, windows are drawn like in UniformSampler.
+  std::vector<size_t> first(blocks);
+  for (size_t block = 1; block < blocks; ++block) {
+    first[block] = first[block - 1] + count[block - 1];
+  }
+  std::vector<size_t> windows(windows_count);
+  threadpool::parallelFor("visualisation", 0, blocks, 64,
+                          [&](size_t begin, size_t end) {
+    for (size_t block = begin; block < end; ++block) {
+      size_t block_start = block * block_size;
+      size_t length = std::min(block_size, data_size - block_start);
+      auto block_windows = windows.begin() + first[block];
+      std::seed_seq seed{static_cast<uint32_t>(block)};
+      std::default_random_engine generator(seed);
+      std::uniform_int_distribution<size_t> distribution(
+          0, length - count[block] * window_size);
+      for (size_t i = 0; i < count[block]; ++i) {
+        block_windows[i] = distribution(generator);
+      }
+      std::sort(block_windows, block_windows + count[block]);
+      for (size_t i = 0; i < count[block]; ++i) {
+        block_windows[i] += block_start + i * window_size;
+      }
+    }
+  });
+
+  char *tmp_buffer = gatherWindows(sc, windows, window_size);
+  if (tmp_buffer == nullptr) {
+    return nullptr;
+  }
+
+  WindowedResampleData *rd = new WindowedResampleData;
+  rd->window_size = window_size;
+  rd->windows_count = windows_count;
+  rd->windows = std::move(windows);
+  rd->data = tmp_buffer;
+  return rd;
+}
+
+void EntropySampler::applyResample(ResampleData *rd) {
+  WindowedResampleData *wrd = static_cast<WindowedResampleData*>(rd);
+  applyWindows(wrd);
+  delete wrd;
+}
+
+void EntropySampler::cleanupResample(ResampleData *rd) {
+  if (rd == nullptr) return;
+  WindowedResampleData *wrd = static_cast<WindowedResampleData*>(rd);
+  delete[] wrd->data;
+  delete wrd;
+}
+
+EntropySampler* EntropySampler::cloneImpl() {
+  return new EntropySampler(*this);
+}
+
+}  // namespace util
+}  // namespace veles
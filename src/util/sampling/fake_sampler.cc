@@ -51,5 +51,9 @@ void FakeSampler::applyResample(ISampler::ResampleData *rd) {}
 
 void FakeSampler::cleanupResample(ResampleData *rd) {};
 
+SampleSnapshot::Layout FakeSampler::getSampleLayout() {
+  return SampleSnapshot::unsampled(getRawData(), getDataSize());
+}
+
 }  // namespace util
 }  // namespace veles
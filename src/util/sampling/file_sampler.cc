@@ -0,0 +1,127 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+
+#include <QFile>
+
+#ifdef Q_OS_UNIX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "util/sampling/file_sampler.h"
+
+
+namespace veles {
+namespace util {
+
+class FileSampler::File {
+ public:
+  explicit File(const QString &path) : file_(path), size_(0) {
+    if (file_.open(QIODevice::ReadOnly)) {
+      size_ = static_cast<size_t>(file_.size());
+    }
+  }
+
+  size_t size() const { return size_; }
+
+  // Hints that [offset, offset + length) is going to be read soon.
+  void willRead(size_t offset, size_t length) {
+#if defined(Q_OS_UNIX) && defined(POSIX_FADV_WILLNEED)
+    posix_fadvise(file_.handle(), static_cast<off_t>(offset),
+                  static_cast<off_t>(length), POSIX_FADV_WILLNEED);
+#else
+    (void)offset;
+    (void)length;
+#endif
+  }
+
+  // Reads length bytes at offset to buffer, filling whatever can't be read
+  // (past the end, or on errors) with zeros.
+  void read(size_t offset, size_t length, char *buffer) {
+    size_t done = 0;
+#ifdef Q_OS_UNIX
+    while (done < length) {
+      ssize_t res = pread(file_.handle(), buffer + done, length - done,
+                          static_cast<off_t>(offset + done));
+      if (res < 0 && errno == EINTR) continue;
+      if (res <= 0) break;
+      done += static_cast<size_t>(res);
+    }
+#else
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (file_.seek(static_cast<qint64>(offset))) {
+        qint64 res = file_.read(buffer, static_cast<qint64>(length));
+        done = res > 0 ? static_cast<size_t>(res) : 0;
+      }
+    }
+#endif
+    memset(buffer + done, 0, length - done);
+  }
+
+ private:
+  QFile file_;
+  size_t size_;
+#ifndef Q_OS_UNIX
+  // QFile has a single position.
+  std::mutex mutex_;
+#endif
+};
+
+/*****************************************************************************/
+/* Public methods */
+/*****************************************************************************/
+
+FileSampler::FileSampler(const QString &path) :
+    FileSampler(std::make_shared<File>(path)) {}
+
+FileSampler::~FileSampler() {
+  stopResampling();
+}
+
+/*****************************************************************************/
+/* Private methods */
+/*****************************************************************************/
+
+FileSampler::FileSampler(std::shared_ptr<File> file) :
+    UniformSampler(file->size()), file_(file) {}
+
+FileSampler::FileSampler(const FileSampler& other) :
+    UniformSampler(other), file_(other.file_) {}
+
+void FileSampler::readWindows(SamplerConfig *sc, const size_t *windows,
+                              size_t count, size_t window_size,
+                              char *buffer) {
+  for (size_t i = 0; i < count; ++i) {
+    file_->willRead(sc->start + windows[i], window_size);
+  }
+  for (size_t i = 0; i < count; ++i) {
+    if (resampleCancelled(sc)) return;
+    file_->read(sc->start + windows[i], window_size,
+                buffer + i * window_size);
+  }
+}
+
+FileSampler* FileSampler::cloneImpl() {
+  return new FileSampler(*this);
+}
+
+}  // namespace util
+}  // namespace veles
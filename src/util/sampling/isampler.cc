@@ -23,23 +23,34 @@
 namespace veles {
 namespace util {
 
+// What samplers without data in memory refer to.
+static const QByteArray k_no_data;
+
 /*****************************************************************************/
 /* Public methods */
 /*****************************************************************************/
 
 ISampler::ISampler(const QByteArray &data) :
-    data_(data), start_(0), sample_size_(0),
+    data_(data), data_size_(static_cast<size_t>(data.size())),
+    in_memory_(true), start_(0), sample_size_(0),
     allow_async_(false), current_version_(0),
-    requested_version_(0), next_cb_id_(0) {
-  end_ = static_cast<size_t>(data_.size());
+    requested_version_(0), pending_config_(nullptr),
+    resample_scheduled_(false), next_cb_id_(0),
+    snapshot_(std::make_shared<SampleSnapshot>()) {
+  end_ = data_size_;
   last_config_.start = start_;
   last_config_.end = end_;
   last_config_.sample_size = sample_size_;
+  last_config_.version = 0;
+}
+
+ISampler::~ISampler() {
+  stopResampling();
 }
 
 void ISampler::setRange(size_t start, size_t end) {
   assert(!empty());
-  assert(end <= static_cast<size_t>(data_.size()));
+  assert(end <= data_size_);
   auto lc = lock();
   last_config_.start = start;
   last_config_.end = end;
@@ -74,7 +85,7 @@ size_t ISampler::getSampleSize() {
 size_t ISampler::getFileOffset(size_t index) {
   assert(!empty());
   auto lc = lock();
-  size_t sample_s = getRequestedSampleSize();
+  size_t sample_s = getSampleSize();
   assert(index <= sample_s);
   if (index == 0) return start_;
   if (index == sample_s - 1) return end_ - 1;
@@ -101,7 +112,7 @@ size_t ISampler::getSampleOffset(size_t index) {
 char ISampler::operator[](size_t index) {
   assert(!empty());
   auto lc = lock();
-  assert(index < getRequestedSampleSize());
+  assert(index < getSampleSize());
   if (!samplingRequired()) {
     return getDataByte(index);
   }
@@ -117,8 +128,12 @@ const char* ISampler::data() {
   return getData();
 }
 
+std::shared_ptr<const SampleSnapshot> ISampler::snapshot() {
+  return std::atomic_load(&snapshot_);
+}
+
 bool ISampler::empty() {
-  return data_.isEmpty();
+  return data_size_ == 0;
 }
 
 std::unique_lock<SamplerMutex> ISampler::lock() {
@@ -176,22 +191,39 @@ void ISampler::allowAsynchronousResampling(bool allow) {
 /* Protected methods */
 /*****************************************************************************/
 
+ISampler::ISampler(size_t data_size) :
+    data_(k_no_data), data_size_(data_size), in_memory_(false), start_(0),
+    end_(data_size), sample_size_(0), allow_async_(false),
+    current_version_(0), requested_version_(0), pending_config_(nullptr),
+    resample_scheduled_(false), next_cb_id_(0),
+    snapshot_(std::make_shared<SampleSnapshot>()) {
+  last_config_.start = start_;
+  last_config_.end = end_;
+  last_config_.sample_size = sample_size_;
+  last_config_.version = 0;
+}
+
 ISampler::ISampler(const ISampler& other) : data_(other.data_),
+                   data_size_(other.data_size_),
+                   in_memory_(other.in_memory_),
                    start_(other.start_), end_(other.end_),
                    sample_size_(other.sample_size_),
                    allow_async_(other.allow_async_),
                    last_config_(other.last_config_),
                    current_version_(0), requested_version_(0),
-                   callbacks_(other.callbacks_) {}
+                   pending_config_(nullptr), resample_scheduled_(false),
+                   callbacks_(other.callbacks_),
+                   snapshot_(std::atomic_load(&other.snapshot_)) {}
 
 size_t ISampler::getDataSize(SamplerConfig *sc) {
   if (sc == nullptr) {
-    return std::min((size_t)data_.size(), end_ - start_);
+    return std::min(data_size_, end_ - start_);
   }
-  return std::min((size_t)data_.size(), sc->end - sc->start);
+  return std::min(data_size_, sc->end - sc->start);
 }
 
 char ISampler::getDataByte(size_t index, SamplerConfig *sc) {
+  assert(in_memory_);
   size_t start = (sc == nullptr) ? start_ : sc->start;
   return data_[static_cast<int>(start + index)];
 }
@@ -206,16 +238,35 @@ size_t ISampler::getRequestedSampleSize(SamplerConfig *sc) {
 }
 
 const char* ISampler::getRawData(SamplerConfig *sc) {
+  assert(in_memory_);
   size_t start = (sc == nullptr) ? start_ : sc->start;
   return data_.data() + start;
 }
 
+bool ISampler::resampleCancelled(SamplerConfig *sc) {
+  return allow_async_ && sc != nullptr
+      && sc->version != requested_version_.load();
+}
+
+void ISampler::stopResampling() {
+  // Makes resampleCancelled() true for the one in progress - before taking
+  // the lock, which its caller may hold (see runResample()).
+  ++requested_version_;
+  auto lc = lock();
+  delete pending_config_;
+  pending_config_ = nullptr;
+  while (resample_scheduled_) {
+    sampler_condition_.wait(lc);
+  }
+}
+
 /*****************************************************************************/
 /* Private methods */
 /*****************************************************************************/
 
 size_t ISampler::samplingRequired(SamplerConfig *sc) {
-  return ((!empty()) && getRequestedSampleSize(sc) < getDataSize(sc));
+  return ((!empty()) && (!in_memory_
+                         || getRequestedSampleSize(sc) < getDataSize(sc)));
 }
 
 void ISampler::applySamplerConfig(SamplerConfig *sc) {
@@ -228,48 +279,82 @@ void ISampler::applySamplerConfig(SamplerConfig *sc) {
 
 void ISampler::runResample(SamplerConfig *sc) {
   if (allow_async_) {
+    auto lc = lock();
+    sc->version = ++requested_version_;
+    // Whatever was waiting is outdated now.
+    delete pending_config_;
+    pending_config_ = nullptr;
     if (!samplingRequired(sc)) {
-      auto lc = lock();
-      current_version_ = ++requested_version_;
+      current_version_ = sc->version;
       applySamplerConfig(sc);
+      publishSnapshot();
       for (auto i = callbacks_.rbegin(); i != callbacks_.rend(); ++i) {
         (i->second)();
       }
       lc.unlock();
       delete sc;
+      sampler_condition_.notify_all();
       return;
     }
-    threadpool::runTask("visualisation",
-      std::bind(&ISampler::resampleAsync, this, ++requested_version_, sc));
+    pending_config_ = sc;
+    if (!resample_scheduled_) {
+      resample_scheduled_ = true;
+      if (threadpool::runTask("visualisation",
+              std::bind(&ISampler::resampleAsync, this))
+          != threadpool::SchedulingResult::SCHEDULED) {
+        resampleAsync();
+      }
+    }
   } else {
     if (samplingRequired(sc)) {
       ResampleData *prepared = prepareResample(sc);
       applyResample(prepared);
     }
     applySamplerConfig(sc);
+    publishSnapshot();
     delete sc;
   }
 }
 
-void ISampler::resampleAsync(int target_version, SamplerConfig *sc) {
-  if (target_version < requested_version_.load()) return;
-  ResampleData *prepared = prepareResample(sc);
+void ISampler::resampleAsync() {
   auto lc = lock();
-  if (target_version > current_version_) {
-    applyResample(prepared);
-    applySamplerConfig(sc);
-    current_version_ = target_version;
-    for (auto i = callbacks_.rbegin(); i != callbacks_.rend(); ++i) {
-      (i->second)();
-    }
+  while (pending_config_ != nullptr) {
+    SamplerConfig *sc = pending_config_;
+    pending_config_ = nullptr;
     lc.unlock();
+    ResampleData *prepared = prepareResample(sc);
+    lc.lock();
+    if (sc->version == requested_version_.load()) {
+      applyResample(prepared);
+      applySamplerConfig(sc);
+      publishSnapshot();
+      current_version_ = sc->version;
+      for (auto i = callbacks_.rbegin(); i != callbacks_.rend(); ++i) {
+        (i->second)();
+      }
+      sampler_condition_.notify_all();
+    } else {
+      cleanupResample(prepared);
+    }
     delete sc;
-    sampler_condition_.notify_all();
+  }
+  resample_scheduled_ = false;
+  // For stopResampling().
+  sampler_condition_.notify_all();
+}
+
+void ISampler::publishSnapshot() {
+  std::shared_ptr<const SampleSnapshot> snapshot;
+  if (empty()) {
+    snapshot = std::make_shared<SampleSnapshot>();
+  } else if (!samplingRequired()) {
+    snapshot = std::make_shared<SampleSnapshot>(
+        start_, end_, SampleSnapshot::unsampled(getRawData(), getDataSize()));
   } else {
-    lc.unlock();
-    cleanupResample(prepared);
-    delete sc;
+    snapshot = std::make_shared<SampleSnapshot>(start_, end_,
+                                                getSampleLayout());
   }
+  std::atomic_store(&snapshot_, snapshot);
 }
 
 }  // namespace util
@@ -0,0 +1,146 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <utility>
+
+#include "util/sampling/pyramid_sampler.h"
+
+
+namespace veles {
+namespace util {
+
+/*****************************************************************************/
+/* Public methods */
+/*****************************************************************************/
+
+PyramidSampler::PyramidSampler(const QByteArray &data,
+                               std::shared_ptr<const void> owner) :
+    ISampler(data), pyramid_(SamplePyramid::forData(data, std::move(owner))),
+    slice_start_(0) {
+  slice_.first = 0;
+  slice_.count = 0;
+}
+
+PyramidSampler::~PyramidSampler() {
+  stopResampling();
+}
+
+/*****************************************************************************/
+/* Private methods */
+/*****************************************************************************/
+
+PyramidSampler::PyramidSampler(const PyramidSampler& other) :
+    ISampler(other), pyramid_(other.pyramid_), slice_(other.slice_),
+    slice_start_(other.slice_start_) {}
+
+char PyramidSampler::getSampleByte(size_t index) {
+  return slice_.data()[index];
+}
+
+const char* PyramidSampler::getData() {
+  return slice_.data();
+}
+
+size_t PyramidSampler::getRealSampleSize() {
+  return slice_.level ? slice_.size() : 0;
+}
+
+size_t PyramidSampler::getFileOffsetImpl(size_t index) {
+  size_t window_size = slice_.level->window_size;
+  return slice_.window(index / window_size) + index % window_size
+      - slice_start_;
+}
+
+size_t PyramidSampler::getSampleOffsetImpl(size_t address) {
+  // we want the last window less or equal to address (or first window if
+  // no such window exists)
+  address += slice_start_;
+  auto windows_begin = slice_.level->windows.begin() + slice_.first;
+  auto windows_end = windows_begin + slice_.count;
+  if (address < *windows_begin) return 0;
+  auto previous_window = std::upper_bound(windows_begin, windows_end, address);
+  if (previous_window != windows_begin) --previous_window;
+  size_t window_size = slice_.level->window_size;
+  size_t base_index = static_cast<size_t>(
+    std::distance(windows_begin, previous_window) * window_size);
+  return base_index + std::min(window_size - 1, address - (*previous_window));
+}
+
+ISampler::ResampleData* PyramidSampler::prepareResample(SamplerConfig *sc) {
+  size_t data_size = getDataSize(sc);
+  size_t size = getRequestedSampleSize(sc);
+  PyramidSamplerResampleData *rd = new PyramidSamplerResampleData;
+  rd->start = sc->start;
+
+  // Data under the pyramid's smallest window has no levels at all.
+  int level = std::min(1, pyramid_->levels());
+  while (level < pyramid_->levels() && (data_size >> (level + 1)) >= size) {
+    level++;
+  }
+  for (; level > 0; --level) {
+    rd->slice = pyramid_->slice(level, sc->start, sc->end);
+    if (rd->slice.count > 0) {
+      return rd;
+    }
+  }
+
+  // The range is too small for the pyramid, take its beginning.
+  auto beginning = std::make_shared<SamplePyramid::Level>();
+  beginning->window_size = size;
+  beginning->windows.push_back(sc->start);
+  beginning->bytes.resize(size);
+  memcpy(beginning->bytes.data(), getRawData(sc), size);
+  rd->slice.level = beginning;
+  rd->slice.first = 0;
+  rd->slice.count = 1;
+  return rd;
+}
+
+void PyramidSampler::applyResample(ResampleData *rd) {
+  PyramidSamplerResampleData *psrd =
+    static_cast<PyramidSamplerResampleData*>(rd);
+  slice_ = psrd->slice;
+  slice_start_ = psrd->start;
+  delete psrd;
+}
+
+void PyramidSampler::cleanupResample(ResampleData *rd) {
+  delete static_cast<PyramidSamplerResampleData*>(rd);
+}
+
+PyramidSampler* PyramidSampler::cloneImpl() {
+  return new PyramidSampler(*this);
+}
+
+SampleSnapshot::Layout PyramidSampler::getSampleLayout() {
+  if (!slice_.level) {
+    return SampleSnapshot::unsampled(nullptr, 0);
+  }
+  SampleSnapshot::Layout layout;
+  layout.data = slice_.data();
+  layout.size = slice_.size();
+  layout.window_size = slice_.level->window_size;
+  layout.window_base = 0;
+  layout.windows = slice_.level->windows.data() + slice_.first;
+  layout.owner = slice_.level;
+  return layout;
+}
+
+}  // namespace util
+}  // namespace veles
@@ -0,0 +1,187 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "util/concurrency/parallel.h"
+#include "util/sampling/sample_pyramid.h"
+
+
+namespace veles {
+namespace util {
+
+std::mutex SamplePyramid::registry_mutex_;
+std::map<std::pair<const char*, int>, std::weak_ptr<SamplePyramid>>
+    SamplePyramid::registry_;
+
+// Decides which half of a group is kept on the next level.
+static bool pickSecond(int level, size_t group) {
+  // splitmix64 finalizer
+  uint64_t x = group ^ (static_cast<uint64_t>(level) << 56);
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return (x ^ (x >> 31)) & 1;
+}
+
+/*****************************************************************************/
+/* Public methods */
+/*****************************************************************************/
+
+SamplePyramid::SamplePyramid(const QByteArray &data,
+                             std::shared_ptr<const void> owner) :
+    data_(data), owner_(std::move(owner)), levels_(0) {
+  groups_.push_back(static_cast<size_t>(data_.size()) / k_window_size);
+  while (groups_.back() > 1
+         && groups_.back() * k_window_size > k_min_level_size) {
+    groups_.push_back((groups_.back() + 1) / 2);
+    levels_++;
+  }
+  if (levels_ == 0 && groups_.back() > 1) {
+    groups_.push_back((groups_.back() + 1) / 2);
+    levels_++;
+  }
+  stored_.resize(levels_ + 1);
+  building_.resize(levels_ + 1, false);
+}
+
+std::shared_ptr<SamplePyramid> SamplePyramid::forData(
+    const QByteArray &data, std::shared_ptr<const void> owner) {
+  auto key = std::make_pair(data.constData(), data.size());
+  std::shared_ptr<SamplePyramid> pyramid;
+  {
+    std::lock_guard<std::mutex> lock(registry_mutex_);
+    auto found = registry_.find(key);
+    if (found != registry_.end()) {
+      pyramid = found->second.lock();
+      if (pyramid) {
+        return pyramid;
+      }
+    }
+    for (auto i = registry_.begin(); i != registry_.end();) {
+      if (i->second.expired()) {
+        i = registry_.erase(i);
+      } else {
+        ++i;
+      }
+    }
+    pyramid = std::make_shared<SamplePyramid>(data, std::move(owner));
+    registry_[key] = pyramid;
+  }
+
+  // The task doesn't keep the pyramid alive, so that closing the last panel
+  // using it stops the build after the current level.
+  std::weak_ptr<SamplePyramid> weak_pyramid = pyramid;
+  int levels = pyramid->levels();
+  threadpool::runTask("visualisation", [weak_pyramid, levels]() {
+    for (int level = levels; level > 0; --level) {
+      auto pyramid = weak_pyramid.lock();
+      if (!pyramid) return;
+      if (pyramid->stored(level)) {
+        pyramid->storedLevel(level);
+      }
+    }
+  });
+  return pyramid;
+}
+
+SamplePyramid::Slice SamplePyramid::slice(int level, size_t start,
+                                          size_t end) {
+  std::shared_ptr<const Level> windows;
+  if (stored(level)) {
+    windows = storedLevel(level);
+  } else {
+    size_t group_size = k_window_size << level;
+    windows = gather(level, start / group_size,
+                     std::min(groups_[level], (end - 1) / group_size + 1));
+  }
+  // Windows have to fit in the range as a whole.
+  auto first = std::lower_bound(windows->windows.begin(),
+                                windows->windows.end(), start);
+  auto last = first;
+  if (end >= start + k_window_size) {
+    last = std::upper_bound(first, windows->windows.end(),
+                            end - k_window_size);
+  }
+  Slice result;
+  result.level = windows;
+  result.first = static_cast<size_t>(first - windows->windows.begin());
+  result.count = static_cast<size_t>(last - first);
+  return result;
+}
+
+bool SamplePyramid::stored(int level) const {
+  return groups_[level] * k_window_size <= k_max_level_size;
+}
+
+/*****************************************************************************/
+/* Private methods */
+/*****************************************************************************/
+
+size_t SamplePyramid::pick(int level, size_t group) const {
+  for (; level > 0; --level) {
+    size_t child = 2 * group;
+    if (pickSecond(level, group) && child + 1 < groups_[level - 1]) {
+      child++;
+    }
+    group = child;
+  }
+  return group;
+}
+
+std::shared_ptr<const SamplePyramid::Level> SamplePyramid::gather(
+    int level, size_t first_group, size_t last_group) const {
+  auto result = std::make_shared<Level>();
+  size_t count = last_group - first_group;
+  result->window_size = k_window_size;
+  result->windows.resize(count);
+  result->bytes.resize(count * k_window_size);
+  const char *data = data_.constData();
+  Level *windows = result.get();
+  threadpool::parallelFor("visualisation", 0, count, k_groups_per_chunk,
+                          [=](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      size_t offset = pick(level, first_group + i) * k_window_size;
+      windows->windows[i] = offset;
+      memcpy(windows->bytes.data() + i * k_window_size, data + offset,
+             k_window_size);
+    }
+  });
+  return result;
+}
+
+std::shared_ptr<const SamplePyramid::Level> SamplePyramid::storedLevel(
+    int level) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (building_[level]) {
+    level_built_.wait(lock);
+  }
+  if (stored_[level]) {
+    return stored_[level];
+  }
+  building_[level] = true;
+  lock.unlock();
+  auto windows = gather(level, 0, groups_[level]);
+  lock.lock();
+  stored_[level] = windows;
+  building_[level] = false;
+  level_built_.notify_all();
+  return windows;
+}
+
+}  // namespace util
+}  // namespace veles
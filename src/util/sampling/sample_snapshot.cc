@@ -0,0 +1,107 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <algorithm>
+#include <cassert>
+
+#include "util/sampling/sample_snapshot.h"
+
+
+namespace veles {
+namespace util {
+
+// Owner of windowed layouts.
+struct WindowedSample {
+  std::shared_ptr<const char> data;
+  std::vector<size_t> windows;
+};
+
+/*****************************************************************************/
+/* Public methods */
+/*****************************************************************************/
+
+SampleSnapshot::Layout SampleSnapshot::unsampled(const char *data,
+                                                 size_t size) {
+  Layout layout;
+  layout.data = data;
+  layout.size = size;
+  layout.window_size = 0;
+  layout.window_base = 0;
+  layout.windows = nullptr;
+  return layout;
+}
+
+SampleSnapshot::Layout SampleSnapshot::windowed(
+    std::shared_ptr<const char> data, size_t size, size_t window_size,
+    size_t window_base, std::vector<size_t> windows) {
+  auto sample = std::make_shared<WindowedSample>();
+  sample->data = std::move(data);
+  sample->windows = std::move(windows);
+  Layout layout;
+  layout.data = sample->data.get();
+  layout.size = size;
+  layout.window_size = window_size;
+  layout.window_base = window_base;
+  layout.windows = sample->windows.data();
+  layout.owner = sample;
+  return layout;
+}
+
+SampleSnapshot::SampleSnapshot() :
+    start_(0), end_(0), layout_(unsampled(nullptr, 0)) {}
+
+SampleSnapshot::SampleSnapshot(size_t start, size_t end, Layout layout) :
+    start_(start), end_(end), layout_(std::move(layout)) {}
+
+size_t SampleSnapshot::getFileOffset(size_t index) const {
+  assert(!empty());
+  assert(index <= layout_.size);
+  if (index == 0) return start_;
+  if (index == layout_.size - 1) return end_ - 1;
+  if (index == layout_.size) return end_;
+  if (layout_.window_size == 0) {
+    return start_ + index;
+  }
+  return layout_.window_base + layout_.windows[index / layout_.window_size]
+      + index % layout_.window_size;
+}
+
+size_t SampleSnapshot::getSampleOffset(size_t address) const {
+  assert(!empty());
+  assert(address >= start_);
+  assert(address < end_);
+  if (address == start_) return 0;
+  if (address == end_ - 1) return layout_.size - 1;
+  if (layout_.window_size == 0) {
+    return address - start_;
+  }
+  // we want the last window less or equal to address (or first window if
+  // no such window exists)
+  size_t offset = address - layout_.window_base;
+  const size_t *windows_end =
+      layout_.windows + layout_.size / layout_.window_size;
+  if (offset < layout_.windows[0]) return 0;
+  const size_t *previous_window = std::upper_bound(layout_.windows,
+                                                   windows_end, offset);
+  if (previous_window != layout_.windows) --previous_window;
+  size_t base_index = static_cast<size_t>(previous_window - layout_.windows)
+      * layout_.window_size;
+  return base_index + std::min(layout_.window_size - 1,
+                               offset - *previous_window);
+}
+
+}  // namespace util
+}  // namespace veles
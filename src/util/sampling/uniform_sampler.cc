@@ -17,11 +17,12 @@
 #include <algorithm>
 #include <cmath>
 #include <cstdlib>
-#include <iterator>
+#include <numeric>
 #include <random>
 #include <set>
 
 #include "util/sampling/uniform_sampler.h"
+#include "util/concurrency/parallel.h"
 
 
 namespace veles {
@@ -32,13 +33,15 @@ namespace util {
 /*****************************************************************************/
 
 UniformSampler::UniformSampler(const QByteArray &data) :
-    ISampler(data), window_size_(0), use_default_window_size_(true),
-    buffer_(nullptr) {}
+    WindowedSampler(data), use_default_window_size_(true), incremental_(false), seed_(0),
+    drawn_start_(0), drawn_seed_(0), drawn_window_size_(0) {}
+
+UniformSampler::UniformSampler(size_t data_size) :
+    WindowedSampler(data_size), use_default_window_size_(true), incremental_(false), seed_(0),
+    drawn_start_(0), drawn_seed_(0), drawn_window_size_(0) {}
 
 UniformSampler::~UniformSampler() {
-  if (buffer_ != nullptr) {
-    delete[] buffer_;
-  }
+  stopResampling();
 }
 
 void UniformSampler::setWindowSize(size_t size) {
@@ -48,45 +51,30 @@ void UniformSampler::setWindowSize(size_t size) {
   resample();
 }
 
-/*****************************************************************************/
-/* Private methods */
-/*****************************************************************************/
-
-UniformSampler::UniformSampler(const UniformSampler& other) :
-    ISampler(other), window_size_(other.window_size_), buffer_(nullptr) {}
-
-char UniformSampler::getSampleByte(size_t index) {
-  if (buffer_ != nullptr) {
-    return buffer_[index];
-  }
-  size_t base_index = windows_[index / window_size_];
-  return getDataByte(base_index + (index % window_size_));
+void UniformSampler::setSeed(uint32_t seed) {
+  auto lc = waitAndLock();
+  seed_ = seed;
+  resample();
 }
 
-const char* UniformSampler::getData() {
-  return buffer_;
+void UniformSampler::setIncrementalResampling(bool incremental) {
+  auto lc = waitAndLock();
+  incremental_ = incremental;
 }
 
-size_t UniformSampler::getRealSampleSize() {
-  return window_size_ * windows_count_;
-}
+/*****************************************************************************/
+/* Protected methods */
+/*****************************************************************************/
 
-size_t UniformSampler::getFileOffsetImpl(size_t index) {
-  size_t base_index = windows_[index / window_size_];
-  return base_index + (index % window_size_);
-}
+UniformSampler::UniformSampler(const UniformSampler& other) :
+    WindowedSampler(other),
+    use_default_window_size_(other.use_default_window_size_),
+    incremental_(other.incremental_), seed_(other.seed_), drawn_start_(0),
+    drawn_seed_(0), drawn_window_size_(0) {}
 
-size_t UniformSampler::getSampleOffsetImpl(size_t address) {
-  // we want the last window less or equal to address (or first window if
-  // no such window exists)
-  if (address < windows_[0]) return 0;
-  auto previous_window = std::upper_bound(windows_.begin(), windows_.end(),
-                                          address);
-  if (previous_window != windows_.begin()) --previous_window;
-  size_t base_index = static_cast<size_t>(
-    std::distance(windows_.begin(), previous_window) * window_size_);
-  return base_index + std::min(window_size_ - 1, address - (*previous_window));
-}
+/*****************************************************************************/
+/* Private methods */
+/*****************************************************************************/
 
 ISampler::ResampleData* UniformSampler::prepareResample(SamplerConfig *sc) {
   size_t size = getRequestedSampleSize(sc);
@@ -95,7 +83,40 @@ ISampler::ResampleData* UniformSampler::prepareResample(SamplerConfig *sc) {
     window_size = (size_t)floor(sqrt(size));
   }
   size_t windows_count = size / window_size;
-  size = window_size * windows_count;
+  std::vector<size_t> windows;
+  std::vector<size_t> sources;
+
+  // Resamples of one sampler never overlap, so the current sample can't
+  // change under our feet.
+  bool reused = incremental_ && buffer_ != nullptr
+      && window_size == drawn_window_size_ && seed_ == drawn_seed_
+      && reuseWindows(sc, windows_count, &windows, &sources);
+  if (!reused) {
+    windows = drawWindows(getDataSize(sc), window_size, windows_count);
+  }
+
+  // Now let's create data array (it's more efficient to do it here,
+  // than later calculate values)
+  char *tmp_buffer = gatherWindows(sc, windows, window_size,
+                                   reused ? &sources : nullptr);
+  if (tmp_buffer == nullptr) {
+    return nullptr;
+  }
+
+  UniformSamplerResampleData *rd = new UniformSamplerResampleData;
+  rd->window_size = window_size;
+  rd->windows_count = windows_count;
+  rd->windows = std::move(windows);
+  rd->data = tmp_buffer;
+  rd->start = sc->start;
+  rd->seed = seed_;
+  return rd;
+}
+
+std::vector<size_t> UniformSampler::drawWindows(size_t data_size,
+                                                size_t window_size,
+                                                size_t windows_count,
+                                                size_t base) {
   std::vector<size_t> windows(windows_count);
 
   // Algorithm:
@@ -113,46 +134,159 @@ ISampler::ResampleData* UniformSampler::prepareResample(SamplerConfig *sc) {
   //   n - m*k + (m-1)*k = n - k
   //   which is exactly what we want because the piece length is k.
   // - For each i the distance d_{i+1}-d_i >= k.
-  size_t max_index = getDataSize(sc) - windows_count * window_size;
-  std::default_random_engine generator;
-  std::uniform_int_distribution<size_t> distribution(0, max_index);
-  for (size_t i = 0; i < windows_count; ++i) {
-    windows[i] = distribution(generator);
-  }
-  std::sort(windows.begin(), windows.end());
+  //
+  // Offsets are drawn in blocks with separately seeded generators, so that
+  // the result doesn't depend on how the blocks are split between threads.
+  size_t max_index = data_size - windows_count * window_size;
+  uint32_t seed = seed_;
+  threadpool::parallelFor("visualisation", 0, windows_count,
+                          k_windows_per_block,
+                          [&windows, max_index, seed, base](size_t begin,
+                                                            size_t end) {
+    std::seed_seq seq{seed, static_cast<uint32_t>(base),
+                      static_cast<uint32_t>(base >> 32),
+                      static_cast<uint32_t>(begin / k_windows_per_block)};
+    std::default_random_engine generator(seq);
+    std::uniform_int_distribution<size_t> distribution(0, max_index);
+    for (size_t i = begin; i < end; ++i) {
+      windows[i] = distribution(generator);
+    }
+  });
+  threadpool::parallelSort("visualisation", windows.begin(), windows.end(),
+                           k_windows_per_block);
   for (size_t i = 0; i < windows_count; ++i) {
     windows[i] += i * window_size;
   }
+  return windows;
+}
 
-  // Now let's create data array (it's more efficient to do it here,
-  // than later calculate values)
-  const char *raw_data = getRawData(sc);
-  char *tmp_buffer = new char[size];
-  for (size_t i = 0; i < size; ++i) {
-    size_t base_index = windows[i / window_size];
-    tmp_buffer[i] = raw_data[base_index + (i % window_size)];
+// A stable pseudo-random rank of the window at a given file offset.
+static uint64_t windowRank(uint64_t offset, uint32_t seed) {
+  // splitmix64 finalizer
+  uint64_t x = offset ^ (static_cast<uint64_t>(seed) << 32);
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+bool UniformSampler::reuseWindows(SamplerConfig *sc, size_t windows_count,
+                                  std::vector<size_t> *windows,
+                                  std::vector<size_t> *sources) {
+  size_t data_size = getDataSize(sc);
+  size_t window_size = drawn_window_size_;
+
+  // Current windows that are still in range, relative to the new start.
+  std::vector<size_t> kept, kept_index;
+  for (size_t i = 0; i < windows_count_; ++i) {
+    size_t offset = drawn_start_ + windows_[i];
+    if (offset >= sc->start && offset - sc->start + window_size <= data_size) {
+      kept.push_back(offset - sc->start);
+      kept_index.push_back(i);
+    }
+  }
+  if (kept.empty()) {
+    return false;
+  }
+  if (kept.size() > windows_count) {
+    // Too many - keep those ranked lowest, so that zooming in and out gives
+    // back the same windows.
+    std::vector<std::pair<uint64_t, size_t>> ranked;
+    for (size_t i = 0; i < kept.size(); ++i) {
+      ranked.emplace_back(windowRank(sc->start + kept[i], seed_), i);
+    }
+    std::nth_element(ranked.begin(), ranked.begin() + windows_count,
+                     ranked.end());
+    std::vector<size_t> chosen;
+    for (size_t i = 0; i < windows_count; ++i) {
+      chosen.push_back(ranked[i].second);
+    }
+    std::sort(chosen.begin(), chosen.end());
+    std::vector<size_t> chosen_kept, chosen_index;
+    for (auto i : chosen) {
+      chosen_kept.push_back(kept[i]);
+      chosen_index.push_back(kept_index[i]);
+    }
+    kept.swap(chosen_kept);
+    kept_index.swap(chosen_index);
   }
 
-  UniformSamplerResampleData *rd = new UniformSamplerResampleData;
-  rd->window_size = window_size;
-  rd->windows_count = windows_count;
-  rd->windows = std::move(windows);
-  rd->data = tmp_buffer;
-  return rd;
+  // Too few - new windows go to the gaps around the kept ones, gap i being
+  // the one just before kept window i (or the end of data).  Each gap gets
+  // a share of them proportional to its size, as far as it has room.
+  size_t gaps = kept.size() + 1;
+  std::vector<size_t> gap_begin(gaps), gap_end(gaps), room(gaps), count(gaps);
+  size_t total_room = 0, total_size = 0;
+  for (size_t i = 0; i < gaps; ++i) {
+    gap_begin[i] = i == 0 ? 0 : kept[i - 1] + window_size;
+    gap_end[i] = i < kept.size() ? kept[i] : data_size;
+    room[i] = (gap_end[i] - gap_begin[i]) / window_size;
+    total_room += room[i];
+    total_size += gap_end[i] - gap_begin[i];
+  }
+  size_t missing = windows_count - kept.size();
+  if (total_room < missing) {
+    return false;
+  }
+  size_t assigned = 0;
+  for (size_t i = 0; i < gaps && missing > 0; ++i) {
+    count[i] = std::min(room[i], static_cast<size_t>(
+        static_cast<double>(missing) * (gap_end[i] - gap_begin[i])
+        / total_size));
+    assigned += count[i];
+  }
+  std::vector<size_t> by_room(gaps);
+  std::iota(by_room.begin(), by_room.end(), 0);
+  std::sort(by_room.begin(), by_room.end(), [&](size_t a, size_t b) {
+    return room[a] - count[a] > room[b] - count[b];
+  });
+  while (assigned < missing) {
+    for (auto i : by_room) {
+      if (assigned < missing && count[i] < room[i]) {
+        count[i]++;
+        assigned++;
+      }
+    }
+  }
+
+  // Lay them out as [new in gap 0][kept 0][new in gap 1][kept 1]...
+  std::vector<size_t> first(gaps);
+  for (size_t i = 1; i < gaps; ++i) {
+    first[i] = first[i - 1] + count[i - 1] + 1;
+  }
+  windows->resize(windows_count);
+  sources->resize(windows_count);
+  size_t start = sc->start;
+  threadpool::parallelFor("visualisation", 0, gaps, k_gaps_per_task,
+                          [&, start, window_size](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      // The new windows only depend on where the gap is.
+      auto drawn = drawWindows(gap_end[i] - gap_begin[i], window_size,
+                               count[i], start + gap_begin[i]);
+      for (size_t j = 0; j < count[i]; ++j) {
+        (*windows)[first[i] + j] = gap_begin[i] + drawn[j];
+        (*sources)[first[i] + j] = k_new_window;
+      }
+      if (i < kept.size()) {
+        (*windows)[first[i] + count[i]] = kept[i];
+        (*sources)[first[i] + count[i]] = kept_index[i];
+      }
+    }
+  });
+  return true;
 }
 
 void UniformSampler::applyResample(ResampleData *rd) {
-  delete[] buffer_;
   UniformSamplerResampleData *usrd =
     static_cast<UniformSamplerResampleData*>(rd);
-  window_size_ = usrd->window_size;
-  windows_count_ = usrd->windows_count;
-  windows_ = std::move(usrd->windows);
-  buffer_ = usrd->data;
+  applyWindows(usrd);
+  drawn_start_ = usrd->start;
+  drawn_seed_ = usrd->seed;
+  drawn_window_size_ = usrd->window_size;
   delete usrd;
 }
 
 void UniformSampler::cleanupResample(ResampleData *rd) {
+  if (rd == nullptr) return;
   UniformSamplerResampleData *usrd =
     static_cast<UniformSamplerResampleData*>(rd);
   delete[] usrd->data;
@@ -0,0 +1,141 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+#include "util/sampling/windowed_sampler.h"
+#include "util/concurrency/parallel.h"
+
+
+namespace veles {
+namespace util {
+
+const size_t WindowedSampler::k_new_window;
+
+/*****************************************************************************/
+/* Protected methods */
+/*****************************************************************************/
+
+WindowedSampler::WindowedSampler(const QByteArray &data) :
+    ISampler(data), window_size_(0), windows_count_(0) {}
+
+WindowedSampler::WindowedSampler(size_t data_size) :
+    ISampler(data_size), window_size_(0), windows_count_(0) {}
+
+WindowedSampler::WindowedSampler(const WindowedSampler& other) :
+    ISampler(other), window_size_(other.window_size_), windows_count_(0) {}
+
+char* WindowedSampler::gatherWindows(SamplerConfig *sc,
+                                     const std::vector<size_t> &windows,
+                                     size_t window_size,
+                                     const std::vector<size_t> *sources) {
+  // Resamples of one sampler never overlap, so the current sample can't
+  // change under our feet.
+  const char *old_buffer = buffer_.get();
+  char *buffer = new char[windows.size() * window_size];
+  size_t grain = std::max(static_cast<size_t>(1),
+                          k_bytes_per_copy_chunk / window_size);
+  threadpool::parallelFor("visualisation", 0, windows.size(), grain,
+                          [=, &windows](size_t begin, size_t end) {
+    if (resampleCancelled(sc)) return;
+    size_t i = begin;
+    while (i < end) {
+      if (sources != nullptr && (*sources)[i] != k_new_window) {
+        memcpy(buffer + i * window_size,
+               old_buffer + (*sources)[i] * window_size, window_size);
+        ++i;
+        continue;
+      }
+      size_t new_end = i + 1;
+      while (new_end < end && (sources == nullptr
+                               || (*sources)[new_end] == k_new_window)) {
+        ++new_end;
+      }
+      readWindows(sc, windows.data() + i, new_end - i, window_size,
+                  buffer + i * window_size);
+      i = new_end;
+    }
+  });
+  if (resampleCancelled(sc)) {
+    delete[] buffer;
+    return nullptr;
+  }
+  return buffer;
+}
+
+void WindowedSampler::readWindows(SamplerConfig *sc, const size_t *windows,
+                                  size_t count, size_t window_size,
+                                  char *buffer) {
+  const char *raw_data = getRawData(sc);
+  for (size_t i = 0; i < count; ++i) {
+    memcpy(buffer + i * window_size, raw_data + windows[i], window_size);
+  }
+}
+
+void WindowedSampler::applyWindows(WindowedResampleData *rd) {
+  window_size_ = rd->window_size;
+  windows_count_ = rd->windows_count;
+  windows_ = std::move(rd->windows);
+  buffer_.reset(rd->data, std::default_delete<const char[]>());
+  rd->data = nullptr;
+}
+
+/*****************************************************************************/
+/* Private methods */
+/*****************************************************************************/
+
+char WindowedSampler::getSampleByte(size_t index) {
+  if (buffer_ != nullptr) {
+    return buffer_.get()[index];
+  }
+  size_t base_index = windows_[index / window_size_];
+  return getDataByte(base_index + (index % window_size_));
+}
+
+const char* WindowedSampler::getData() {
+  return buffer_.get();
+}
+
+size_t WindowedSampler::getRealSampleSize() {
+  return window_size_ * windows_count_;
+}
+
+size_t WindowedSampler::getFileOffsetImpl(size_t index) {
+  size_t base_index = windows_[index / window_size_];
+  return base_index + (index % window_size_);
+}
+
+size_t WindowedSampler::getSampleOffsetImpl(size_t address) {
+  // we want the last window less or equal to address (or first window if
+  // no such window exists)
+  if (address < windows_[0]) return 0;
+  auto previous_window = std::upper_bound(windows_.begin(), windows_.end(),
+                                          address);
+  if (previous_window != windows_.begin()) --previous_window;
+  size_t base_index = static_cast<size_t>(
+    std::distance(windows_.begin(), previous_window) * window_size_);
+  return base_index + std::min(window_size_ - 1, address - (*previous_window));
+}
+
+SampleSnapshot::Layout WindowedSampler::getSampleLayout() {
+  return SampleSnapshot::windowed(buffer_, getRealSampleSize(), window_size_,
+                                  getRange().first, windows_);
+}
+
+}  // namespace util
+}  // namespace veles
@@ -55,6 +55,16 @@ void setIpAddress(QString addr) {
   settings.setValue("network.ip", addr);
 }
 
+QString localServerName() {
+  QSettings settings;
+  return settings.value("network.local_name", "veles").toString();
+}
+
+void setLocalServerName(QString name) {
+  QSettings settings;
+  settings.setValue("network.local_name", name);
+}
+
 }  // namespace network
 }  // namespace settings
 }  // namespace util
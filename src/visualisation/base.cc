@@ -28,7 +28,8 @@ namespace visualisation {
 
 VisualisationWidget::VisualisationWidget(QWidget *parent) :
   QOpenGLWidget(parent), initialised_(false), gl_initialised_(false),
-  gl_broken_(false), error_message_set_(false), sampler_(nullptr) {
+  gl_broken_(false), error_message_set_(false), sampler_(nullptr),
+  sample_(std::make_shared<util::SampleSnapshot>()), index_cb_id_(0) {
   connect(this, &VisualisationWidget::resampled,
           this, &VisualisationWidget::refreshVisualisation);
 }
@@ -37,23 +38,37 @@ VisualisationWidget::~VisualisationWidget() {
   if (sampler_) {
     sampler_->removeResampleCallback(resample_cb_id_);
   }
+  if (histogram_index_) {
+    histogram_index_->removeBuiltCallback(index_cb_id_);
+  }
 }
 
-void VisualisationWidget::setSampler(util::ISampler *sampler) {
+void VisualisationWidget::setSampler(
+    util::ISampler *sampler, std::shared_ptr<util::HistogramIndex> index) {
   if (sampler_) {
     sampler_->removeResampleCallback(resample_cb_id_);
   }
+  if (histogram_index_) {
+    histogram_index_->removeBuiltCallback(index_cb_id_);
+  }
+  // No callbacks of the old sampler run past this point, so
+  // onAsyncResample always sees the index of its sampler.
+  histogram_index_ = index;
   sampler_ = sampler;
   resample_cb_id_ = sampler_->registerResampleCallback(
     std::function<void()>(
       std::bind(&VisualisationWidget::resampleCallback, this)));
+  if (histogram_index_) {
+    index_cb_id_ = histogram_index_->registerBuiltCallback(
+        std::bind(&VisualisationWidget::resampleCallback, this));
+  }
   initialised_ = true;
   refreshVisualisation();
 }
 
 void VisualisationWidget::refreshVisualisation(AdditionalResampleDataPtr ad) {
   if (gl_initialised_ && !error_message_set_) {
-    auto lc = sampler_->lock();
+    sample_ = sampler_->snapshot();
     refresh(ad);
   }
 }
@@ -91,21 +106,18 @@ void VisualisationWidget::initializeGL() {
 }
 
 size_t VisualisationWidget::getDataSize() {
-  if (!initialised_ || sampler_->empty()) {
-    return 0;
-  }
-  return sampler_->getSampleSize();
+  return sample_->getSampleSize();
 }
 
 const char* VisualisationWidget::getData() {
-  if (!initialised_ || sampler_->empty()) {
+  if (sample_->empty()) {
     return nullptr;
   }
-  return sampler_->data();
+  return sample_->data();
 }
 
 char VisualisationWidget::getByte(size_t index) {
-  return (*sampler_)[index];
+  return (*sample_)[index];
 }
 
 bool VisualisationWidget::prepareOptionsPanel(QBoxLayout *layout) {
@@ -113,7 +125,8 @@ bool VisualisationWidget::prepareOptionsPanel(QBoxLayout *layout) {
 }
 
 void VisualisationWidget::resampleCallback() {
-  AdditionalResampleDataPtr additionalData(onAsyncResample());
+  AdditionalResampleDataPtr additionalData(
+      onAsyncResample(*sampler_->snapshot()));
   emit resampled(additionalData);
 }
 
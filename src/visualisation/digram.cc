@@ -16,9 +16,14 @@
  */
 #include "visualisation/digram.h"
 
+#include "util/concurrency/parallel.h"
+
 namespace veles {
 namespace visualisation {
 
+// Bytes per chunk of the data-parallel loops.
+const size_t k_parallel_grain = 1024 * 1024;
+
 DigramWidget::DigramWidget(QWidget *parent) : VisualisationWidget(parent),
   texture_(nullptr) {}
 
@@ -73,15 +78,23 @@ void DigramWidget::initTextures() {
   texture_->allocateStorage();
 
   // effectively arrays of size [256][256][2], represented as single blocks
-  auto bigtab = new uint64_t[256 * 256 * 2];
-  memset(bigtab, 0, 256 * 256 * 2 * sizeof(*bigtab));
-  auto ftab = new float[256 * 256 * 2];
   const uint8_t *rowdata = reinterpret_cast<const uint8_t *>(getData());
-  for (size_t i = 0; i < getDataSize() - 1; i++) {
-    size_t index = rowdata[i] * 512 + rowdata[i + 1] * 2;
-    bigtab[index]++;
-    bigtab[index + 1] += i;
-  }
+  size_t size = getDataSize();
+  std::vector<uint64_t> bigtab = util::threadpool::parallelReduce(
+      "visualisation", 0, size > 0 ? size - 1 : 0, k_parallel_grain,
+      std::vector<uint64_t>(256 * 256 * 2),
+      [rowdata](std::vector<uint64_t> &tab, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      size_t index = rowdata[i] * 512 + rowdata[i + 1] * 2;
+      tab[index]++;
+      tab[index + 1] += i;
+    }
+  }, [](std::vector<uint64_t> &into, std::vector<uint64_t> &&from) {
+    for (size_t i = 0; i < into.size(); i++) {
+      into[i] += from[i];
+    }
+  });
+  auto ftab = new float[256 * 256 * 2];
   for (int i = 0; i < 256; i++) {
     for (int j = 0; j < 256; j++) {
       size_t index = i * 512 + j * 2;
@@ -100,7 +113,6 @@ void DigramWidget::initTextures() {
 
   texture_->setWrapMode(QOpenGLTexture::ClampToEdge);
 
-  delete[] bigtab;
   delete[] ftab;
 }
 
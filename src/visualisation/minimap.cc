@@ -16,21 +16,30 @@
  */
 #include "visualisation/minimap.h"
 #include <QImage>
+#include <array>
 #include <cstdlib>
 #include <cmath>
 #include <assert.h>
 
+#include "visualisation/minimap_texture.h"
+
 namespace veles {
 namespace visualisation {
 
 VisualisationMinimap::VisualisationMinimap(QWidget *parent) :
   QOpenGLWidget(parent), initialised_(false), gl_initialised_(false),
-  sampler_(nullptr), rows_(0), cols_(0), selection_start_(0),
+  sampler_(nullptr), index_cb_id_(0), rows_(0), cols_(0), selection_start_(0),
   selection_end_(0), top_line_pos_(1.0), bottom_line_pos_(-1.0),
   color_(k_default_color), mode_(k_default_mode), texture_(nullptr),
-  lines_texture_(nullptr) {}
+  lines_texture_(nullptr) {
+  connect(this, &VisualisationMinimap::histogramIndexBuilt,
+          this, [this]() { refresh(); });
+}
 
 VisualisationMinimap::~VisualisationMinimap() {
+  if (histogram_index_) {
+    histogram_index_->removeBuiltCallback(index_cb_id_);
+  }
   if (gl_initialised_) {
     makeCurrent();
     delete texture_;
@@ -40,8 +49,17 @@ VisualisationMinimap::~VisualisationMinimap() {
   }
 }
 
-void VisualisationMinimap::setSampler(util::ISampler *sampler) {
+void VisualisationMinimap::setSampler(
+    util::ISampler *sampler, std::shared_ptr<util::HistogramIndex> index) {
   sampler_ = sampler;
+  if (histogram_index_) {
+    histogram_index_->removeBuiltCallback(index_cb_id_);
+  }
+  histogram_index_ = index;
+  if (histogram_index_) {
+    index_cb_id_ = histogram_index_->registerBuiltCallback(
+        [this]() { emit histogramIndexBuilt(); });
+  }
   selection_start_ = 0;
   selection_end_ = (empty()) ? 0 : sampler_->getSampleSize();
   initialised_ = true;
@@ -115,153 +133,33 @@ void VisualisationMinimap::setMinimapMode(MinimapMode mode) {
 /* calculate minimap texture methods */
 /*****************************************************************************/
 
-float* VisualisationMinimap::calculateAverageValueTexture(
-              const uint8_t *sample, size_t sample_size,
-              size_t texture_size, double point_size) {
-  auto bigtab = new float[texture_size];
-  memset(bigtab, 0, texture_size * sizeof(*bigtab));
-  uint64_t point_sum = 0, point_count = 0;
-
-  size_t index = 0;
-  for (size_t i = 0; i < sample_size; ++i) {
-    if (index < texture_size - 1 &&
-        static_cast<double>(i) / point_size >= index + 1) {
-      uint8_t result = (point_count == 0) ? 0 : point_sum / point_count;
-      bigtab[index] = static_cast<float>(result); // HAX
-      index += 1;
-      point_sum = 0;
-      point_count = 0;
-    }
-    point_sum += sample[i];
-    point_count += 1;
-  }
-  bigtab[texture_size - 1] = static_cast<float>(
-      (point_count == 0) ? 0 : point_sum / point_count);
-  return bigtab;
-}
-
-float* VisualisationMinimap::calculateEntropyTexture(
-              const uint8_t *sample, size_t sample_size,
-              size_t texture_size, double point_size) {
-  if (point_size > k_minimum_entropy_window) {
-    return calculateEntropyTexturePerPixel(sample, sample_size,
-                                           texture_size, point_size);
-  }
-  if (sample_size < 2 * k_minimum_entropy_window) {
-    return calculateEntropyTextureSingleWindow(sample, sample_size,
-                                               texture_size, point_size);
-  }
-  return calculateEntropyTextureSlidingWindow(sample, sample_size,
-                                              texture_size, point_size);
-}
-
-float* VisualisationMinimap::calculateEntropyTexturePerPixel(
-              const uint8_t *sample, size_t sample_size,
-              size_t texture_size, double point_size) {
-  auto bigtab = new float[texture_size];
-  memset(bigtab, 0, texture_size * sizeof(*bigtab));
-
-  auto counts = new uint64_t[256]; // assume 8-bit bytes
-  memset(counts, 0, 256 * sizeof(*counts));
-
-  size_t index = 0, point_count = 0;
-
-  for (size_t i = 0; i < sample_size; ++i) {
-    if (index < texture_size - 1 &&
-        static_cast<double>(i) / point_size >= index + 1) {
-      bigtab[index] = calculateEntropyValue(counts, point_count);
-      index += 1;
-      point_count = 0;
-      memset(counts, 0, 256 * sizeof(*counts));
-    }
-    counts[sample[i]] += 1;
-    point_count += 1;
-  }
-  bigtab[texture_size - 1] = calculateEntropyValue(counts, point_count);
-  delete[] counts;
-  return bigtab;
-}
-
-float* VisualisationMinimap::calculateEntropyTextureSlidingWindow(
-              const uint8_t *sample, size_t sample_size,
+float* VisualisationMinimap::calculateIndexedTexture(
+              const util::HistogramIndex &index,
+              const util::SampleSnapshot &sample, MinimapMode mode,
               size_t texture_size, double point_size) {
   auto bigtab = new float[texture_size];
   memset(bigtab, 0, texture_size * sizeof(*bigtab));
-
-  auto counts = new uint64_t[256]; // assume 8-bit bytes
-  memset(counts, 0, 256 * sizeof(*counts));
-
-  size_t start = 0, end = 0;
-  while (start < sample_size) {
-    size_t mid = (start + end) / 2;
-    if (mid > 0 && std::floor(mid / point_size) != std::floor((mid - 1) / point_size)) {
-      size_t point_count = end - start;
-      bigtab[static_cast<size_t>(mid / point_size)] = calculateEntropyValue(
-          counts, point_count);
-    }
-    if (end > k_minimum_entropy_window || end >= sample_size) {
-      counts[sample[start++]] -= 1;
+  // Every point gets the data between the file offsets of its first sample
+  // byte and that of the next point.
+  minimap::forEachPoint(sample.getSampleSize(), texture_size, point_size,
+               [&index, &sample, mode, bigtab](size_t point, size_t begin,
+                                               size_t end) {
+    size_t start = sample.getFileOffset(begin);
+    size_t stop = sample.getFileOffset(end);
+    if (stop <= start) {
+      return;
     }
-    if (end < sample_size) {
-      counts[sample[end++]] += 1;
+    if (mode == MinimapMode::VALUE) {
+      uint8_t result = static_cast<uint8_t>(index.mean(start, stop));
+      bigtab[point] = static_cast<float>(result);
+    } else {
+      // Normalise to 0-256, like the other entropy textures.
+      bigtab[point] = static_cast<float>(index.entropy(start, stop) * 32);
     }
-  }
-  delete[] counts;
+  });
   return bigtab;
 }
 
-float* VisualisationMinimap::calculateEntropyTextureSingleWindow(
-              const uint8_t *sample, size_t sample_size,
-              size_t texture_size, double point_size) {
-  auto bigtab = new float[texture_size];
-  memset(bigtab, 0, texture_size * sizeof(*bigtab));
-
-  auto counts = new uint64_t[256]; // assume 8-bit bytes
-  memset(counts, 0, 256 * sizeof(*counts));
-
-  for (size_t i = 0; i < sample_size; ++i) {
-    counts[sample[i]] += 1;
-  }
-
-  uint64_t point_count = 0;
-  float point_sum = 0;
-  float result = 0;
-
-  size_t index = 0;
-  for (size_t i = 0; i < sample_size; ++i) {
-    if (index < texture_size - 1 &&
-        static_cast<double>(i) / point_size >= index + 1) {
-      result = (point_count == 0) ? 0.0f : point_sum / point_count;
-      bigtab[index] = static_cast<float>(result) * 32;  // Normalise to 0-256
-      index += 1;
-      point_sum = 0;
-      point_count = 0;
-    }
-    point_sum -= log2(static_cast<float>(counts[sample[i]]) / sample_size);
-    point_count += 1;
-  }
-  result = (point_count == 0) ? 0.0f : point_sum / point_count;
-  bigtab[texture_size - 1] = static_cast<float>(result) * 32;  // Normalise to 0-256
-  delete[] counts;
-  return bigtab;
-}
-
-float VisualisationMinimap::calculateEntropyValue(uint64_t bytes_counts[],
-                                                  uint64_t total_count) {
-  if (total_count == 0) {
-    return 0.0f;
-  }
-  float entropy = 0.0f;
-  for (int i = 0; i < 256; ++i) {
-    if (bytes_counts[i] > 0) {
-      float fcounts = static_cast<float>(bytes_counts[i]) / total_count;
-      entropy -= fcounts * log2(fcounts);
-    }
-  }
-  entropy *= 32; // 256 / 8 (entropy will be in range [0,8], scale it
-  return entropy;
-}
-
 /*****************************************************************************/
 /* OpenGL methods */
 /*****************************************************************************/
@@ -317,7 +215,8 @@ void VisualisationMinimap::initTextures() {
   // calculate texture size
   texture_rows_ = std::max(static_cast<size_t>(1), rows_);
   texture_cols_ = std::max(static_cast<size_t>(1), cols_);
-  sample_size_ = sampler_->getSampleSize();
+  auto sample = sampler_->snapshot();
+  sample_size_ = sample->getSampleSize();
   size_t texture_size = texture_rows_ * texture_cols_;
 
   if (sample_size_ < texture_size) {
@@ -342,15 +241,22 @@ void VisualisationMinimap::initTextures() {
   texture_->allocateStorage();
 
   point_size_ = std::max(1.0, static_cast<double>(sample_size_) / texture_size);
-  const uint8_t *rowdata = reinterpret_cast<const uint8_t *>(sampler_->data());
+  const uint8_t *rowdata = reinterpret_cast<const uint8_t *>(sample->data());
 
   float* bigtab;
-  if (mode_ == MinimapMode::VALUE) {
-    bigtab = calculateAverageValueTexture(rowdata, sample_size_,
-                                          texture_size, point_size_);
-  } else {
-    bigtab = calculateEntropyTexture(rowdata, sample_size_,
+  auto range = sample->getRange();
+  // Until the index is built, it would scan the whole range.
+  if (histogram_index_ != nullptr && histogram_index_->built() &&
+      range.second - range.first
+      >= texture_size * util::HistogramIndex::k_leaf_size) {
+    bigtab = calculateIndexedTexture(*histogram_index_, *sample, mode_,
                                      texture_size, point_size_);
+  } else if (mode_ == MinimapMode::VALUE) {
+    bigtab = minimap::calculateAverageValueTexture(rowdata, sample_size_,
+                                                   texture_size, point_size_);
+  } else {
+    bigtab = minimap::calculateEntropyTexture(rowdata, sample_size_,
+                                              texture_size, point_size_);
   }
 
   texture_->setData(QOpenGLTexture::Red, QOpenGLTexture::Float32,
@@ -47,8 +47,10 @@ MinimapPanel::MinimapPanel(QWidget *parent) :
 MinimapPanel::~MinimapPanel() {
 }
 
-void MinimapPanel::setSampler(util::ISampler *sampler) {
+void MinimapPanel::setSampler(util::ISampler *sampler,
+                              std::shared_ptr<util::HistogramIndex> index) {
   sampler_ = sampler;
+  histogram_index_ = index;
   while (minimaps_.size() > 1) {
     removeMinimap();
   }
@@ -57,7 +59,7 @@ void MinimapPanel::setSampler(util::ISampler *sampler) {
     minimap_samplers_.pop_back();
   }
   minimap_samplers_.push_back(sampler_->clone());
-  minimaps_[0]->setSampler(minimap_samplers_[0]);
+  minimaps_[0]->setSampler(minimap_samplers_[0], histogram_index_);
   select_range_button_->setEnabled(!sampler_->empty());
   auto range = sampler_->getRange();
   selection_ = qMakePair(range.first, range.second);
@@ -133,7 +135,7 @@ void MinimapPanel::addMinimap() {
   auto new_sampler = minimap_samplers_.back()->clone();
   auto range = minimaps_.back()->getSelectedRange();
   new_sampler->setRange(range.first, range.second);
-  new_minimap->setSampler(new_sampler);
+  new_minimap->setSampler(new_sampler, histogram_index_);
   new_minimap->setMinimapColor(getMinimapColor());
   new_minimap->setMinimapMode(mode_);
   connect(new_minimap, &VisualisationMinimap::selectionChanged,
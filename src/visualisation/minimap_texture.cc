@@ -0,0 +1,226 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <array>
+#include <cmath>
+#include <cstring>
+
+#include "util/analysis.h"
+#include "visualisation/minimap_texture.h"
+
+namespace veles {
+namespace visualisation {
+namespace minimap {
+
+// Entropy of n bytes with counts c_i is log2(n) - sum(c_i * log2(c_i)) / n,
+// so keeping the sum lets windows slide in O(1).  Counts up to this are
+// looked up.
+const size_t k_clogc_table_size = 4096;
+
+typedef std::array<double, k_clogc_table_size> CLogCTable;
+
+// c * log2(c) for every c in the table (0 for c = 0).
+static const CLogCTable& cLogCTable() {
+  static const CLogCTable table = []() {
+    CLogCTable res;
+    res[0] = 0;
+    for (size_t c = 1; c < res.size(); ++c) {
+      res[c] = c * std::log2(static_cast<double>(c));
+    }
+    return res;
+  }();
+  return table;
+}
+
+static double cLogC(const CLogCTable &table, uint64_t c) {
+  if (c < table.size()) {
+    return table[c];
+  }
+  return c * std::log2(static_cast<double>(c));
+}
+
+// Entropy of total bytes whose counts give sum_clogc, scaled to 0-256.
+static float scaledEntropy(const CLogCTable &table, double sum_clogc,
+                           uint64_t total) {
+  if (total == 0) {
+    return 0.0f;
+  }
+  double entropy = (cLogC(table, total) - sum_clogc) / total;
+  // 256 / 8 - entropy is in range [0, 8] (give or take rounding errors).
+  return static_cast<float>(std::max(0.0, entropy) * 32);
+}
+
+size_t pointStart(size_t index, double point_size) {
+  auto start = static_cast<size_t>(std::ceil(index * point_size));
+  while (start > 0 && static_cast<double>(start - 1) / point_size >= index) {
+    start -= 1;
+  }
+  while (static_cast<double>(start) / point_size < index) {
+    start += 1;
+  }
+  return start;
+}
+
+float* calculateAverageValueTexture(const uint8_t *sample, size_t sample_size,
+                                    size_t texture_size, double point_size) {
+  auto bigtab = new float[texture_size];
+  memset(bigtab, 0, texture_size * sizeof(*bigtab));
+  forEachPoint(sample_size, texture_size, point_size,
+               [sample, bigtab](size_t index, size_t begin, size_t end) {
+    uint64_t point_sum = util::analysis::byteSum(sample + begin, end - begin);
+    uint8_t result = (end == begin) ? 0 : point_sum / (end - begin);
+    bigtab[index] = static_cast<float>(result); // HAX
+  });
+  return bigtab;
+}
+
+float* calculateEntropyTexture(const uint8_t *sample, size_t sample_size,
+                               size_t texture_size, double point_size) {
+  if (point_size > k_minimum_entropy_window) {
+    return calculateEntropyTexturePerPixel(sample, sample_size,
+                                           texture_size, point_size);
+  }
+  if (sample_size < 2 * k_minimum_entropy_window) {
+    return calculateEntropyTextureSingleWindow(sample, sample_size,
+                                               texture_size, point_size);
+  }
+  return calculateEntropyTextureSlidingWindow(sample, sample_size,
+                                              texture_size, point_size);
+}
+
+float* calculateEntropyTexturePerPixel(
+    const uint8_t *sample, size_t sample_size,
+    size_t texture_size, double point_size) {
+  auto bigtab = new float[texture_size];
+  memset(bigtab, 0, texture_size * sizeof(*bigtab));
+  const CLogCTable &table = cLogCTable();
+  forEachPoint(sample_size, texture_size, point_size,
+               [sample, bigtab, &table](size_t index, size_t begin,
+                                        size_t end) {
+    // byteHistogram counts into interleaved tables, which keeps runs of
+    // equal bytes from serialising on one counter.
+    auto counts = util::analysis::byteHistogram(sample + begin, end - begin);
+    double sum_clogc = 0;
+    for (auto count : counts) {
+      sum_clogc += cLogC(table, count);
+    }
+    bigtab[index] = scaledEntropy(table, sum_clogc, end - begin);
+  });
+  return bigtab;
+}
+
+float* calculateEntropyTextureSlidingWindow(
+    const uint8_t *sample, size_t sample_size,
+    size_t texture_size, double point_size) {
+  auto bigtab = new float[texture_size];
+  memset(bigtab, 0, texture_size * sizeof(*bigtab));
+
+  // The window [start, end) first grows from empty to
+  // k_minimum_entropy_window + 1 bytes, then slides to the end of the sample
+  // and shrinks again - at step t it is [windowStart(t), windowEnd(t)).
+  // Steps are split between threads, each point is set by the last step
+  // centered on its first byte.
+  const size_t window = k_minimum_entropy_window + 1;
+  const size_t steps = sample_size + window;
+  auto windowStart = [window](size_t step) {
+    return step > window ? step - window : 0;
+  };
+  auto windowEnd = [sample_size](size_t step) {
+    return std::min(step, sample_size);
+  };
+  auto windowMid = [windowStart, windowEnd](size_t step) {
+    return (windowStart(step) + windowEnd(step)) / 2;
+  };
+  // Counts never exceed the window, so all of them are in the table.
+  static_assert(window < k_clogc_table_size, "c * log2(c) table too small");
+  const CLogCTable &table = cLogCTable();
+  util::threadpool::parallelFor("visualisation", 0, steps, k_parallel_grain,
+      [=, &table](size_t begin, size_t end_step) {
+    uint32_t counts[256] = {}; // assume 8-bit bytes
+    // Sum of c * log2(c) over counts - updated along with them.
+    double sum_clogc = 0;
+    auto add = [&](uint8_t byte) {
+      uint32_t &count = counts[byte];
+      sum_clogc += table[count + 1] - table[count];
+      count += 1;
+    };
+    auto remove = [&](uint8_t byte) {
+      uint32_t &count = counts[byte];
+      sum_clogc -= table[count] - table[count - 1];
+      count -= 1;
+    };
+    size_t start = windowStart(begin), end = windowEnd(begin);
+    for (size_t i = start; i < end; ++i) {
+      add(sample[i]);
+    }
+    for (size_t step = begin; step < end_step; ++step) {
+      size_t mid = (start + end) / 2;
+      if (mid > 0 && std::floor(mid / point_size) != std::floor((mid - 1) / point_size)
+          && (step + 1 == steps || windowMid(step + 1) != mid)) {
+        bigtab[static_cast<size_t>(mid / point_size)] = scaledEntropy(
+            table, sum_clogc, end - start);
+      }
+      if (end >= window || end >= sample_size) {
+        remove(sample[start++]);
+      }
+      if (end < sample_size) {
+        add(sample[end++]);
+      }
+    }
+  });
+  return bigtab;
+}
+
+float* calculateEntropyTextureSingleWindow(
+    const uint8_t *sample, size_t sample_size,
+    size_t texture_size, double point_size) {
+  auto bigtab = new float[texture_size];
+  memset(bigtab, 0, texture_size * sizeof(*bigtab));
+
+  typedef std::array<uint64_t, 256> Counts; // assume 8-bit bytes
+  Counts counts = util::threadpool::parallelReduce(
+      "visualisation", 0, sample_size, k_parallel_grain, Counts(),
+      [sample](Counts &acc, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; ++i) {
+      acc[sample[i]] += 1;
+    }
+  }, [](Counts &into, Counts &&from) {
+    for (int i = 0; i < 256; ++i) {
+      into[i] += from[i];
+    }
+  });
+
+  typedef decltype(log2(1.0f)) Log;
+  std::array<Log, 256> logs;
+  for (int i = 0; i < 256; ++i) {
+    logs[i] = log2(static_cast<float>(counts[i]) / sample_size);
+  }
+
+  forEachPoint(sample_size, texture_size, point_size,
+               [sample, bigtab, &logs](size_t index, size_t begin, size_t end) {
+    float point_sum = 0;
+    for (size_t i = begin; i < end; ++i) {
+      point_sum -= logs[sample[i]];
+    }
+    float result = (end == begin) ? 0.0f : point_sum / (end - begin);
+    bigtab[index] = static_cast<float>(result) * 32;  // Normalise to 0-256
+  });
+  return bigtab;
+}
+
+}  // namespace minimap
+}  // namespace visualisation
+}  // namespace veles
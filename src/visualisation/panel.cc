@@ -23,6 +23,9 @@
 #include "visualisation/panel.h"
 #include "util/icons.h"
 #include "util/sampling/fake_sampler.h"
+#include "util/sampling/entropy_sampler.h"
+#include "util/sampling/file_sampler.h"
+#include "util/sampling/pyramid_sampler.h"
 #include "util/sampling/uniform_sampler.h"
 #include "visualisation/digram.h"
 #include "visualisation/trigram.h"
@@ -34,7 +37,9 @@ namespace visualisation {
 const std::map<QString, VisualisationPanel::ESampler>
   VisualisationPanel::k_sampler_map = {
     {"No sampling", VisualisationPanel::ESampler::NO_SAMPLER},
-    {"Uniform random sampling", VisualisationPanel::ESampler::UNIFORM_SAMPLER}
+    {"Uniform random sampling", VisualisationPanel::ESampler::UNIFORM_SAMPLER},
+    {"Entropy-weighted sampling", VisualisationPanel::ESampler::ENTROPY_SAMPLER},
+    {"Multi-resolution sampling", VisualisationPanel::ESampler::PYRAMID_SAMPLER}
 };
 
 /*****************************************************************************/
@@ -44,10 +49,10 @@ const std::map<QString, VisualisationPanel::ESampler>
 VisualisationPanel::VisualisationPanel(QWidget *parent) :
   sampler_type_(k_default_sampler),
   visualisation_type_(k_default_visualisation), sample_size_(1024) {
-    sampler_ = getSampler(sampler_type_, data_, sample_size_);
+    sampler_ = getSampler(sampler_type_, data_, data_owner_, sample_size_);
     sampler_->allowAsynchronousResampling(true);
-    minimap_sampler_ = getSampler(ESampler::UNIFORM_SAMPLER,
-                                  data_, k_minimap_sample_size);
+    minimap_sampler_ = getSampler(ESampler::PYRAMID_SAMPLER,
+                                  data_, data_owner_, k_minimap_sample_size);
     minimap_ = new MinimapPanel(this);
     minimap_->setSampler(minimap_sampler_);
     connect(minimap_, SIGNAL(selectionChanged(size_t, size_t)), this,
@@ -68,23 +73,22 @@ VisualisationPanel::~VisualisationPanel() {
   }
 }
 
-void VisualisationPanel::setData(const QByteArray &data) {
-  if (sampler_ != nullptr) {
-    delete sampler_;
-  }
-  if (minimap_sampler_ != nullptr) {
-    delete minimap_sampler_;
-  }
+void VisualisationPanel::setData(const QByteArray &data,
+                                 std::shared_ptr<const void> owner) {
+  // The old data has to outlive the old samplers.
+  auto old_owner = data_owner_;
   data_ = data;
-  sampler_ = getSampler(sampler_type_, data_, sample_size_);
-  sampler_->allowAsynchronousResampling(true);
-  minimap_sampler_ = getSampler(ESampler::UNIFORM_SAMPLER,
-                                data_, k_minimap_sample_size);
-  minimap_->setSampler(minimap_sampler_);
-  visualisation_->setSampler(sampler_);
-  selection_label_->setText(prepareAddressString(0,
-                            sampler_->getFileOffset(sampler_->getSampleSize())));
+  data_owner_ = owner;
+  file_path_ = QString();
+  setSamplers();
+}
 
+void VisualisationPanel::setFile(const QString &path) {
+  auto old_owner = data_owner_;
+  data_ = QByteArray();
+  data_owner_.reset();
+  file_path_ = path;
+  setSamplers();
 }
 
 void VisualisationPanel::setRange(const size_t start, const size_t end) {
@@ -97,15 +101,28 @@ void VisualisationPanel::setRange(const size_t start, const size_t end) {
 
 util::ISampler* VisualisationPanel::getSampler(ESampler type,
                                           const QByteArray &data,
+                                          std::shared_ptr<const void> owner,
                                           int sample_size) {
   switch (type) {
   case ESampler::NO_SAMPLER:
     return new util::FakeSampler(data);
-  case ESampler::UNIFORM_SAMPLER:
+  case ESampler::UNIFORM_SAMPLER: {
     util::UniformSampler *sampler = new util::UniformSampler(data);
+    sampler->setIncrementalResampling(true);
+    sampler->setSampleSize(1024 * sample_size);
+    return sampler;
+  }
+  case ESampler::ENTROPY_SAMPLER: {
+    util::EntropySampler *sampler = new util::EntropySampler(data);
+    sampler->setSampleSize(1024 * sample_size);
+    return sampler;
+  }
+  case ESampler::PYRAMID_SAMPLER: {
+    util::PyramidSampler *sampler = new util::PyramidSampler(data, owner);
     sampler->setSampleSize(1024 * sample_size);
     return sampler;
   }
+  }
   return nullptr;
 }
 
@@ -127,6 +144,17 @@ VisualisationWidget* VisualisationPanel::getVisualisation(EVisualisation type,
   return nullptr;
 }
 
+util::ISampler* VisualisationPanel::createSampler(ESampler type,
+                                                  int sample_size) {
+  if (file_path_.isEmpty()) {
+    return getSampler(type, data_, data_owner_, sample_size);
+  }
+  util::FileSampler *sampler = new util::FileSampler(file_path_);
+  sampler->setIncrementalResampling(true);
+  sampler->setSampleSize(1024 * sample_size);
+  return sampler;
+}
+
 QString VisualisationPanel::prepareAddressString(size_t start, size_t end) {
   auto label = QString("0x%1 : ").arg(start, 8, 16, QChar('0'));
   label.append(QString("0x%1\n").arg(end, 8, 16, QChar('0')));
@@ -143,21 +171,21 @@ void VisualisationPanel::setSamplingMethod(const QString &name) {
   if (new_sampler_type == sampler_type_) return;
 
   auto old_sampler = sampler_;
-  sampler_ = getSampler(new_sampler_type, data_, sample_size_);
+  sampler_ = createSampler(new_sampler_type, sample_size_);
   sampler_->allowAsynchronousResampling(true);
   auto selection = minimap_->getSelection();
   sampler_->setRange(selection.first, selection.second);
-  visualisation_->setSampler(sampler_);
+  visualisation_->setSampler(sampler_, histogram_index_);
   if (old_sampler != nullptr) {
     delete old_sampler;
   }
   sampler_type_ = new_sampler_type;
-  sample_size_box_->setEnabled(sampler_type_ == ESampler::UNIFORM_SAMPLER);
+  sample_size_box_->setEnabled(sampler_type_ != ESampler::NO_SAMPLER);
 }
 
 void VisualisationPanel::setSampleSize(int kilobytes) {
   sample_size_ = kilobytes;
-  if (sampler_type_ == ESampler::UNIFORM_SAMPLER) {
+  if (sampler_type_ != ESampler::NO_SAMPLER) {
     sampler_->setSampleSize(1024 * kilobytes);
   }
 }
@@ -195,13 +223,37 @@ void VisualisationPanel::minimapSelectionChanged(size_t start, size_t end) {
 /* Private methods */
 /*****************************************************************************/
 
+void VisualisationPanel::setSamplers() {
+  if (sampler_ != nullptr) {
+    delete sampler_;
+  }
+  if (minimap_sampler_ != nullptr) {
+    delete minimap_sampler_;
+  }
+  sampler_ = createSampler(sampler_type_, sample_size_);
+  sampler_->allowAsynchronousResampling(true);
+  minimap_sampler_ = createSampler(ESampler::PYRAMID_SAMPLER,
+                                   k_minimap_sample_size);
+  histogram_index_.reset();
+  if (file_path_.isEmpty() && !data_.isEmpty()) {
+    histogram_index_ = util::HistogramIndex::forData(data_, data_owner_);
+  }
+  minimap_->setSampler(minimap_sampler_, histogram_index_);
+  visualisation_->setSampler(sampler_, histogram_index_);
+  sampling_method_box_->setEnabled(file_path_.isEmpty());
+  // A file can still turn out empty or unreadable once it's opened here.
+  size_t end = sampler_->empty() ? 0
+      : sampler_->getFileOffset(sampler_->getSampleSize());
+  selection_label_->setText(prepareAddressString(0, end));
+}
+
 void VisualisationPanel::setVisualisation(EVisualisation type) {
   if (type != visualisation_type_) {
     VisualisationWidget *old = visualisation_;
     auto sizes = splitter_->sizes();
     visualisation_type_ = type;
     visualisation_ = getVisualisation(visualisation_type_, this);
-    visualisation_->setSampler(sampler_);
+    visualisation_->setSampler(sampler_, histogram_index_);
 
     splitter_->addWidget(visualisation_);
     old->hide();
@@ -285,10 +337,12 @@ void VisualisationPanel::initOptionsPanel() {
   sampling_label->setAlignment(Qt::AlignTop);
   options_layout_->addWidget(sampling_label);
 
-  QComboBox *sampling_method = new QComboBox;
-  sampling_method->addItem("Uniform random sampling");
-  sampling_method->addItem("No sampling");
-  options_layout_->addWidget(sampling_method);
+  sampling_method_box_ = new QComboBox;
+  sampling_method_box_->addItem("Uniform random sampling");
+  sampling_method_box_->addItem("Entropy-weighted sampling");
+  sampling_method_box_->addItem("Multi-resolution sampling");
+  sampling_method_box_->addItem("No sampling");
+  options_layout_->addWidget(sampling_method_box_);
 
   QLabel *sample_size_label = new QLabel("Sample size (KB):");
   sample_size_label->setAlignment(Qt::AlignTop);
@@ -299,10 +353,10 @@ void VisualisationPanel::initOptionsPanel() {
   sample_size_box_->setMaximum(k_max_sample_size);
   sample_size_box_->setSingleStep(1024);
   sample_size_box_->setValue(sample_size_);
-  sample_size_box_->setEnabled(sampler_type_ == ESampler::UNIFORM_SAMPLER);
+  sample_size_box_->setEnabled(sampler_type_ != ESampler::NO_SAMPLER);
   options_layout_->addWidget(sample_size_box_);
 
-  connect(sampling_method, SIGNAL(currentIndexChanged(const QString&)),
+  connect(sampling_method_box_, SIGNAL(currentIndexChanged(const QString&)),
           this, SLOT(setSamplingMethod(const QString&)));
   connect(sample_size_box_, SIGNAL(valueChanged(int)),
           this, SLOT(setSampleSize(int)));
@@ -15,6 +15,8 @@
  *
  */
 #include "visualisation/trigram.h"
+#include "util/analysis.h"
+#include "util/concurrency/parallel.h"
 #include "util/icons.h"
 
 #include <stdio.h>
@@ -46,6 +48,8 @@ const int k_brightness_heuristic_min = 38;
 const int k_brightness_heuristic_max = 66;
 // decrease this to reduce noise (but you may lose data if you overdo it)
 const double k_brightness_heuristic_scaling = 2.5;
+// Bytes per chunk of the data-parallel loops.
+const size_t k_parallel_grain = 1024 * 1024;
 
 TrigramWidget::TrigramWidget(QWidget *parent) :
     VisualisationWidget(parent), texture(nullptr), databuf(nullptr), angle(0),
@@ -126,7 +130,7 @@ bool TrigramWidget::prepareOptionsPanel(QBoxLayout *layout) {
   brightness_label->setAlignment(Qt::AlignTop);
   layout->addWidget(brightness_label);
 
-  brightness_ = suggestBrightness();
+  brightness_ = suggestBrightness(sample());
   brightness_slider_ = new QSlider(Qt::Horizontal);
   brightness_slider_->setMinimum(k_minimum_brightness);
   brightness_slider_->setMaximum(k_maximum_brightness);
@@ -192,18 +196,37 @@ bool TrigramWidget::prepareOptionsPanel(QBoxLayout *layout) {
   return true;
 }
 
-int TrigramWidget::suggestBrightness() {
-  size_t size = getDataSize();
-  auto data = reinterpret_cast<const uint8_t*>(getData());
+int TrigramWidget::suggestBrightness(const util::SampleSnapshot &sample) {
+  size_t size = sample.getSampleSize();
+  auto data = reinterpret_cast<const uint8_t*>(sample.data());
   if (size < 100) {
     return (k_minimum_brightness + k_maximum_brightness) / 2;
   }
-  std::vector<uint64_t> counts(256, 0);
-  for (size_t i = 0; i < size; ++i) {
-    counts[data[i]] += 1;
+  util::analysis::ByteHistogram counts;
+  if (histogramIndex() != nullptr && histogramIndex()->built()) {
+    // The sample stands for its range, whose histogram is cheaper to get.
+    auto range = sample.getRange();
+    counts = histogramIndex()->histogram(range.first, range.second);
+    size = range.second - range.first;
+  } else {
+    counts = util::threadpool::parallelReduce(
+        "visualisation", 0, size, k_parallel_grain,
+        util::analysis::ByteHistogram(),
+        [data](util::analysis::ByteHistogram &acc, size_t begin, size_t end) {
+      auto chunk = util::analysis::byteHistogram(data + begin, end - begin);
+      for (int i = 0; i < 256; ++i) {
+        acc[i] += chunk[i];
+      }
+    }, [](util::analysis::ByteHistogram &into,
+          util::analysis::ByteHistogram &&from) {
+      for (int i = 0; i < 256; ++i) {
+        into[i] += from[i];
+      }
+    });
   }
   std::sort(counts.begin(), counts.end());
-  int offset = 0, sum = 0;
+  int offset = 0;
+  uint64_t sum = 0;
   while (offset < 255 && sum < k_brightness_heuristic_threshold * size) {
     sum += counts[255 - offset];
     offset += 1;
@@ -214,10 +237,11 @@ int TrigramWidget::suggestBrightness() {
                   k_brightness_heuristic_max - offset);
 }
 
-VisualisationWidget::AdditionalResampleData* TrigramWidget::onAsyncResample() {
+VisualisationWidget::AdditionalResampleData* TrigramWidget::onAsyncResample(
+    const util::SampleSnapshot &sample) {
   if (use_brightness_heuristic_) {
     BrightnessData* res = new BrightnessData();
-    res->brightness = suggestBrightness();
+    res->brightness = suggestBrightness(sample);
     return res;
   }
   return nullptr;
@@ -282,7 +306,7 @@ void TrigramWidget::setManipulator(Manipulator* manipulator) {
 }
 
 void TrigramWidget::autoSetBrightness() {
-  auto new_brightness = suggestBrightness();
+  auto new_brightness = suggestBrightness(sample());
   if (new_brightness == brightness_) return;
   brightness_ = new_brightness;
   if (brightness_slider_ != nullptr) {
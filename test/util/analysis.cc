@@ -0,0 +1,120 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <cstring>
+
+#include "gtest/gtest.h"
+#include "util/analysis.h"
+#include "util/concurrency/threadpool.h"
+
+namespace veles {
+namespace util {
+namespace analysis {
+
+TEST(Analysis, findAll) {
+  const char *data = "abababcab";
+  auto hits = findAll(reinterpret_cast<const uint8_t *>(data), strlen(data),
+                      reinterpret_cast<const uint8_t *>("aba"), 3, 100);
+  EXPECT_EQ(hits, std::vector<uint64_t>({0, 2}));
+  hits = findAll(reinterpret_cast<const uint8_t *>(data), strlen(data),
+                 reinterpret_cast<const uint8_t *>("ab"), 2, 3);
+  EXPECT_EQ(hits, std::vector<uint64_t>({0, 2, 4}));
+  hits = findAll(reinterpret_cast<const uint8_t *>(data), strlen(data),
+                 reinterpret_cast<const uint8_t *>("b"), 1, 100);
+  EXPECT_EQ(hits, std::vector<uint64_t>({1, 3, 5, 8}));
+  hits = findAll(reinterpret_cast<const uint8_t *>(data), 2,
+                 reinterpret_cast<const uint8_t *>("aba"), 3, 100);
+  EXPECT_TRUE(hits.empty());
+}
+
+TEST(Analysis, byteHistogram) {
+  std::vector<uint8_t> data;
+  for (int i = 0; i < 1027; i++) {
+    data.push_back(i % 7);
+  }
+  auto counts = byteHistogram(data.data(), data.size());
+  uint64_t total = 0;
+  for (int value = 0; value < 256; value++) {
+    uint64_t expected = 0;
+    for (auto byte : data) {
+      expected += byte == value;
+    }
+    EXPECT_EQ(counts[value], expected);
+    total += counts[value];
+  }
+  EXPECT_EQ(total, data.size());
+}
+
+TEST(Analysis, byteSum) {
+  std::vector<uint8_t> data;
+  for (int i = 0; i < 1000; i++) {
+    data.push_back(static_cast<uint8_t>(i * 37));
+  }
+  // All lengths and alignments around the vector width.
+  for (size_t start = 0; start < 40; start++) {
+    for (size_t size = 0; start + size <= data.size(); size += 7) {
+      uint64_t expected = 0;
+      for (size_t i = start; i < start + size; i++) {
+        expected += data[i];
+      }
+      ASSERT_EQ(expected, byteSum(data.data() + start, size));
+    }
+  }
+}
+
+TEST(Analysis, entropySeries) {
+  std::vector<uint8_t> data(256, 0);
+  for (int i = 0; i < 256; i++) {
+    data.push_back(i);
+  }
+  data.push_back(1);
+  auto series = entropySeries(data.data(), data.size(), 256);
+  ASSERT_EQ(series.size(), 3);
+  EXPECT_FLOAT_EQ(series[0], 0);
+  EXPECT_FLOAT_EQ(series[1], 8);
+  EXPECT_FLOAT_EQ(series[2], 0);
+  EXPECT_TRUE(entropySeries(data.data(), data.size(), 0).empty());
+}
+
+TEST(Analysis, parallel) {
+  threadpool::createTopic("analysis_test");
+  // A few chunks, with a match across every chunk boundary.
+  std::vector<uint8_t> data(3 * k_chunk_size + 100);
+  for (size_t i = 0; i < data.size(); i++) {
+    data[i] = static_cast<uint8_t>(i * 7 + i / 1000);
+  }
+  const uint8_t pattern[] = {1, 2, 3};
+  for (size_t boundary = 1; boundary <= 3; boundary++) {
+    memcpy(&data[boundary * k_chunk_size - 1], pattern, sizeof(pattern));
+  }
+  for (size_t max_hits : {size_t(1), size_t(2), size_t(100)}) {
+    EXPECT_EQ(parallelFindAll("analysis_test", data.data(), data.size(),
+                              pattern, sizeof(pattern), max_hits),
+              findAll(data.data(), data.size(), pattern, sizeof(pattern),
+                      max_hits));
+  }
+  EXPECT_EQ(parallelByteHistogram("analysis_test", data.data(), data.size()),
+            byteHistogram(data.data(), data.size()));
+  for (size_t window : {size_t(1000), k_chunk_size + 1}) {
+    EXPECT_EQ(parallelEntropySeries("analysis_test", data.data(), data.size(),
+                                    window),
+              entropySeries(data.data(), data.size(), window));
+  }
+}
+
+}  // namespace analysis
+}  // namespace util
+}  // namespace veles
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "util/concurrency/parallel.h"
+
+namespace veles {
+namespace util {
+namespace threadpool {
+
+TEST(Parallel, forCoversRange) {
+  createTopic("parallel_test");
+  for (size_t grain : {1, 7, 1000, 100000}) {
+    std::vector<std::atomic<int>> visits(10007);
+    for (auto &visit : visits) {
+      visit = 0;
+    }
+    parallelFor("parallel_test", 3, visits.size(), grain,
+                [&visits, grain](size_t begin, size_t end) {
+      EXPECT_LT(begin, end);
+      EXPECT_LE(end - begin, grain);
+      for (size_t i = begin; i < end; i++) {
+        visits[i]++;
+      }
+    });
+    for (size_t i = 0; i < visits.size(); i++) {
+      EXPECT_EQ(visits[i].load(), i < 3 ? 0 : 1);
+    }
+  }
+  parallelFor("parallel_test", 5, 5, 1, [](size_t, size_t) {
+    ADD_FAILURE();
+  });
+}
+
+TEST(Parallel, reduce) {
+  createTopic("parallel_test");
+  std::vector<uint64_t> values(100000);
+  std::iota(values.begin(), values.end(), 0);
+  auto sum = [](uint64_t &into, uint64_t from) { into += from; };
+  uint64_t result = parallelReduce(
+      "parallel_test", 0, values.size(), 1000, uint64_t(0),
+      [&values](uint64_t &acc, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      acc += values[i];
+    }
+  }, sum);
+  EXPECT_EQ(result, uint64_t(99999) * 100000 / 2);
+
+  // Accumulators can be anything copyable.
+  auto histogram = parallelReduce(
+      "parallel_test", 0, values.size(), 999, std::vector<uint64_t>(10),
+      [&values](std::vector<uint64_t> &acc, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      acc[values[i] % 10]++;
+    }
+  }, [](std::vector<uint64_t> &into, std::vector<uint64_t> &&from) {
+    for (size_t i = 0; i < into.size(); i++) {
+      into[i] += from[i];
+    }
+  });
+  EXPECT_EQ(histogram, std::vector<uint64_t>(10, 10000));
+}
+
+TEST(Parallel, nested) {
+  createTopic("parallel_test");
+  uint64_t result = parallelReduce(
+      "parallel_test", 0, 64, 1, uint64_t(0),
+      [](uint64_t &acc, size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      acc += parallelReduce("parallel_test", 0, 1000, 10, uint64_t(0),
+          [](uint64_t &inner, size_t b, size_t e) { inner += e - b; },
+          [](uint64_t &into, uint64_t from) { into += from; });
+    }
+  }, [](uint64_t &into, uint64_t from) { into += from; });
+  EXPECT_EQ(result, 64000u);
+}
+
+TEST(Parallel, mockTopic) {
+  mockTopic("parallel_test_mock");
+  std::atomic<size_t> count(0);
+  parallelFor("parallel_test_mock", 0, 100, 3, [&count](size_t b, size_t e) {
+    count += e - b;
+  });
+  EXPECT_EQ(count.load(), 100u);
+}
+
+TEST(Parallel, exception) {
+  createTopic("parallel_test");
+  std::atomic<size_t> count(0);
+  EXPECT_THROW(parallelFor("parallel_test", 0, 1000, 1,
+                           [&count](size_t begin, size_t) {
+    count++;
+    if (begin == 10) {
+      throw std::runtime_error("failed");
+    }
+  }), std::runtime_error);
+  // Other workers may still run every chunk before they see the failure,
+  // so skipping is only checked when the calling thread works alone.
+  mockTopic("parallel_test_mock");
+  count = 0;
+  EXPECT_THROW(parallelFor("parallel_test_mock", 0, 1000, 1,
+                           [&count](size_t begin, size_t) {
+    count++;
+    if (begin == 10) {
+      throw std::runtime_error("failed");
+    }
+  }), std::runtime_error);
+  EXPECT_EQ(count.load(), 11u);
+}
+
+TEST(Parallel, sort) {
+  createTopic("parallel_test");
+  std::minstd_rand random(1);
+  for (size_t size : {0, 1, 5, 1000, 100003}) {
+    std::vector<uint32_t> values(size);
+    for (auto &value : values) {
+      value = random() % 1000;
+    }
+    auto expected = values;
+    std::sort(expected.begin(), expected.end());
+    parallelSort("parallel_test", values.begin(), values.end(), 1000);
+    EXPECT_EQ(values, expected);
+  }
+}
+
+}  // namespace threadpool
+}  // namespace util
+}  // namespace veles
@@ -0,0 +1,240 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <atomic>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "util/concurrency/threadpool.h"
+#include "util/concurrency/work_stealing_deque.h"
+
+namespace veles {
+namespace util {
+namespace threadpool {
+
+TEST(WorkStealingDeque, pushPopSteal) {
+  WorkStealingDeque<int> deque(1);
+  std::vector<int> values(100);
+  EXPECT_TRUE(deque.empty());
+  EXPECT_EQ(deque.pop(), nullptr);
+  EXPECT_EQ(deque.steal(), nullptr);
+  for (auto &value : values) {
+    deque.push(&value);
+  }
+  EXPECT_EQ(deque.steal(), &values[0]);
+  EXPECT_EQ(deque.pop(), &values[99]);
+  EXPECT_EQ(deque.pop(), &values[98]);
+  EXPECT_EQ(deque.steal(), &values[1]);
+  for (int i = 97; i >= 2; i--) {
+    EXPECT_EQ(deque.pop(), &values[i]);
+  }
+  EXPECT_TRUE(deque.empty());
+  EXPECT_EQ(deque.pop(), nullptr);
+}
+
+TEST(WorkStealingDeque, concurrentSteal) {
+  const int items = 100000;
+  WorkStealingDeque<int> deque;
+  std::vector<int> values(items);
+  std::vector<std::atomic<int>> taken(items);
+  std::atomic<int> remaining(items);
+  for (auto &count : taken) {
+    count = 0;
+  }
+  auto take = [&](int *item) {
+    taken[item - values.data()]++;
+    remaining--;
+  };
+  std::vector<std::thread> thieves;
+  for (int i = 0; i < 3; i++) {
+    thieves.push_back(std::thread([&]() {
+      while (remaining.load() > 0) {
+        if (int *item = deque.steal()) {
+          take(item);
+        }
+      }
+    }));
+  }
+  for (int i = 0; i < items; i++) {
+    deque.push(&values[i]);
+    if (i % 3 == 0) {
+      if (int *item = deque.pop()) {
+        take(item);
+      }
+    }
+  }
+  while (remaining.load() > 0) {
+    if (int *item = deque.pop()) {
+      take(item);
+    }
+  }
+  for (auto &thief : thieves) {
+    thief.join();
+  }
+  for (auto &count : taken) {
+    EXPECT_EQ(count.load(), 1);
+  }
+}
+
+TEST(ThreadPool, unknownTopic) {
+  EXPECT_EQ(runTask("threadpool_test_unknown", []() {}),
+            SchedulingResult::ERR_UNKNOWN_TOPIC);
+  auto result = submit("threadpool_test_unknown", []() { return 1; });
+  EXPECT_THROW(result.get(), std::future_error);
+}
+
+TEST(ThreadPool, mockTopic) {
+  mockTopic("threadpool_test_mock");
+  std::thread::id id;
+  EXPECT_EQ(runTask("threadpool_test_mock",
+                    [&id]() { id = std::this_thread::get_id(); }),
+            SchedulingResult::SCHEDULED);
+  EXPECT_EQ(id, std::this_thread::get_id());
+}
+
+TEST(ThreadPool, moveOnlyTasks) {
+  createTopic("threadpool_test");
+  std::unique_ptr<int> value(new int(42));
+  std::promise<int> promise;
+  auto result = promise.get_future();
+  struct MoveOnly {
+    std::unique_ptr<int> value;
+    std::promise<int> promise;
+    void operator()() { promise.set_value(*value); }
+  };
+  EXPECT_EQ(runTask("threadpool_test",
+                    MoveOnly{std::move(value), std::move(promise)}),
+            SchedulingResult::SCHEDULED);
+  EXPECT_EQ(result.get(), 42);
+}
+
+TEST(ThreadPool, submit) {
+  createTopic("threadpool_test");
+  createTopic("threadpool_test_high", 3);
+  std::vector<std::future<int>> results;
+  for (int i = 0; i < 1000; i++) {
+    results.push_back(submit(i % 2 ? "threadpool_test" : "threadpool_test_high",
+                             [i]() { return i * i; }));
+  }
+  for (int i = 0; i < 1000; i++) {
+    EXPECT_EQ(results[i].get(), i * i);
+  }
+  auto failed = submit("threadpool_test", []() -> int {
+    throw std::runtime_error("failed");
+  });
+  EXPECT_THROW(failed.get(), std::runtime_error);
+}
+
+TEST(ThreadPool, submitThen) {
+  createTopic("threadpool_test");
+  createTopic("threadpool_test_high", 3);
+  std::promise<int> squared;
+  auto squared_result = squared.get_future();
+  EXPECT_EQ(submitThen("threadpool_test", []() { return 7; },
+                       "threadpool_test_high",
+                       [&squared](std::future<int> result) {
+                         int value = result.get();
+                         squared.set_value(value * value);
+                       }),
+            SchedulingResult::SCHEDULED);
+  EXPECT_EQ(squared_result.get(), 49);
+
+  // Exceptions reach the continuation, which runs even if its topic
+  // doesn't exist.
+  std::promise<bool> threw;
+  auto threw_result = threw.get_future();
+  EXPECT_EQ(submitThen("threadpool_test_high",
+                       []() { throw std::runtime_error("failed"); },
+                       "threadpool_test_unknown",
+                       [&threw](std::future<void> result) {
+                         try {
+                           result.get();
+                           threw.set_value(false);
+                         } catch (const std::runtime_error &) {
+                           threw.set_value(true);
+                         }
+                       }),
+            SchedulingResult::SCHEDULED);
+  EXPECT_TRUE(threw_result.get());
+
+  EXPECT_EQ(submitThen("threadpool_test_unknown", []() {}, "threadpool_test",
+                       [](std::future<void>) { FAIL(); }),
+            SchedulingResult::ERR_UNKNOWN_TOPIC);
+}
+
+// Recursively splits a range into tasks scheduled from the workers.
+void sumRange(int begin, int end, std::atomic<int64_t> *sum,
+              std::shared_ptr<std::promise<void>> done,
+              std::shared_ptr<std::atomic<int>> pending) {
+  while (end - begin > 16) {
+    int middle = begin + (end - begin) / 2;
+    (*pending)++;
+    runTask("threadpool_test", [=]() {
+      sumRange(middle, end, sum, done, pending);
+    });
+    end = middle;
+  }
+  for (int i = begin; i < end; i++) {
+    *sum += i;
+  }
+  if (--*pending == 0) {
+    done->set_value();
+  }
+}
+
+TEST(ThreadPool, nestedTasks) {
+  createTopic("threadpool_test");
+  std::atomic<int64_t> sum(0);
+  auto done = std::make_shared<std::promise<void>>();
+  auto pending = std::make_shared<std::atomic<int>>(1);
+  auto finished = done->get_future();
+  runTask("threadpool_test", [&sum, done, pending]() {
+    sumRange(0, 100000, &sum, done, pending);
+  });
+  finished.wait();
+  EXPECT_EQ(sum.load(), int64_t(100000) * 99999 / 2);
+}
+
+// Runs in a separate process, so that the rest of the tests keep their pool.
+void shutdownAndExit() {
+  setWorkerCount(4);
+  createTopic("threadpool_test");
+  std::atomic<int> done(0);
+  for (int i = 0; i < 1000; i++) {
+    runTask("threadpool_test", [&done]() {
+      // Tasks scheduled by tasks are still run before shutdown returns.
+      runTask("threadpool_test", [&done]() { done++; });
+    });
+  }
+  shutdown();
+  bool ok = done.load() == 1000;
+  ok = ok && runTask("threadpool_test", []() {}) ==
+      SchedulingResult::ERR_NO_WORKERS;
+  std::exit(ok ? 0 : 1);
+}
+
+TEST(ThreadPoolDeathTest, shutdown) {
+  ::testing::FLAGS_gtest_death_test_style = "threadsafe";
+  EXPECT_EXIT(shutdownAndExit(), ::testing::ExitedWithCode(0), "");
+}
+
+}  // namespace threadpool
+}  // namespace util
+}  // namespace veles
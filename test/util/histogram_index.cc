@@ -0,0 +1,101 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+#include <random>
+
+#include "gtest/gtest.h"
+#include "util/histogram_index.h"
+
+namespace veles {
+namespace util {
+
+static QByteArray prepare_skewed_data(size_t size) {
+  std::mt19937 generator(7);
+  QByteArray data;
+  for (size_t i = 0; i < size; ++i) {
+    // Mostly small values, with different mixes in different parts.
+    data.push_back(static_cast<char>(generator() % (16 + i / 100000)));
+  }
+  return data;
+}
+
+TEST(HistogramIndex, matchesScanning) {
+  const size_t size = 3 * 1024 * 1024 + 1234;
+  auto data = prepare_skewed_data(size);
+  auto bytes = reinterpret_cast<const uint8_t *>(data.constData());
+  HistogramIndex index(data);
+  index.build();
+  ASSERT_TRUE(index.built());
+
+  std::mt19937 generator(1);
+  std::vector<std::pair<size_t, size_t>> ranges = {
+      {0, size}, {0, 0}, {4096, 8192}, {4095, 4097}, {100, 70000},
+      {size - 5000, size}};
+  for (int i = 0; i < 100; ++i) {
+    size_t start = generator() % size;
+    size_t end = start + generator() % (size - start + 1);
+    ranges.push_back(std::make_pair(start, end));
+  }
+  for (auto range : ranges) {
+    auto expected = analysis::byteHistogram(bytes + range.first,
+                                            range.second - range.first);
+    ASSERT_EQ(expected, index.histogram(range.first, range.second));
+    ASSERT_DOUBLE_EQ(analysis::entropy(expected, range.second - range.first),
+                     index.entropy(range.first, range.second));
+  }
+}
+
+TEST(HistogramIndex, mean) {
+  QByteArray data;
+  for (int i = 0; i < 100000; ++i) {
+    data.push_back(static_cast<char>(i % 2 ? 10 : 20));
+  }
+  HistogramIndex index(data);
+  // Not built yet - the same answers, from the data.
+  ASSERT_FALSE(index.built());
+  ASSERT_DOUBLE_EQ(15, index.mean(0, 100000));
+  ASSERT_DOUBLE_EQ(1, index.entropy(1000, 99000));
+  index.build();
+  ASSERT_DOUBLE_EQ(15, index.mean(0, 100000));
+  ASSERT_DOUBLE_EQ(1, index.entropy(1000, 99000));
+  ASSERT_DOUBLE_EQ(20, index.mean(0, 1));
+  ASSERT_DOUBLE_EQ(0, index.mean(5, 5));
+}
+
+TEST(HistogramIndex, builtCallback) {
+  auto data = prepare_skewed_data(100000);
+  HistogramIndex index(data);
+  int calls = 0, removed_calls = 0;
+  index.registerBuiltCallback([&calls]() { calls++; });
+  int removed_id = index.registerBuiltCallback(
+      [&removed_calls]() { removed_calls++; });
+  index.removeBuiltCallback(removed_id);
+  index.build();
+  index.build();
+  ASSERT_EQ(1, calls);
+  ASSERT_EQ(0, removed_calls);
+}
+
+TEST(HistogramIndex, sharedPerBuffer) {
+  auto data = prepare_skewed_data(100000);
+  QByteArray copy = data;
+  auto index = HistogramIndex::forData(data);
+  ASSERT_EQ(index, HistogramIndex::forData(copy));
+  ASSERT_NE(index, HistogramIndex::forData(prepare_skewed_data(1000)));
+}
+
+}  // namespace util
+}  // namespace veles
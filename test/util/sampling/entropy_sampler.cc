@@ -0,0 +1,83 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <random>
+
+#include "mock_sampler.h"
+#include "util/sampling/entropy_sampler.h"
+
+namespace veles {
+namespace util {
+
+// 90% zero padding followed by random bytes.
+QByteArray prepare_padded_data(size_t size) {
+  QByteArray data;
+  std::default_random_engine generator(1);
+  std::uniform_int_distribution<int> distribution(0, 255);
+  for (size_t i = 0; i < size; ++i) {
+    data.push_back(i < size / 10 * 9 ? 0 : static_cast<char>(
+        distribution(generator)));
+  }
+  return data;
+}
+
+TEST(EntropySampler, prefersHighEntropy) {
+  const size_t data_size = 1024 * 1024;
+  auto data = prepare_padded_data(data_size);
+  EntropySampler sampler(data);
+  sampler.setSampleSize(64 * 1024);
+  size_t sample_size = sampler.getSampleSize();
+  ASSERT_GT(sample_size, 60 * 1024);
+  ASSERT_LE(sample_size, 64 * 1024);
+  size_t random_bytes = 0;
+  for (size_t i = 1; i + 1 < sample_size; ++i) {
+    size_t offset = sampler.getFileOffset(i);
+    ASSERT_EQ(data[static_cast<int>(offset)], sampler[i]);
+    if (offset >= data_size / 10 * 9) ++random_bytes;
+  }
+  // Uniform sampling would spend only 10% of the sample on random data.
+  ASSERT_GT(random_bytes, sample_size / 2);
+  // Padding is still represented.
+  ASSERT_LT(random_bytes, sample_size - sample_size / 20);
+}
+
+TEST(EntropySampler, testOffsets) {
+  auto data = prepare_padded_data(64 * 1024);
+  EntropySampler sampler(data);
+  sampler.setSampleSize(4096);
+  size_t sample_size = sampler.getSampleSize();
+  ASSERT_EQ(0, sampler.getFileOffset(0));
+  ASSERT_EQ(0, sampler.getSampleOffset(0));
+  size_t prev = 0;
+  for (size_t i = 1; i < sample_size; ++i) {
+    size_t curr = sampler.getFileOffset(i);
+    ASSERT_LT(prev, curr);
+    ASSERT_LT(curr, 64 * 1024);
+    ASSERT_EQ(i, sampler.getSampleOffset(curr));
+    prev = curr;
+  }
+  prev = 0;
+  for (size_t i = 0; i < 64 * 1024; ++i) {
+    size_t curr = sampler.getSampleOffset(i);
+    ASSERT_LT(curr, sample_size);
+    ASSERT_LE(prev, curr);
+    prev = curr;
+  }
+}
+
+}  // namespace util
+}  // namespace veles
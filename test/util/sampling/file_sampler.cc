@@ -0,0 +1,75 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <memory>
+#include <vector>
+
+#include <QTemporaryFile>
+
+#include "mock_sampler.h"
+#include "util/sampling/file_sampler.h"
+
+namespace veles {
+namespace util {
+
+TEST(FileSampler, sameAsUniformSampler) {
+  QByteArray data;
+  for (size_t i = 0; i < 1024 * 1024; ++i) {
+    data.push_back(static_cast<char>((i * 2654435761u) >> 24));
+  }
+  QTemporaryFile file;
+  ASSERT_TRUE(file.open());
+  ASSERT_EQ(data.size(), file.write(data.data(), data.size()));
+  file.flush();
+
+  FileSampler file_sampler(file.fileName());
+  UniformSampler sampler(data);
+  ASSERT_FALSE(file_sampler.empty());
+  for (auto s : std::vector<ISampler*>{&file_sampler, &sampler}) {
+    s->setSampleSize(64 * 1024);
+    s->setRange(100000, 900000);
+  }
+  ASSERT_EQ(sampler.getSampleSize(), file_sampler.getSampleSize());
+  for (size_t i = 0; i < sampler.getSampleSize(); ++i) {
+    ASSERT_EQ(sampler.getFileOffset(i), file_sampler.getFileOffset(i));
+    ASSERT_EQ(sampler[i], file_sampler[i]);
+  }
+
+  // Ranges smaller than the sample are still read from the file.
+  file_sampler.setRange(1000, 2000);
+  size_t sample_size = file_sampler.getSampleSize();
+  ASSERT_GT(sample_size, 0);
+  ASSERT_LE(sample_size, 1000);
+  for (size_t i = 1; i + 1 < sample_size; ++i) {
+    ASSERT_EQ(data[static_cast<int>(file_sampler.getFileOffset(i))],
+              file_sampler[i]);
+  }
+
+  std::unique_ptr<ISampler> clone(file_sampler.clone());
+  ASSERT_EQ(sample_size, clone->getSampleSize());
+  for (size_t i = 0; i < sample_size; ++i) {
+    ASSERT_EQ(file_sampler[i], (*clone)[i]);
+  }
+}
+
+TEST(FileSampler, missingFile) {
+  FileSampler sampler("/nonexistent/veles/file");
+  ASSERT_TRUE(sampler.empty());
+}
+
+}  // namespace util
+}  // namespace veles
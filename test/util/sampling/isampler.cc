@@ -15,6 +15,10 @@
  *
  */
 
+#include <atomic>
+#include <future>
+#include <thread>
+
 #include "mock_sampler.h"
 #include "util/concurrency/threadpool.h"
 
@@ -24,6 +28,7 @@ namespace util {
 using testing::Mock;
 using testing::Return;
 using testing::Expectation;
+using testing::Invoke;
 using testing::_;
 
 /*****************************************************************************/
@@ -252,6 +257,68 @@ TEST(ISamplerAsynchronous, prepareAndApplySample) {
   ASSERT_TRUE(sampler.isFinished());
 }
 
+TEST(ISamplerAsynchronous, cancelAndCoalesce) {
+  threadpool::mockTopic("visualisation");
+  auto data = prepare_data(100);
+  MockCallback mc;
+  mc.resetCallCount();
+  testing::StrictMock<MockSampler> sampler(data);
+  sampler.allowAsynchronousResampling(true);
+  sampler.registerResampleCallback(std::ref(mc));
+  bool cancelled = false;
+  size_t prepared_size = 0;
+  // While the first resample runs, two more are requested - the first one
+  // gets cancelled and only the latest of the others is prepared.
+  EXPECT_CALL(sampler, prepareResample(_))
+    .WillOnce(Invoke([&](MockSampler::SamplerConfig *sc) {
+      EXPECT_FALSE(sampler.proxy_resampleCancelled(sc));
+      sampler.setSampleSize(20);
+      sampler.setSampleSize(30);
+      cancelled = sampler.proxy_resampleCancelled(sc);
+      return nullptr;
+    }))
+    .WillOnce(Invoke([&](MockSampler::SamplerConfig *sc) {
+      prepared_size = sc->sample_size;
+      EXPECT_FALSE(sampler.proxy_resampleCancelled(sc));
+      return nullptr;
+    }));
+  EXPECT_CALL(sampler, cleanupResample(nullptr));
+  EXPECT_CALL(sampler, applyResample(nullptr));
+  sampler.setSampleSize(10);
+  sampler.wait();
+  ASSERT_TRUE(sampler.isFinished());
+  ASSERT_TRUE(cancelled);
+  ASSERT_EQ(30u, prepared_size);
+  ASSERT_EQ(1, mc.getCallCount());
+}
+
+TEST(ISamplerAsynchronous, destroyWhileResampling) {
+  threadpool::mockTopic("visualisation");
+  auto data = prepare_data(100);
+  std::promise<void> started;
+  std::atomic<bool> returned(false);
+  std::thread resampling;
+  {
+    testing::NiceMock<MockSampler> sampler(data);
+    sampler.allowAsynchronousResampling(true);
+    // Only a cancelled resample returns, so the destructor has to cancel
+    // it and then wait for it.
+    ON_CALL(sampler, prepareResample(_))
+      .WillByDefault(Invoke([&](MockSampler::SamplerConfig *sc) {
+        started.set_value();
+        while (!sampler.proxy_resampleCancelled(sc)) {
+          std::this_thread::yield();
+        }
+        returned = true;
+        return nullptr;
+      }));
+    // The topic is mocked, so this thread does the resampling.
+    resampling = std::thread([&sampler]() { sampler.setSampleSize(10); });
+    started.get_future().wait();
+  }
+  EXPECT_TRUE(returned.load());
+  resampling.join();
+}
 
 }  // namespace util
 }  // namespace veles
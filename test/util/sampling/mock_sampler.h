@@ -24,7 +24,10 @@ namespace util {
 
 class MockSampler : public ISampler {
  public:
+  using ISampler::SamplerConfig;
+
   explicit MockSampler(const QByteArray &data) : ISampler(data) {}
+  ~MockSampler() { stopResampling(); }
   MOCK_METHOD0(cloneImpl, ISampler*());
   MOCK_METHOD0(getRealSampleSize, size_t());
   MOCK_METHOD1(getSampleByte, char(size_t index));
@@ -37,6 +40,14 @@ class MockSampler : public ISampler {
 
   size_t proxy_getDataSize() { return getDataSize(); }
   char proxy_getDataByte(size_t index) { return getDataByte(index); }
+  bool proxy_resampleCancelled(SamplerConfig *sc) {
+    return resampleCancelled(sc);
+  }
+
+ private:
+  SampleSnapshot::Layout getSampleLayout() override {
+    return SampleSnapshot::unsampled(nullptr, 0);
+  }
 
 };
 
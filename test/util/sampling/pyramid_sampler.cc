@@ -0,0 +1,152 @@
+/*
+ * Copyright 2017 CodiLime
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include <memory>
+
+#include "mock_sampler.h"
+#include "util/sampling/pyramid_sampler.h"
+#include "util/sampling/sample_pyramid.h"
+
+namespace veles {
+namespace util {
+
+// Bytes that (mostly) tell where they come from.
+static QByteArray prepare_hashed_data(size_t size) {
+  QByteArray data;
+  for (size_t i = 0; i < size; ++i) {
+    data.push_back(static_cast<char>((i * 2654435761u) >> 24));
+  }
+  return data;
+}
+
+TEST(SamplePyramid, sharedPerBuffer) {
+  auto data = prepare_hashed_data(1024 * 1024);
+  QByteArray copy = data;
+  auto pyramid = SamplePyramid::forData(data);
+  ASSERT_EQ(pyramid, SamplePyramid::forData(copy));
+  ASSERT_NE(pyramid, SamplePyramid::forData(prepare_hashed_data(1024)));
+}
+
+TEST(SamplePyramid, rawDataOwner) {
+  auto owned = std::make_shared<QByteArray>(prepare_hashed_data(1024 * 1024));
+  auto view = QByteArray::fromRawData(owned->constData(), owned->size());
+  std::weak_ptr<QByteArray> weak_owned = owned;
+  auto pyramid = SamplePyramid::forData(view, owned);
+  ASSERT_EQ(pyramid, SamplePyramid::forData(
+      QByteArray::fromRawData(view.constData(), view.size())));
+  // The pyramid keeps the data alive.
+  owned.reset();
+  ASSERT_FALSE(weak_owned.expired());
+  auto slice = pyramid->slice(1, 0, 1024 * 1024);
+  ASSERT_EQ(view.constData()[slice.window(1)], slice.data()[512]);
+}
+
+TEST(SamplePyramid, nestedLevels) {
+  const size_t data_size = 1024 * 1024 + 100;
+  auto data = prepare_hashed_data(data_size);
+  SamplePyramid pyramid(data);
+  ASSERT_GT(pyramid.levels(), 2);
+  auto finer = pyramid.slice(1, 0, data_size);
+  ASSERT_EQ(data_size / 512 / 2, finer.count);
+  for (int level = 2; level <= pyramid.levels(); ++level) {
+    auto coarser = pyramid.slice(level, 0, data_size);
+    ASSERT_EQ((finer.count + 1) / 2, coarser.count);
+    size_t j = 0;
+    for (size_t i = 0; i < coarser.count; ++i) {
+      while (finer.window(j) < coarser.window(i)) ++j;
+      ASSERT_EQ(finer.window(j), coarser.window(i));
+    }
+    finer = coarser;
+  }
+  // Parts of levels are parts of whole levels.
+  auto whole = pyramid.slice(1, 0, data_size);
+  auto part = pyramid.slice(1, 100000, 300000);
+  size_t first = 0;
+  while (whole.window(first) < 100000) ++first;
+  for (size_t i = 0; i < part.count; ++i) {
+    ASSERT_EQ(whole.window(first + i), part.window(i));
+    ASSERT_LE(part.window(i) + 512, 300000);
+  }
+  ASSERT_GT(whole.window(first + part.count) + 512, 300000);
+}
+
+TEST(PyramidSampler, testOffsets) {
+  const size_t data_size = 1024 * 1024;
+  auto data = prepare_hashed_data(data_size);
+  PyramidSampler sampler(data);
+  sampler.setSampleSize(64 * 1024);
+  size_t sample_size = sampler.getSampleSize();
+  ASSERT_GE(sample_size, 64 * 1024);
+  ASSERT_LT(sample_size, 128 * 1024);
+  ASSERT_EQ(0, sampler.getFileOffset(0));
+  ASSERT_EQ(0, sampler.getSampleOffset(0));
+  size_t prev = 0;
+  for (size_t i = 1; i + 1 < sample_size; ++i) {
+    size_t curr = sampler.getFileOffset(i);
+    ASSERT_LT(prev, curr);
+    ASSERT_EQ(data[static_cast<int>(curr)], sampler[i]);
+    ASSERT_EQ(i, sampler.getSampleOffset(curr));
+    prev = curr;
+  }
+  prev = 0;
+  for (size_t i = 0; i < data_size; ++i) {
+    size_t curr = sampler.getSampleOffset(i);
+    ASSERT_LT(curr, sample_size);
+    ASSERT_LE(prev, curr);
+    prev = curr;
+  }
+}
+
+TEST(PyramidSampler, range) {
+  const size_t data_size = 1024 * 1024;
+  auto data = prepare_hashed_data(data_size);
+  PyramidSampler sampler(data);
+  sampler.setSampleSize(4096);
+  sampler.setRange(200000, 300000);
+  size_t sample_size = sampler.getSampleSize();
+  ASSERT_GE(sample_size, 4096);
+  for (size_t i = 1; i + 1 < sample_size; ++i) {
+    size_t offset = sampler.getFileOffset(i);
+    ASSERT_GE(offset, 200000);
+    ASSERT_LT(offset, 300000);
+    ASSERT_EQ(data[static_cast<int>(offset)], sampler[i]);
+  }
+
+  std::unique_ptr<ISampler> clone(sampler.clone());
+  ASSERT_EQ(sample_size, clone->getSampleSize());
+
+  // Too small for any window of the pyramid.
+  sampler.setRange(1000, 1500);
+  sampler.setSampleSize(100);
+  ASSERT_EQ(100, sampler.getSampleSize());
+  ASSERT_EQ(data[1010], sampler[10]);
+}
+
+TEST(PyramidSampler, smallData) {
+  // Too small for the pyramid to have any levels.
+  auto data = prepare_hashed_data(700);
+  PyramidSampler sampler(data);
+  sampler.setSampleSize(100);
+  ASSERT_EQ(100, sampler.getSampleSize());
+  for (size_t i = 0; i + 1 < 100; ++i) {
+    ASSERT_EQ(i, sampler.getFileOffset(i));
+    ASSERT_EQ(data[static_cast<int>(i)], sampler[i]);
+  }
+}
+
+}  // namespace util
+}  // namespace veles
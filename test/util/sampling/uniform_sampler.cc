@@ -15,6 +15,9 @@
  *
  */
 
+#include <set>
+#include <string>
+
 #include "mock_sampler.h"
 #include "util/sampling/uniform_sampler.h"
 
@@ -69,5 +72,111 @@ TEST(UniformSampler, testOffsets) {
   }
 }
 
+// Returns file offsets of all windows but the first (whose offset is
+// reported as the start of range), checking that they match the data.
+std::vector<size_t> windowOffsets(UniformSampler *sampler,
+                                  const QByteArray &data, size_t window_size) {
+  std::vector<size_t> result;
+  auto range = sampler->getRange();
+  for (size_t i = window_size; i < sampler->getSampleSize();
+       i += window_size) {
+    size_t offset = sampler->getFileOffset(i);
+    EXPECT_GE(offset, range.first);
+    EXPECT_LE(offset + window_size, range.second);
+    if (!result.empty()) {
+      EXPECT_GE(offset, result.back() + window_size);
+    }
+    for (size_t j = 0; j < window_size; ++j) {
+      EXPECT_EQ(data[static_cast<int>(offset + j)], sampler->data()[i + j]);
+    }
+    result.push_back(offset);
+  }
+  return result;
+}
+
+TEST(UniformSampler, seed) {
+  auto data = prepare_data(100000);
+  UniformSampler sampler1(data), sampler2(data);
+  sampler1.setSampleSize(1000);
+  sampler2.setSampleSize(1000);
+  auto sample = std::string(sampler1.data(), sampler1.getSampleSize());
+  ASSERT_EQ(sample, std::string(sampler2.data(), sampler2.getSampleSize()));
+  sampler2.setSeed(1);
+  ASSERT_NE(sample, std::string(sampler2.data(), sampler2.getSampleSize()));
+  sampler1.setSeed(1);
+  ASSERT_EQ(std::string(sampler1.data(), sampler1.getSampleSize()),
+            std::string(sampler2.data(), sampler2.getSampleSize()));
+}
+
+TEST(UniformSampler, incrementalResampling) {
+  auto data = prepare_data(100000);
+  UniformSampler sampler(data);
+  sampler.setIncrementalResampling(true);
+  sampler.setSampleSize(1000);
+  sampler.setWindowSize(10);
+  ASSERT_EQ(1000, sampler.getSampleSize());
+  auto before = windowOffsets(&sampler, data, 10);
+
+  // Zooming in keeps the windows in range and adds new ones.
+  sampler.setRange(20000, 60000);
+  ASSERT_EQ(1000, sampler.getSampleSize());
+  auto after = windowOffsets(&sampler, data, 10);
+  std::set<size_t> after_set(after.begin(), after.end());
+  size_t in_range = 0;
+  for (auto offset : before) {
+    if (offset > 20000 && offset + 10 <= 60000) {
+      in_range++;
+      // Unless it became the first window, whose offset we don't know.
+      EXPECT_TRUE(after_set.count(offset) == 1 || offset < after.front());
+    }
+  }
+  ASSERT_GT(in_range, 0u);
+  ASSERT_LT(in_range, after.size());
+
+  // Zooming out again keeps all of them.
+  sampler.setRange(0, 100000);
+  auto zoomed_out = windowOffsets(&sampler, data, 10);
+  std::set<size_t> zoomed_out_set(zoomed_out.begin(), zoomed_out.end());
+  for (auto offset : after) {
+    EXPECT_EQ(1u, zoomed_out_set.count(offset));
+  }
+}
+
+TEST(UniformSampler, snapshot) {
+  auto data = prepare_data(100000);
+  UniformSampler sampler(data);
+  ASSERT_TRUE(sampler.snapshot()->empty());
+  sampler.setSampleSize(1000);
+  sampler.setWindowSize(10);
+  auto snapshot = sampler.snapshot();
+  ASSERT_EQ(sampler.getRange(), snapshot->getRange());
+  ASSERT_EQ(sampler.getSampleSize(), snapshot->getSampleSize());
+  std::vector<char> contents(snapshot->data(),
+                             snapshot->data() + snapshot->getSampleSize());
+  for (size_t i = 0; i <= snapshot->getSampleSize(); ++i) {
+    ASSERT_EQ(sampler.getFileOffset(i), snapshot->getFileOffset(i));
+  }
+  for (size_t i = 0; i < 100000; i += 7) {
+    ASSERT_EQ(sampler.getSampleOffset(i), snapshot->getSampleOffset(i));
+  }
+
+  // The old sample stays as it was, the new one gets its own snapshot.
+  sampler.setRange(20000, 60000);
+  ASSERT_NE(snapshot, sampler.snapshot());
+  ASSERT_EQ(std::make_pair(size_t(20000), size_t(60000)),
+            sampler.snapshot()->getRange());
+  ASSERT_EQ(std::make_pair(size_t(0), size_t(100000)), snapshot->getRange());
+  for (size_t i = 0; i < contents.size(); ++i) {
+    ASSERT_EQ(contents[i], (*snapshot)[i]);
+  }
+
+  // Without sampling the snapshot is the range itself.
+  sampler.setSampleSize(100000);
+  snapshot = sampler.snapshot();
+  ASSERT_EQ(40000, snapshot->getSampleSize());
+  ASSERT_EQ(data.data() + 20000, snapshot->data());
+  ASSERT_EQ(20123, snapshot->getFileOffset(123));
+}
+
 }  // namespace util
 }  // namespace veles